@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_http_client.h"
+#include "cJSON.h"
+
+#include "aws_credentials.h"
+
+static const char *TAG = "aws_credentials";
+
+static int _copy_string(char *output, size_t output_size, const char *value)
+{
+    size_t len = value ? strlen(value) : 0;
+    if (len >= output_size) {
+        return -1;
+    }
+    memcpy(output, value ? value : "", len + 1);
+    return 0;
+}
+
+/**
+ * Parse an ISO 8601 time in UTC, e.g. 2024-05-01T12:00:00Z. The date is counted in days since the epoch by hand, as
+ * newlib has no timegm.
+ */
+static int _parse_time(const char *text, time_t *output)
+{
+    int year, month, day, hour, minute, second;
+    if (sscanf(text, "%4d-%2d-%2dT%2d:%2d:%2d", &year, &month, &day, &hour, &minute, &second) != 6) {
+        return -1;
+    }
+    if (year < 1970 || month < 1 || month > 12 || day < 1 || day > 31) {
+        return -1;
+    }
+
+    /* Shift the year to start in March, so the leap day is the last day of the year */
+    int y = year - (month <= 2);
+    int era = y / 400;
+    int year_of_era = y - era * 400;
+    int day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    int day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    long long days = (long long)era * 146097 + day_of_era - 719468;
+
+    *output = (time_t)(days * 86400 + hour * 3600 + minute * 60 + second);
+    return 0;
+}
+
+esp_err_t aws_credentials_parse(const char *json, size_t json_len, aws_credentials_t *credentials)
+{
+    esp_err_t err = ESP_OK;
+    cJSON *root = cJSON_ParseWithLength(json, json_len);
+    const char *access_key = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(root, "AccessKeyId"));
+    const char *secret_key = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(root, "SecretAccessKey"));
+    const char *session_token = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(root, "Token"));
+    const char *expiration = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(root, "Expiration"));
+
+    memset(credentials, 0, sizeof(aws_credentials_t));
+    if (access_key == NULL || secret_key == NULL ||
+        _copy_string(credentials->access_key, sizeof(credentials->access_key), access_key) != 0 ||
+        _copy_string(credentials->secret_key, sizeof(credentials->secret_key), secret_key) != 0 ||
+        _copy_string(credentials->session_token, sizeof(credentials->session_token), session_token) != 0 ||
+        (expiration != NULL && _parse_time(expiration, &credentials->expiration) != 0)) {
+        memset(credentials, 0, sizeof(aws_credentials_t));
+        err = ESP_ERR_INVALID_RESPONSE;
+    }
+
+    cJSON_Delete(root);
+    return err;
+}
+
+esp_err_t aws_credentials_fetch_static(void *user_data, aws_credentials_t *credentials)
+{
+    aws_static_credentials_t *source = (aws_static_credentials_t *)user_data;
+
+    memset(credentials, 0, sizeof(aws_credentials_t));
+    if (_copy_string(credentials->access_key, sizeof(credentials->access_key), source->access_key) != 0 ||
+        _copy_string(credentials->secret_key, sizeof(credentials->secret_key), source->secret_key) != 0 ||
+        _copy_string(credentials->session_token, sizeof(credentials->session_token), source->session_token) != 0) {
+        memset(credentials, 0, sizeof(aws_credentials_t));
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+esp_err_t aws_credentials_fetch_endpoint(void *user_data, aws_credentials_t *credentials)
+{
+    aws_credentials_endpoint_t *endpoint = (aws_credentials_endpoint_t *)user_data;
+    esp_http_client_config_t config = {
+        .url = endpoint->url,
+        .method = HTTP_METHOD_GET,
+        .timeout_ms = AWS_CREDENTIALS_TIMEOUT_MS,
+        .disable_auto_redirect = true,
+    };
+
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (client == NULL) {
+        return ESP_FAIL;
+    }
+    if (endpoint->authorization && strlen(endpoint->authorization) > 0) {
+        esp_http_client_set_header(client, "Authorization", endpoint->authorization);
+    }
+
+    esp_err_t err = esp_http_client_open(client, 0);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to connect to the credentials endpoint: %s", esp_err_to_name(err));
+        esp_http_client_cleanup(client);
+        return err;
+    }
+
+    int data_read = -1;
+    if (esp_http_client_fetch_headers(client) >= 0) {
+        data_read = esp_http_client_read_response(client, endpoint->response, sizeof(endpoint->response) - 1);
+    }
+    int status_code = esp_http_client_get_status_code(client);
+    if (data_read < 0) {
+        ESP_LOGE(TAG, "Failed to read the response of the credentials endpoint");
+        err = ESP_FAIL;
+    } else if (status_code != 200) {
+        ESP_LOGE(TAG, "Credentials endpoint answered with status %d", status_code);
+        err = ESP_FAIL;
+    } else if (!esp_http_client_is_complete_data_received(client)) {
+        ESP_LOGE(TAG, "Credentials are larger than %d bytes", (int)sizeof(endpoint->response) - 1);
+        err = ESP_ERR_INVALID_SIZE;
+    } else {
+        endpoint->response[data_read] = '\0';
+        err = aws_credentials_parse(endpoint->response, data_read, credentials);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to parse the credentials");
+        }
+    }
+
+    /* The response holds the secret */
+    memset(endpoint->response, 0, sizeof(endpoint->response));
+    esp_http_client_cleanup(client);
+    return err;
+}
@@ -0,0 +1,101 @@
+#ifndef _AWS_CREDENTIALS_H_
+#define _AWS_CREDENTIALS_H_
+
+#include <time.h>
+#include "esp_err.h"
+#include "aws_sig_v4_signing.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AWS_CREDENTIALS_ACCESS_KEY_SIZE (129)
+#define AWS_CREDENTIALS_SECRET_KEY_SIZE (AWS_SIG_V4_SECRET_KEY_MAX_LENGTH + 1)
+#define AWS_CREDENTIALS_SESSION_TOKEN_SIZE (2048)
+#define AWS_CREDENTIALS_RESPONSE_SIZE (4096)
+#define AWS_CREDENTIALS_TIMEOUT_MS (10000)
+
+/**
+ * @brief      AWS credentials, either long-term keys or temporary credentials of STS
+ */
+typedef struct {
+    char   access_key[AWS_CREDENTIALS_ACCESS_KEY_SIZE];          /*!< Access key ID */
+    char   secret_key[AWS_CREDENTIALS_SECRET_KEY_SIZE];          /*!< Secret access key */
+    char   session_token[AWS_CREDENTIALS_SESSION_TOKEN_SIZE];    /*!< Session token, empty for long-term keys */
+    time_t expiration;                                           /*!< When the credentials expire, 0 if they never do */
+} aws_credentials_t;
+
+/**
+ * @brief      Fetch a fresh set of credentials. It may block, e.g. on a HTTP request.
+ *
+ * @param      user_data    The user data of the provider
+ * @param      credentials  Output of the credentials
+ *
+ * @return     ESP_OK on success
+ */
+typedef esp_err_t (*aws_credentials_fetch_t)(void *user_data, aws_credentials_t *credentials);
+
+/**
+ * @brief      A source of credentials
+ */
+typedef struct {
+    aws_credentials_fetch_t fetch;      /*!< Fetches the credentials */
+    void                    *user_data; /*!< Passed to fetch */
+} aws_credentials_provider_t;
+
+/**
+ * @brief      Credentials built into the firmware, for aws_credentials_fetch_static
+ */
+typedef struct {
+    const char *access_key;             /*!< Access key ID */
+    const char *secret_key;             /*!< Secret access key */
+    const char *session_token;          /*!< Session token, NULL for long-term keys */
+} aws_static_credentials_t;
+
+/**
+ * @brief      A HTTP endpoint that hands out temporary credentials, for aws_credentials_fetch_endpoint. It answers a
+ *             GET with the JSON of the container credentials, e.g.
+ *             `{"AccessKeyId": "...", "SecretAccessKey": "...", "Token": "...", "Expiration": "2024-05-01T12:00:00Z"}`
+ */
+typedef struct {
+    const char *url;                                /*!< URL of the endpoint */
+    const char *authorization;                      /*!< Value of the Authorization header, NULL or "" for none */
+    char       response[AWS_CREDENTIALS_RESPONSE_SIZE]; /*!< Buffer for the response */
+} aws_credentials_endpoint_t;
+
+/**
+ * @brief      Fetch the credentials built into the firmware. They never expire.
+ *
+ * @param      user_data    The aws_static_credentials_t
+ * @param      credentials  Output of the credentials
+ *
+ * @return     ESP_OK on success, ESP_ERR_INVALID_SIZE if a key doesn't fit
+ */
+esp_err_t aws_credentials_fetch_static(void *user_data, aws_credentials_t *credentials);
+
+/**
+ * @brief      Fetch temporary credentials from a HTTP endpoint
+ *
+ * @param      user_data    The aws_credentials_endpoint_t
+ * @param      credentials  Output of the credentials
+ *
+ * @return     ESP_OK on success
+ */
+esp_err_t aws_credentials_fetch_endpoint(void *user_data, aws_credentials_t *credentials);
+
+/**
+ * @brief      Parse the JSON of the container credentials. The expiration is optional.
+ *
+ * @param      json         The JSON
+ * @param      json_len     The length of the JSON
+ * @param      credentials  Output of the credentials, wiped on failure
+ *
+ * @return     ESP_OK on success, ESP_ERR_INVALID_RESPONSE if a field is missing or doesn't fit
+ */
+esp_err_t aws_credentials_parse(const char *json, size_t json_len, aws_credentials_t *credentials);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
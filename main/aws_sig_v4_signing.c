@@ -24,36 +24,35 @@
 
 #include <stdlib.h>
 #include <string.h>
-#include <stdio.h>
-#include <stdarg.h>
-#include "freertos/FreeRTOS.h"
 #include "aws_sig_v4_signing.h"
+#include "hex.h"
 
 #define HASH_LENGHT (32)
-#define HASH_HEX_LENGTH (65)
+#define HASH_HEX_LENGTH AWS_SIG_V4_HASH_HEX_LENGTH
 static const char *aws_algorithm = "AWS4-HMAC-SHA256";
+static const char *session_token_signed_header = ";x-amz-security-token";
 #define GET_BUFFER(ctx) (ctx->buffer + ctx->buffer_offset)
 #define NEXT_BUFFER(ctx, len) (ctx->buffer_offset += len)
 #define REMAIN_BUFFER(ctx) (AWS_SIG_V4_BUFFER_SIZE - ctx->buffer_offset)
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
 
-static void _hmac(char *output, const char *key, int key_size, const char *payload, int payload_size)
+/* The parts of the canonical request and the string to sign go into the hash as they are, without being copied. */
+#define SHA256_UPDATE(ctx, data, len) mbedtls_sha256_update(&(ctx)->sha256_ctx, (const unsigned char *)(data), (len))
+#define SHA256_UPDATE_STRING(ctx, str) SHA256_UPDATE(ctx, str, strlen(str))
+#define HMAC_UPDATE(ctx, data, len) mbedtls_md_hmac_update(&(ctx)->md_ctx, (const unsigned char *)(data), (len))
+#define HMAC_UPDATE_STRING(ctx, str) HMAC_UPDATE(ctx, str, strlen(str))
+
+/* Bytes are read as unsigned, so hashes come out right whatever the signedness of char. */
+static void hex_encode_hash(char *output, const char *hash)
 {
-    mbedtls_md_context_t ctx;
-    mbedtls_md_init(&ctx);
-    mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1);
-    mbedtls_md_hmac_starts(&ctx, (const unsigned char *) key, key_size);
-    mbedtls_md_hmac_update(&ctx, (const unsigned char *) payload, payload_size);
-    mbedtls_md_hmac_finish(&ctx, (unsigned char *)output);
-    mbedtls_md_free(&ctx);
+    Hex_encode(output, (const uint8_t *)hash, HASH_LENGHT);
 }
-static void _hmac_hex(char *output, const char *key, int key_size, const char *payload, int payload_size)
+
+static void _hmac(mbedtls_md_context_t *md_ctx, char *output, const char *key, int key_size, const char *payload, int payload_size)
 {
-    char hmac[HASH_LENGHT];
-    _hmac(hmac, key, key_size, payload, payload_size);
-    for (int i = 0; i < sizeof(hmac); i++) {
-        sprintf(output + i * 2, "%02x", (int)hmac[i]);
-    }
-    output[HASH_HEX_LENGTH - 1] = 0;
+    mbedtls_md_hmac_starts(md_ctx, (const unsigned char *) key, key_size);
+    mbedtls_md_hmac_update(md_ctx, (const unsigned char *) payload, payload_size);
+    mbedtls_md_hmac_finish(md_ctx, (unsigned char *)output);
 }
 
 static void _sha256_hex(char *output, const char *data, int data_len)
@@ -65,93 +64,269 @@ static void _sha256_hex(char *output, const char *data, int data_len)
     mbedtls_sha256_update(&ctx, (const unsigned char*)data, data_len);
     mbedtls_sha256_finish(&ctx, (unsigned char *)sha256_res);
     mbedtls_sha256_free(&ctx);
-    for (int i = 0; i < sizeof(sha256_res); i++) {
-        sprintf(output + i * 2, "%02x", (int)sha256_res[i]);
-    }
-    output[HASH_HEX_LENGTH - 1] = 0;
+    hex_encode_hash(output, sha256_res);
 }
 
-static void _get_signature_key(char *output, const char *aws4_key, const char *date_stamp, const char *region_name, const char *service_name)
+static int _get_signature_key(mbedtls_md_context_t *md_ctx, char *output, const char *secret_key, const char *date_stamp,
+                              const char *region_name, int region_name_len, const char *service_name, int service_name_len)
 {
+    char aws4_key[4 + AWS_SIG_V4_SECRET_KEY_MAX_LENGTH];
     char k_date[HASH_LENGHT], k_region[HASH_LENGHT], k_service[HASH_LENGHT];
-    _hmac(k_date, aws4_key, strlen(aws4_key), date_stamp, strlen(date_stamp));
-    _hmac(k_region, k_date, HASH_LENGHT, region_name, strlen(region_name));
-    _hmac(k_service, k_region, HASH_LENGHT, service_name, strlen(service_name));
-    _hmac(output, k_service, HASH_LENGHT, "aws4_request", strlen("aws4_request"));
+    int secret_key_len = strlen(secret_key);
+    if (secret_key_len > AWS_SIG_V4_SECRET_KEY_MAX_LENGTH) {
+        return -1;
+    }
+    memcpy(aws4_key, "AWS4", 4);
+    memcpy(aws4_key + 4, secret_key, secret_key_len);
+    _hmac(md_ctx, k_date, aws4_key, 4 + secret_key_len, date_stamp, strlen(date_stamp));
+    _hmac(md_ctx, k_region, k_date, HASH_LENGHT, region_name, region_name_len);
+    _hmac(md_ctx, k_service, k_region, HASH_LENGHT, service_name, service_name_len);
+    _hmac(md_ctx, output, k_service, HASH_LENGHT, "aws4_request", strlen("aws4_request"));
+    memset(aws4_key, 0, sizeof(aws4_key));
+    return 0;
 }
 
+/**
+ * The signing key is derived from the date, the region and service, which the scope suffix of the template holds,
+ * and the secret. The cache key is these inputs, each terminated by a null character.
+ */
+#define SIGNING_KEY_INPUTS(tmpl, config) { (config)->date_stamp, (tmpl)->scope_suffix, (config)->secret_key }
+#define SIGNING_KEY_INPUTS_COUNT (3)
 
-char *aws_sig_v4_signing_header(aws_sig_v4_context_t *ctx, aws_sig_v4_config_t *config)
+static int _signing_key_cache_hit(aws_sig_v4_context_t *ctx, const aws_sig_v4_template_t *tmpl, aws_sig_v4_config_t *config)
+{
+    const char *inputs[SIGNING_KEY_INPUTS_COUNT] = SIGNING_KEY_INPUTS(tmpl, config);
+    const char *cached = ctx->signing_key_inputs;
+
+    if (!ctx->signing_key_valid) {
+        return 0;
+    }
+    for (int i = 0; i < SIGNING_KEY_INPUTS_COUNT; i++) {
+        if (strcmp(cached, inputs[i]) != 0) {
+            return 0;
+        }
+        cached += strlen(cached) + 1;
+    }
+    return 1;
+}
+
+static void _signing_key_cache_store(aws_sig_v4_context_t *ctx, const aws_sig_v4_template_t *tmpl, aws_sig_v4_config_t *config)
+{
+    const char *inputs[SIGNING_KEY_INPUTS_COUNT] = SIGNING_KEY_INPUTS(tmpl, config);
+    int offset = 0;
+
+    for (int i = 0; i < SIGNING_KEY_INPUTS_COUNT; i++) {
+        int len = strlen(inputs[i]) + 1;
+        if (offset + len > sizeof(ctx->signing_key_inputs)) {
+            /* Too long to be cached, derive the key on every request */
+            ctx->signing_key_valid = 0;
+            return;
+        }
+        memcpy(ctx->signing_key_inputs + offset, inputs[i], len);
+        offset += len;
+    }
+    ctx->signing_key_valid = 1;
+}
+
+/**
+ * Concatenate the parts into the output, where a NULL part is empty.
+ *
+ * @return The length of the output, -1 if it doesn't fit
+ */
+static int _compose(char *output, int output_size, const char *parts[], int parts_count)
 {
+    int len = 0;
+    for (int i = 0; i < parts_count; i++) {
+        const char *part = parts[i] ? parts[i] : "";
+        int part_len = strlen(part);
+        if (len + part_len >= output_size) {
+            return -1;
+        }
+        memcpy(output + len, part, part_len);
+        len += part_len;
+    }
+    output[len] = '\0';
+    return len;
+}
+
+/**
+ * Append to the Authorization header in the buffer of the context. It is cut short rather than overflow the buffer,
+ * which only happens for an access key far longer than any issued.
+ */
+static void _append_header(aws_sig_v4_context_t *ctx, const char *data, int data_len)
+{
+    if (data_len > REMAIN_BUFFER(ctx) - 1) {
+        data_len = REMAIN_BUFFER(ctx) - 1;
+    }
+    memcpy(GET_BUFFER(ctx), data, data_len);
+    NEXT_BUFFER(ctx, data_len);
+    *GET_BUFFER(ctx) = '\0';
+}
+
+void aws_sig_v4_init(aws_sig_v4_context_t *ctx)
+{
+    memset(ctx, 0, sizeof(aws_sig_v4_context_t));
+    mbedtls_md_init(&ctx->md_ctx);
+    mbedtls_md_setup(&ctx->md_ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1);
+}
+
+void aws_sig_v4_free(aws_sig_v4_context_t *ctx)
+{
+    mbedtls_md_free(&ctx->md_ctx);
     memset(ctx, 0, sizeof(aws_sig_v4_context_t));
+}
 
-    char *payload_hash = GET_BUFFER(ctx);
+int aws_sig_v4_derive_signing_key(aws_sig_v4_config_t *config, char signing_key[AWS_SIG_V4_SIGNING_KEY_LENGTH])
+{
+    mbedtls_md_context_t md_ctx;
+    mbedtls_md_init(&md_ctx);
+    mbedtls_md_setup(&md_ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1);
+    int ret = _get_signature_key(&md_ctx, signing_key, config->secret_key, config->date_stamp,
+                                 config->region_name, strlen(config->region_name), config->service_name, strlen(config->service_name));
+    mbedtls_md_free(&md_ctx);
+    return ret;
+}
+
+int aws_sig_v4_template_init(aws_sig_v4_template_t *tmpl, aws_sig_v4_config_t *config)
+{
+    int has_signed_headers = config->signed_headers && strlen(config->signed_headers) > 0;
+    const char *canonical_prefix[] = {
+        config->method, "\n", config->path, "\n", config->query, "\n", config->canonical_headers, "host:", config->host, "\nx-amz-date:"
+    };
+    const char *scope_suffix[] = { "/", config->region_name, "/", config->service_name, "/aws4_request" };
+    const char *signed_headers[] = { config->signed_headers, has_signed_headers ? ";" : "", "host;x-amz-date" };
+
+    memset(tmpl, 0, sizeof(aws_sig_v4_template_t));
+    tmpl->canonical_prefix_len = _compose(tmpl->canonical_prefix, sizeof(tmpl->canonical_prefix), canonical_prefix, ARRAY_SIZE(canonical_prefix));
+    tmpl->scope_suffix_len = _compose(tmpl->scope_suffix, sizeof(tmpl->scope_suffix), scope_suffix, ARRAY_SIZE(scope_suffix));
+    tmpl->signed_headers_len = _compose(tmpl->signed_headers, sizeof(tmpl->signed_headers), signed_headers, ARRAY_SIZE(signed_headers));
+    if (tmpl->canonical_prefix_len < 0 || tmpl->scope_suffix_len < 0 || tmpl->signed_headers_len < 0) {
+        return -1;
+    }
+    tmpl->region_name_len = strlen(config->region_name);
+    tmpl->service_name_len = strlen(config->service_name);
+    return 0;
+}
+
+void aws_sig_v4_payload_hash_start(aws_sig_v4_context_t *ctx)
+{
+    mbedtls_sha256_init(&ctx->sha256_ctx);
+    mbedtls_sha256_starts(&ctx->sha256_ctx, 0); /* SHA-256, not 224 */
+}
+
+void aws_sig_v4_payload_hash_update(aws_sig_v4_context_t *ctx, const char *data, size_t data_len)
+{
+    mbedtls_sha256_update(&ctx->sha256_ctx, (const unsigned char *)data, data_len);
+}
+
+void aws_sig_v4_payload_hash_finish(aws_sig_v4_context_t *ctx, char payload_hash[AWS_SIG_V4_HASH_HEX_LENGTH])
+{
+    unsigned char sha256_res[HASH_LENGHT];
+    mbedtls_sha256_finish(&ctx->sha256_ctx, sha256_res);
+    mbedtls_sha256_free(&ctx->sha256_ctx);
+    hex_encode_hash(payload_hash, (const char *)sha256_res);
+}
+
+char *aws_sig_v4_signing_header(aws_sig_v4_context_t *ctx, aws_sig_v4_config_t *config)
+{
+    char payload_hash[HASH_HEX_LENGTH];
     _sha256_hex(payload_hash, config->payload, config->payload_len);
-    NEXT_BUFFER(ctx, HASH_HEX_LENGTH);
-
-    char *canonical_request = GET_BUFFER(ctx);
-    char separate = config->signed_headers && strlen(config->signed_headers) > 0 ? ';' : 0;
-    int canonical_request_len = snprintf(canonical_request,
-                                         REMAIN_BUFFER(ctx),
-                                         "%s\n%s\n%s\n%shost:%s\nx-amz-date:%s\n\n%s%chost;x-amz-date\n%s",
-                                         config->method,
-                                         config->path,
-                                         config->query,
-                                         config->canonical_headers,
-                                         config->host,
-                                         config->amz_date,
-                                         config->signed_headers,
-                                         separate,
-                                         payload_hash);
-    NEXT_BUFFER(ctx, canonical_request_len + 1);
-
-    char *canonical_request_sha256 = GET_BUFFER(ctx);
-    _sha256_hex(canonical_request_sha256, canonical_request, canonical_request_len);
-    NEXT_BUFFER(ctx, HASH_HEX_LENGTH);
-
-    char *credential_scope = GET_BUFFER(ctx);
-    int credential_scope_len = snprintf(credential_scope,
-                                        REMAIN_BUFFER(ctx),
-                                        "%s/%s/%s/aws4_request",
-                                        config->date_stamp,
-                                        config->region_name,
-                                        config->service_name);
-    NEXT_BUFFER(ctx, credential_scope_len + 1);
-
-    char *aws4_key = GET_BUFFER(ctx);
-    int aws4_key_len = snprintf(aws4_key,
-                                REMAIN_BUFFER(ctx),
-                                "AWS4%s",
-                                config->secret_key);
-    NEXT_BUFFER(ctx, aws4_key_len);
-
-    char *signing_key = GET_BUFFER(ctx);
-    _get_signature_key(signing_key, aws4_key, config->date_stamp, config->region_name, config->service_name);
-    NEXT_BUFFER(ctx, HASH_LENGHT);
-
-    char *string_to_sign = GET_BUFFER(ctx);
-    int string_to_sign_len = snprintf(string_to_sign,
-                                      REMAIN_BUFFER(ctx),
-                                      "%s\n%s\n%s\n%s",
-                                      aws_algorithm,
-                                      config->amz_date,
-                                      credential_scope,
-                                      canonical_request_sha256);
-    NEXT_BUFFER(ctx, string_to_sign_len + 1);
-
-    char *signature = GET_BUFFER(ctx);
-    _hmac_hex(signature, signing_key, HASH_LENGHT, string_to_sign, string_to_sign_len);
-    NEXT_BUFFER(ctx, HASH_HEX_LENGTH);
+    return aws_sig_v4_signing_header_with_payload_hash(ctx, config, payload_hash);
+}
 
+char *aws_sig_v4_signing_header_with_payload_hash(aws_sig_v4_context_t *ctx, aws_sig_v4_config_t *config, const char *payload_hash)
+{
+    aws_sig_v4_template_t tmpl;
+    if (aws_sig_v4_template_init(&tmpl, config) != 0) {
+        return NULL;
+    }
+
+    /* As before the context had a lifetime, every call sets it up and releases it again, so the caller may pass any
+     * memory. Only the Authorization header stays in the buffer. */
+    aws_sig_v4_init(ctx);
+    char *header = aws_sig_v4_template_signing_header(ctx, &tmpl, config, payload_hash);
+    mbedtls_md_free(&ctx->md_ctx);
+    memset(ctx->signing_key, 0, sizeof(ctx->signing_key));
+    memset(ctx->signing_key_inputs, 0, sizeof(ctx->signing_key_inputs));
+    ctx->signing_key_valid = 0;
+    return header;
+}
+
+char *aws_sig_v4_template_signing_header(aws_sig_v4_context_t *ctx, const aws_sig_v4_template_t *tmpl, aws_sig_v4_config_t *config, const char *payload_hash)
+{
+    char hash[HASH_LENGHT];
+    char canonical_request_sha256[HASH_HEX_LENGTH];
+    char signature[HASH_HEX_LENGTH];
+    int has_session_token = config->session_token && strlen(config->session_token) > 0;
+
+    /* The canonical request, of which only the date, the session token and the payload hash change per request. The
+     * security token sorts last among the headers, so it goes after x-amz-date. */
+    mbedtls_sha256_init(&ctx->sha256_ctx);
+    mbedtls_sha256_starts(&ctx->sha256_ctx, 0); /* SHA-256, not 224 */
+    SHA256_UPDATE(ctx, tmpl->canonical_prefix, tmpl->canonical_prefix_len);
+    SHA256_UPDATE_STRING(ctx, config->amz_date);
+    SHA256_UPDATE(ctx, "\n", 1);
+    if (has_session_token) {
+        SHA256_UPDATE_STRING(ctx, "x-amz-security-token:");
+        SHA256_UPDATE_STRING(ctx, config->session_token);
+        SHA256_UPDATE(ctx, "\n", 1);
+    }
+    SHA256_UPDATE(ctx, "\n", 1);
+    SHA256_UPDATE(ctx, tmpl->signed_headers, tmpl->signed_headers_len);
+    if (has_session_token) {
+        SHA256_UPDATE_STRING(ctx, session_token_signed_header);
+    }
+    SHA256_UPDATE(ctx, "\n", 1);
+    SHA256_UPDATE(ctx, payload_hash, HASH_HEX_LENGTH - 1);
+    mbedtls_sha256_finish(&ctx->sha256_ctx, (unsigned char *)hash);
+    mbedtls_sha256_free(&ctx->sha256_ctx);
+    hex_encode_hash(canonical_request_sha256, hash);
+
+    /* The signing key only changes with the date, region, service or secret, so it's derived once and cached, unless
+     * the caller has derived it ahead */
+    const char *signing_key = config->signing_key;
+    if (signing_key == NULL) {
+        if (!_signing_key_cache_hit(ctx, tmpl, config)) {
+            if (_get_signature_key(&ctx->md_ctx, ctx->signing_key, config->secret_key, config->date_stamp,
+                                   tmpl->scope_suffix + 1, tmpl->region_name_len,
+                                   tmpl->scope_suffix + 2 + tmpl->region_name_len, tmpl->service_name_len) == 0) {
+                _signing_key_cache_store(ctx, tmpl, config);
+            } else {
+                /* The request is rejected for its signature, which is the same as what a wrong secret gets */
+                memset(ctx->signing_key, 0, sizeof(ctx->signing_key));
+                ctx->signing_key_valid = 0;
+            }
+        }
+        signing_key = ctx->signing_key;
+    }
+
+    /* The string to sign goes straight into the HMAC */
+    mbedtls_md_hmac_starts(&ctx->md_ctx, (const unsigned char *)signing_key, HASH_LENGHT);
+    HMAC_UPDATE_STRING(ctx, aws_algorithm);
+    HMAC_UPDATE(ctx, "\n", 1);
+    HMAC_UPDATE_STRING(ctx, config->amz_date);
+    HMAC_UPDATE(ctx, "\n", 1);
+    HMAC_UPDATE_STRING(ctx, config->date_stamp);
+    HMAC_UPDATE(ctx, tmpl->scope_suffix, tmpl->scope_suffix_len);
+    HMAC_UPDATE(ctx, "\n", 1);
+    HMAC_UPDATE(ctx, canonical_request_sha256, HASH_HEX_LENGTH - 1);
+    mbedtls_md_hmac_finish(&ctx->md_ctx, (unsigned char *)hash);
+    hex_encode_hash(signature, hash);
+
+    ctx->buffer_offset = 0;
     char *authorization_header = GET_BUFFER(ctx);
-    snprintf(authorization_header,
-             REMAIN_BUFFER(ctx),
-             "%s Credential=%s/%s, SignedHeaders=%s%chost;x-amz-date, Signature=%s",
-             aws_algorithm,
-             config->access_key,
-             credential_scope,
-             config->signed_headers,
-             separate,
-             signature);
+    _append_header(ctx, aws_algorithm, strlen(aws_algorithm));
+    _append_header(ctx, " Credential=", strlen(" Credential="));
+    _append_header(ctx, config->access_key, strlen(config->access_key));
+    _append_header(ctx, "/", 1);
+    _append_header(ctx, config->date_stamp, strlen(config->date_stamp));
+    _append_header(ctx, tmpl->scope_suffix, tmpl->scope_suffix_len);
+    _append_header(ctx, ", SignedHeaders=", strlen(", SignedHeaders="));
+    _append_header(ctx, tmpl->signed_headers, tmpl->signed_headers_len);
+    if (has_session_token) {
+        _append_header(ctx, session_token_signed_header, strlen(session_token_signed_header));
+    }
+    _append_header(ctx, ", Signature=", strlen(", Signature="));
+    _append_header(ctx, signature, HASH_HEX_LENGTH - 1);
     return authorization_header;
 }
@@ -32,7 +32,15 @@ extern "C" {
 #endif
 
 
-#define AWS_SIG_V4_BUFFER_SIZE (2048)
+/* Room for the Authorization header, the only string that is built for a request */
+#define AWS_SIG_V4_BUFFER_SIZE (512)
+#define AWS_SIG_V4_HASH_HEX_LENGTH (65)
+#define AWS_SIG_V4_SIGNING_KEY_LENGTH (32)
+#define AWS_SIG_V4_SIGNING_KEY_INPUTS_SIZE (160)
+#define AWS_SIG_V4_SECRET_KEY_MAX_LENGTH (128)
+#define AWS_SIG_V4_CANONICAL_PREFIX_SIZE (384)
+#define AWS_SIG_V4_SCOPE_SUFFIX_SIZE (96)
+#define AWS_SIG_V4_SIGNED_HEADERS_SIZE (128)
 
 /**
  * @brief      Amazon Signature V4 signing context
@@ -40,8 +48,11 @@ extern "C" {
 typedef struct {
     mbedtls_sha256_context  sha256_ctx;                     /*!< mbedtls SHA256 context */
     mbedtls_md_context_t    md_ctx;                         /*!< mbedtls HMAC context */
-    char                    buffer[AWS_SIG_V4_BUFFER_SIZE]; /*!< Buffer to use for this library */
+    char                    buffer[AWS_SIG_V4_BUFFER_SIZE]; /*!< Buffer of the Authorization header */
     int                     buffer_offset;                  /*!< The buffer offset have been used */
+    char                    signing_key[AWS_SIG_V4_SIGNING_KEY_LENGTH];             /*!< Cached signing key */
+    char                    signing_key_inputs[AWS_SIG_V4_SIGNING_KEY_INPUTS_SIZE]; /*!< Date, region, service and secret of the cached signing key */
+    int                     signing_key_valid;              /*!< Whether the cached signing key can be used */
 } aws_sig_v4_context_t;
 
 /**
@@ -52,6 +63,8 @@ typedef struct {
     const char *region_name;            /*!< AWS Region name, ex: us-east-1 */
     const char *secret_key;             /*!< AWS IAM user secret key */
     const char *access_key;             /*!< AWS IAM user access key */
+    const char *session_token;          /*!< Session token of temporary credentials, NULL or "" for long-term keys */
+    const char *signing_key;            /*!< Signing key derived for `date_stamp`, or NULL to derive it on demand */
     const char *host;                   /*!< Current request host name, ex: polly.us-east-1.amazonaws.com*/
     const char *method;                 /*!< Current request method, ex: POST */
     const char *path;                   /*!< Current request path, ex: "/" or "/v1/speech" */
@@ -65,15 +78,125 @@ typedef struct {
 } aws_sig_v4_config_t;
 
 /**
- * @brief      Create HTTP Header for Amazon Signature V4 signing
+ * @brief      The parts of the requests that stay the same on a device, composed once so that signing a request only
+ *             streams the date, the session token and the payload hash into the hashes
+ */
+typedef struct {
+    char    canonical_prefix[AWS_SIG_V4_CANONICAL_PREFIX_SIZE];   /*!< Canonical request up to the value of x-amz-date */
+    int     canonical_prefix_len;                               /*!< Length of the canonical prefix */
+    char    scope_suffix[AWS_SIG_V4_SCOPE_SUFFIX_SIZE];           /*!< Credential scope after the date, ex: /us-east-1/polly/aws4_request */
+    int     scope_suffix_len;                                   /*!< Length of the scope suffix */
+    char    signed_headers[AWS_SIG_V4_SIGNED_HEADERS_SIZE];       /*!< Signed headers, but x-amz-security-token */
+    int     signed_headers_len;                                 /*!< Length of the signed headers */
+    int     region_name_len;                                    /*!< Length of the region in the scope suffix */
+    int     service_name_len;                                   /*!< Length of the service in the scope suffix */
+} aws_sig_v4_template_t;
+
+/**
+ * @brief      Initialize the signing context of aws_sig_v4_template_signing_header and the payload hash. The context
+ *             keeps its HMAC context and the derived signing key across requests, so it should live as long as the
+ *             signer is used.
  *
  * @param      ctx     The context
- * @param      config  The configuration
+ */
+void aws_sig_v4_init(aws_sig_v4_context_t *ctx);
+
+/**
+ * @brief      Release the signing context and wipe the cached signing key
+ *
+ * @param      ctx     The context
+ */
+void aws_sig_v4_free(aws_sig_v4_context_t *ctx);
+
+/**
+ * @brief      Derive the signing key of a secret for a date, region and service ahead of the requests, e.g. whenever the
+ *             credentials are rotated. It can be passed as the `signing_key` of every request of that date, which then
+ *             skips the four HMACs of the derivation.
+ *
+ * @param      config       The configuration, of which `secret_key`, `date_stamp`, `region_name` and `service_name`
+ *                          are used
+ * @param      signing_key  Output of the signing key
+ *
+ * @return     0 on success, -1 if the secret key is longer than AWS_SIG_V4_SECRET_KEY_MAX_LENGTH
+ */
+int aws_sig_v4_derive_signing_key(aws_sig_v4_config_t *config, char signing_key[AWS_SIG_V4_SIGNING_KEY_LENGTH]);
+
+/**
+ * @brief      Compose the signing template of the requests to a host
+ *
+ * @param      tmpl    The template
+ * @param      config  The configuration, of which `service_name`, `region_name`, `host`, `method`, `path`, `query`,
+ *                     `signed_headers` and `canonical_headers` are used
+ *
+ * @return     0 on success, -1 if a part doesn't fit into the template
+ */
+int aws_sig_v4_template_init(aws_sig_v4_template_t *tmpl, aws_sig_v4_config_t *config);
+
+/**
+ * @brief      Create HTTP Header for Amazon Signature V4 signing of a request that matches a template, with a
+ *             precomputed payload hash. Of the configuration, only `access_key`, `secret_key`, `session_token`,
+ *             `signing_key`, `amz_date` and `date_stamp` are used. With a session token, the request has to carry it
+ *             in the `X-Amz-Security-Token` header as well.
+ *
+ * @param      ctx           The context
+ * @param      tmpl          The template
+ * @param      config        The configuration
+ * @param      payload_hash  The hex encoded SHA256 of the payload, must not point into the context
  *
  * @return     The HTTP Header value of `Authorization`
  */
+char *aws_sig_v4_template_signing_header(aws_sig_v4_context_t *ctx, const aws_sig_v4_template_t *tmpl, aws_sig_v4_config_t *config, const char *payload_hash);
+
+/**
+ * @brief      Create HTTP Header for Amazon Signature V4 signing. The context needs no aws_sig_v4_init, it is set up
+ *             and released again by the call, so nothing is cached across requests.
+ *
+ * @param      ctx     The context
+ * @param      config  The configuration
+ *
+ * @return     The HTTP Header value of `Authorization`, NULL if the request doesn't fit into a template
+ */
 char *aws_sig_v4_signing_header(aws_sig_v4_context_t *ctx, aws_sig_v4_config_t *config);
 
+/**
+ * @brief      Start hashing a payload incrementally, so that the payload hash is ready as soon as the payload is
+ *             produced
+ *
+ * @param      ctx     The context
+ */
+void aws_sig_v4_payload_hash_start(aws_sig_v4_context_t *ctx);
+
+/**
+ * @brief      Feed the next chunk of the payload into the payload hash
+ *
+ * @param      ctx       The context
+ * @param      data      The payload chunk
+ * @param      data_len  The length of the payload chunk
+ */
+void aws_sig_v4_payload_hash_update(aws_sig_v4_context_t *ctx, const char *data, size_t data_len);
+
+/**
+ * @brief      Finish the payload hash
+ *
+ * @param      ctx           The context
+ * @param      payload_hash  Output of the hex encoded SHA256 of the payload
+ */
+void aws_sig_v4_payload_hash_finish(aws_sig_v4_context_t *ctx, char payload_hash[AWS_SIG_V4_HASH_HEX_LENGTH]);
+
+/**
+ * @brief      Create HTTP Header for Amazon Signature V4 signing with a precomputed payload hash. The `payload` and
+ *             `payload_len` of the configuration are not used. With a session token, the request has to carry it in
+ *             the `X-Amz-Security-Token` header as well. Like aws_sig_v4_signing_header, the context needs no
+ *             aws_sig_v4_init.
+ *
+ * @param      ctx           The context
+ * @param      config        The configuration
+ * @param      payload_hash  The hex encoded SHA256 of the payload, must not point into the context
+ *
+ * @return     The HTTP Header value of `Authorization`, NULL if the request doesn't fit into a template
+ */
+char *aws_sig_v4_signing_header_with_payload_hash(aws_sig_v4_context_t *ctx, aws_sig_v4_config_t *config, const char *payload_hash);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,152 +1,106 @@
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "driver/gpio.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
 #include "sdkconfig.h"
 
 #include "dht.h"
 
-static int waitUntilTimeout(gpio_num_t dht11_gpio, int usTimeout, int level, int *pUsTick)
+/* The host holds the line low for at least 18 ms to wake the sensor up. */
+#define DHT_START_SIGNAL_MS     (20)
+
+/* A whole frame takes less than 5 ms after the start signal. */
+#define DHT_FRAME_TIMEOUT_MS    (10)
+
+/* Room for a few stray edges before the frame, e.g. of the start signal and of the start of the response. */
+#define DHT_MAX_EDGES           (DHT_FALLING_EDGES + 4)
+
+typedef struct EdgeCapture
 {
-    int result = DHT11_ERROR_NONE;
-    int usTick = 0;
+    TaskHandle_t task;
+    volatile size_t edgesLen;
+    size_t responseEdge;
+    uint32_t edgesUs[DHT_MAX_EDGES];
+} EdgeCapture_t;
+
+static EdgeCapture_t capture;
 
-    while (gpio_get_level(dht11_gpio) == level)
+static void IRAM_ATTR onFallingEdge(void *pArg)
+{
+    EdgeCapture_t *pCapture = (EdgeCapture_t *)pArg;
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+
+    if (pCapture->edgesLen < DHT_MAX_EDGES)
     {
-        esp_rom_delay_us(1);
+        size_t edge = pCapture->edgesLen;
 
-        usTick++;
-        if (usTick > usTimeout)
+        pCapture->edgesUs[edge] = (uint32_t)esp_timer_get_time();
+        if (DHT_IS_RESPONSE_EDGE(pCapture->edgesUs, edge))
         {
-            result = DHT11_ERROR_TIMEOUT;
-            break;
+            pCapture->responseEdge = edge;
         }
+        pCapture->edgesLen = edge + 1;
     }
 
-    if (pUsTick != NULL)
+    /* Wake the reader once the 40 bits after the response are in, no matter how many stray edges came first. */
+    if (pCapture->edgesLen == DHT_MAX_EDGES || pCapture->edgesLen - pCapture->responseEdge == DHT_FALLING_EDGES)
     {
-        *pUsTick = usTick;
+        vTaskNotifyGiveFromISR(pCapture->task, &higherPriorityTaskWoken);
     }
-
-    return result;
+    portYIELD_FROM_ISR(higherPriorityTaskWoken);
 }
 
 static void sendStartSignal(gpio_num_t dht11_gpio)
 {
     gpio_set_direction(dht11_gpio, GPIO_MODE_OUTPUT);
     gpio_set_level(dht11_gpio, 0);
-    esp_rom_delay_us(20 * 1000);
-    gpio_set_level(dht11_gpio, 1);
-    esp_rom_delay_us(40);
+    vTaskDelay(pdMS_TO_TICKS(DHT_START_SIGNAL_MS) + 1);
     gpio_set_direction(dht11_gpio, GPIO_MODE_INPUT);
 }
 
-static int readByte(gpio_num_t dht11_gpio, uint8_t *pByte)
+/**
+ * Record the falling edges of the frame that answers the start signal.
+ */
+static void captureFrame(gpio_num_t dht11_gpio)
 {
-    int result = DHT11_ERROR_NONE;
-    uint8_t b = 0;
-    int usTick = 0;
+    static bool isrServiceInstalled = false;
 
-    for (uint8_t i = 0; i < 8; i++)
+    if (!isrServiceInstalled)
     {
-        if ((result = waitUntilTimeout(dht11_gpio, 50, 0, NULL)) != DHT11_ERROR_NONE)
-        {
-            /* nop, propagate the error */
-            break;
-        }
-
-        b <<= 1;
-        if ((result = waitUntilTimeout(dht11_gpio, 70, 1, &usTick)) != DHT11_ERROR_NONE)
-        {
-            break;
-        }
-        else
-        {
-            if (usTick > 28)
-            {
-                b |= 1;
-            }
-        }
+        /* Fails harmlessly if the application has installed the service already. */
+        gpio_install_isr_service(0);
+        isrServiceInstalled = true;
     }
 
-    if (result == DHT11_ERROR_NONE)
-    {
-        *pByte = b;
-    }
+    capture.task = xTaskGetCurrentTaskHandle();
+    capture.edgesLen = 0;
+    capture.responseEdge = 0;
+    ulTaskNotifyTake(pdTRUE, 0);
 
-    return result;
+    gpio_set_intr_type(dht11_gpio, GPIO_INTR_NEGEDGE);
+    gpio_isr_handler_add(dht11_gpio, onFallingEdge, &capture);
+
+    sendStartSignal(dht11_gpio);
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(DHT_FRAME_TIMEOUT_MS) + 1);
+
+    gpio_isr_handler_remove(dht11_gpio);
+    gpio_set_intr_type(dht11_gpio, GPIO_INTR_DISABLE);
 }
 
 int DHT_read(DhtType_t type, gpio_num_t dht11_gpio, float *pTemperature, float *pHumidity)
 {
     int result = DHT11_ERROR_NONE;
-    uint8_t data[5] = { 0 };
-    float temperature = 0.0f;
-    float humidity = 0.0f;
+    uint8_t data[DHT_DATA_SIZE] = { 0 };
 
-    sendStartSignal(dht11_gpio);
+    captureFrame(dht11_gpio);
 
-    if ((result = waitUntilTimeout(dht11_gpio, 80, 0, NULL)) != DHT11_ERROR_NONE)
-    {
-        /* nop, propagate the error */
-    }
-    else if ((result = waitUntilTimeout(dht11_gpio, 80, 1, NULL)) != DHT11_ERROR_NONE)
+    if ((result = DHT_decode(capture.edgesUs, capture.edgesLen, data)) == DHT11_ERROR_NONE)
     {
-        /* nop, propagate the error */
-    }
-    else
-    {
-        for (int i = 0; i < 5; i++)
-        {
-            if ((result = readByte(dht11_gpio, &(data[i]))) != DHT11_ERROR_NONE)
-            {
-                break;
-            }
-        }
-
-        /* Check CRC */
-        if (data[4] != (data[0] + data[1] + data[2] + data[3]))
-        {
-            result = DHT11_ERROR_CRC;
-        }
-        else
-        {
-            if (type == DHT11)
-            {
-                humidity = ((uint16_t)data[0]) << 8 | data[1];
-                humidity *= 0.1;
-
-                temperature = data[2];
-                if (data[3] & 0x80)
-                {
-                    temperature = -1 - temperature;
-                }
-                temperature += (data[3] & 0x0F) * 0.1;
-            }
-            else if (type == DHT22)
-            {
-                humidity = ((uint16_t)data[0]) << 8 | data[1];
-                humidity *= 0.1;
-
-                temperature = ((uint16_t)data[2] & 0x7F) << 8 | data[3];
-                temperature *= 0.1;
-                if (data[2] & 0x80)
-                {
-                    temperature *= -1;
-                }
-            }
-
-            if (pTemperature != NULL)
-            {
-                *pTemperature = temperature;
-            }
-            if (pHumidity != NULL)
-            {
-                *pHumidity = humidity;
-            }
-        }
+        DHT_convert(type, data, pTemperature, pHumidity);
     }
 
     return result;
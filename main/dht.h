@@ -7,18 +7,13 @@ extern "C" {
 
 #include "driver/gpio.h"
 
-#define DHT11_ERROR_NONE        (0)
-#define DHT11_ERROR_TIMEOUT     (-1)
-#define DHT11_ERROR_CRC         (-2)
-
-typedef enum
-{
-    DHT11 = 11,
-    DHT22 = 22,
-} DhtType_t;
+#include "dht_decode.h"
 
 /**
  * Do the one-wire protocol on GPIO dht11_gpio, get the results of temperature and humidity.
+ *
+ * The calling task sleeps through the start signal and the frame. The falling edges of the frame are time-stamped by a
+ * GPIO interrupt and decoded afterwards, so reading doesn't spin the CPU.
  * 
  * @param[in] dht11_gpio GPIO number for reading data from DHT11
  * @param[out] pTemperature Pointer to store the temperature
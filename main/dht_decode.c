@@ -0,0 +1,94 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "dht_decode.h"
+
+/* A 0 bit lasts about 77 us and a 1 bit about 120 us from falling edge to falling edge. */
+#define DHT_BIT_THRESHOLD_US    (100)
+
+int DHT_decode(const uint32_t *pEdgesUs, size_t edgesLen, uint8_t data[DHT_DATA_SIZE])
+{
+    const uint32_t *pBitEdges = NULL;
+    size_t responseEdge = 0;
+
+    for (size_t edge = 0; edge < edgesLen; edge++)
+    {
+        if (DHT_IS_RESPONSE_EDGE(pEdgesUs, edge))
+        {
+            responseEdge = edge;
+        }
+    }
+
+    if (edgesLen - responseEdge < DHT_FALLING_EDGES)
+    {
+        return DHT11_ERROR_TIMEOUT;
+    }
+
+    /* The first edge of the frame ends the response, every following one ends a bit. */
+    pBitEdges = &(pEdgesUs[responseEdge]);
+
+    for (int i = 0; i < DHT_DATA_SIZE; i++)
+    {
+        uint8_t b = 0;
+
+        for (int j = 0; j < 8; j++)
+        {
+            int bit = i * 8 + j;
+
+            b <<= 1;
+            if (pBitEdges[bit + 1] - pBitEdges[bit] > DHT_BIT_THRESHOLD_US)
+            {
+                b |= 1;
+            }
+        }
+        data[i] = b;
+    }
+
+    /* Check CRC, which is the low byte of the sum */
+    if (data[4] != (uint8_t)(data[0] + data[1] + data[2] + data[3]))
+    {
+        return DHT11_ERROR_CRC;
+    }
+
+    return DHT11_ERROR_NONE;
+}
+
+void DHT_convert(DhtType_t type, const uint8_t data[DHT_DATA_SIZE], float *pTemperature, float *pHumidity)
+{
+    float temperature = 0.0f;
+    float humidity = 0.0f;
+
+    if (type == DHT11)
+    {
+        humidity = ((uint16_t)data[0]) << 8 | data[1];
+        humidity *= 0.1;
+
+        temperature = data[2];
+        if (data[3] & 0x80)
+        {
+            temperature = -1 - temperature;
+        }
+        temperature += (data[3] & 0x0F) * 0.1;
+    }
+    else if (type == DHT22)
+    {
+        humidity = ((uint16_t)data[0]) << 8 | data[1];
+        humidity *= 0.1;
+
+        temperature = ((uint16_t)data[2] & 0x7F) << 8 | data[3];
+        temperature *= 0.1;
+        if (data[2] & 0x80)
+        {
+            temperature *= -1;
+        }
+    }
+
+    if (pTemperature != NULL)
+    {
+        *pTemperature = temperature;
+    }
+    if (pHumidity != NULL)
+    {
+        *pHumidity = humidity;
+    }
+}
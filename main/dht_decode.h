@@ -0,0 +1,63 @@
+#ifndef _DHT_DECODE_H_
+#define _DHT_DECODE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DHT11_ERROR_NONE        (0)
+#define DHT11_ERROR_TIMEOUT     (-1)
+#define DHT11_ERROR_CRC         (-2)
+
+/* A frame is 4 bytes of data and a checksum */
+#define DHT_DATA_SIZE           (5)
+
+/* Falling edges of a frame: one ending the response of the sensor, and one ending every bit */
+#define DHT_FALLING_EDGES       (1 + DHT_DATA_SIZE * 8)
+
+/* The response lasts at least 150 us from falling edge to falling edge, a bit no more than 130 us. */
+#define DHT_RESPONSE_MIN_US     (140)
+
+/* Whether an edge ends the response, i.e. it is the first one or follows a gap longer than any bit. */
+#define DHT_IS_RESPONSE_EDGE(pEdgesUs, edge) \
+    ((edge) == 0 || (pEdgesUs)[(edge)] - (pEdgesUs)[(edge) - 1] > DHT_RESPONSE_MIN_US)
+
+typedef enum
+{
+    DHT11 = 11,
+    DHT22 = 22,
+} DhtType_t;
+
+/**
+ * Decode a frame from the times of the falling edges on the data line.
+ *
+ * Every bit is a 50 us low pulse followed by a high pulse of about 27 us for 0 or 70 us for 1, so the time between
+ * two falling edges tells the bit. The frame starts at the last edge that ends a response, so the trace may start
+ * early, e.g. with the edge of the start signal and the one that starts the response.
+ *
+ * @param[in] pEdgesUs Times of the falling edges in microseconds, oldest first
+ * @param[in] edgesLen Number of edges
+ * @param[out] data The frame, including the checksum
+ * @return 0 on success, DHT11_ERROR_TIMEOUT if fewer than 40 bits follow the response, DHT11_ERROR_CRC if the
+ * checksum doesn't match
+ */
+int DHT_decode(const uint32_t *pEdgesUs, size_t edgesLen, uint8_t data[DHT_DATA_SIZE]);
+
+/**
+ * Convert a frame into temperature and humidity.
+ *
+ * @param[in] type The sensor type
+ * @param[in] data The frame
+ * @param[out] pTemperature Pointer to store the temperature, or NULL
+ * @param[out] pHumidity Pointer to store the humidity, or NULL
+ */
+void DHT_convert(DhtType_t type, const uint8_t data[DHT_DATA_SIZE], float *pTemperature, float *pHumidity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _DHT_DECODE_H_ */
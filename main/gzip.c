@@ -0,0 +1,276 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "gzip.h"
+
+#define MIN_MATCH           (3)
+#define MAX_MATCH           (258)
+#define MAX_CHAIN           (16)
+#define PREV_SIZE           (sizeof(((GzipState_t *)0)->prev) / sizeof(uint16_t))
+
+typedef struct BitWriter
+{
+    uint8_t *pOutput;
+    size_t outputSize;
+    size_t len;
+    uint32_t bits;
+    int bitsLen;
+    bool overflow;
+} BitWriter_t;
+
+/* Base and extra bits of the length codes 257 to 285 */
+static const uint16_t lengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t lengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+/* Base and extra bits of the distance codes 0 to 29 */
+static const uint16_t distanceBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577
+};
+static const uint8_t distanceExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+/* CRC-32 of gzip, four bits at a time */
+static const uint32_t crcTable[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+static uint32_t crc32(const uint8_t *pData, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= pData[i];
+        crc = (crc >> 4) ^ crcTable[crc & 0x0F];
+        crc = (crc >> 4) ^ crcTable[crc & 0x0F];
+    }
+
+    return crc ^ 0xFFFFFFFF;
+}
+
+static void writeByte(BitWriter_t *pWriter, uint8_t b)
+{
+    if (pWriter->len < pWriter->outputSize)
+    {
+        pWriter->pOutput[pWriter->len++] = b;
+    }
+    else
+    {
+        pWriter->overflow = true;
+    }
+}
+
+static void writeLe32(BitWriter_t *pWriter, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        writeByte(pWriter, (uint8_t)(value >> (i * 8)));
+    }
+}
+
+/**
+ * Write bits least significant first, as deflate packs everything but the Huffman codes.
+ */
+static void writeBits(BitWriter_t *pWriter, uint32_t value, int bitsLen)
+{
+    pWriter->bits |= value << pWriter->bitsLen;
+    pWriter->bitsLen += bitsLen;
+    while (pWriter->bitsLen >= 8)
+    {
+        writeByte(pWriter, (uint8_t)pWriter->bits);
+        pWriter->bits >>= 8;
+        pWriter->bitsLen -= 8;
+    }
+}
+
+/**
+ * Write a Huffman code, which deflate packs most significant bit first.
+ */
+static void writeCode(BitWriter_t *pWriter, uint32_t code, int codeLen)
+{
+    uint32_t reversed = 0;
+
+    for (int i = 0; i < codeLen; i++)
+    {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    writeBits(pWriter, reversed, codeLen);
+}
+
+/**
+ * Write a literal/length symbol with the fixed Huffman code.
+ */
+static void writeSymbol(BitWriter_t *pWriter, int symbol)
+{
+    if (symbol < 144)
+    {
+        writeCode(pWriter, 0x30 + symbol, 8);
+    }
+    else if (symbol < 256)
+    {
+        writeCode(pWriter, 0x190 + (symbol - 144), 9);
+    }
+    else if (symbol < 280)
+    {
+        writeCode(pWriter, symbol - 256, 7);
+    }
+    else
+    {
+        writeCode(pWriter, 0xC0 + (symbol - 280), 8);
+    }
+}
+
+static void writeMatch(BitWriter_t *pWriter, int length, int distance)
+{
+    int code = 28;
+
+    while (lengthBase[code] > length)
+    {
+        code--;
+    }
+    writeSymbol(pWriter, 257 + code);
+    writeBits(pWriter, length - lengthBase[code], lengthExtra[code]);
+
+    code = 29;
+    while (distanceBase[code] > distance)
+    {
+        code--;
+    }
+    writeCode(pWriter, code, 5);
+    writeBits(pWriter, distance - distanceBase[code], distanceExtra[code]);
+}
+
+static uint32_t hash3(const uint8_t *p)
+{
+    return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u) >> (32 - GZIP_HASH_BITS);
+}
+
+static void insertPosition(GzipState_t *pState, const uint8_t *pInput, size_t pos)
+{
+    uint32_t h = hash3(&(pInput[pos]));
+
+    pState->prev[pos % PREV_SIZE] = pState->head[h];
+    pState->head[h] = (uint16_t)(pos + 1);
+}
+
+/**
+ * Find the longest earlier match of the data at a position, walking the hash chain back within the window of prev.
+ */
+static int findMatch(GzipState_t *pState, const uint8_t *pInput, size_t inputLen, size_t pos, int *pDistance)
+{
+    size_t maxLen = (inputLen - pos < MAX_MATCH) ? inputLen - pos : MAX_MATCH;
+    uint16_t candidate = pState->head[hash3(&(pInput[pos]))];
+    int bestLen = 0;
+
+    for (int chain = 0; chain < MAX_CHAIN && candidate != 0; chain++)
+    {
+        size_t matchPos = candidate - 1;
+        size_t len = 0;
+
+        if (pos - matchPos > PREV_SIZE)
+        {
+            break;
+        }
+
+        while (len < maxLen && pInput[matchPos + len] == pInput[pos + len])
+        {
+            len++;
+        }
+        if ((int)len > bestLen)
+        {
+            bestLen = (int)len;
+            *pDistance = (int)(pos - matchPos);
+            if (len == maxLen)
+            {
+                break;
+            }
+        }
+
+        candidate = pState->prev[matchPos % PREV_SIZE];
+    }
+
+    return bestLen;
+}
+
+int Gzip_compress(GzipState_t *pState, const uint8_t *pInput, size_t inputLen, uint8_t *pOutput, size_t outputSize,
+                  size_t *pOutputLen)
+{
+    static const uint8_t header[10] = { 0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF };
+    BitWriter_t writer = {
+        .pOutput = pOutput,
+        .outputSize = outputSize,
+    };
+    size_t pos = 0;
+
+    if (inputLen > GZIP_MAX_INPUT_SIZE)
+    {
+        return GZIP_ERROR_INPUT_TOO_LARGE;
+    }
+
+    memset(pState->head, 0, sizeof(pState->head));
+
+    for (size_t i = 0; i < sizeof(header); i++)
+    {
+        writeByte(&writer, header[i]);
+    }
+
+    /* A single final block with the fixed codes */
+    writeBits(&writer, 1, 1);
+    writeBits(&writer, 1, 2);
+
+    while (pos < inputLen && !writer.overflow)
+    {
+        int length = 0;
+        int distance = 0;
+
+        if (inputLen - pos >= MIN_MATCH)
+        {
+            length = findMatch(pState, pInput, inputLen, pos, &distance);
+        }
+
+        if (length >= MIN_MATCH)
+        {
+            writeMatch(&writer, length, distance);
+            for (int i = 0; i < length; i++, pos++)
+            {
+                if (inputLen - pos >= MIN_MATCH)
+                {
+                    insertPosition(pState, pInput, pos);
+                }
+            }
+        }
+        else
+        {
+            writeSymbol(&writer, pInput[pos]);
+            if (inputLen - pos >= MIN_MATCH)
+            {
+                insertPosition(pState, pInput, pos);
+            }
+            pos++;
+        }
+    }
+
+    /* End of block, and flush to a byte boundary. */
+    writeSymbol(&writer, 256);
+    writeBits(&writer, 0, 7);
+
+    writeLe32(&writer, crc32(pInput, inputLen));
+    writeLe32(&writer, (uint32_t)inputLen);
+
+    if (writer.overflow)
+    {
+        return GZIP_ERROR_BUFFER_TOO_SMALL;
+    }
+
+    *pOutputLen = writer.len;
+    return GZIP_ERROR_NONE;
+}
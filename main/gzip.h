@@ -0,0 +1,52 @@
+#ifndef _GZIP_H_
+#define _GZIP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define GZIP_ERROR_NONE             (0)
+#define GZIP_ERROR_BUFFER_TOO_SMALL (-1)
+#define GZIP_ERROR_INPUT_TOO_LARGE  (-2)
+
+/* Largest input, so that positions fit into 16 bits */
+#define GZIP_MAX_INPUT_SIZE         (65535)
+
+/* Bytes of the gzip header and trailer around the deflate stream */
+#define GZIP_OVERHEAD               (18)
+
+#define GZIP_HASH_BITS              (10)
+
+/**
+ * Working memory of the compressor. It can be reused for any number of calls, but not by two calls at once.
+ */
+typedef struct GzipState
+{
+    uint16_t head[1 << GZIP_HASH_BITS];     /* Latest position + 1 of every hash of 3 bytes, 0 for none */
+    uint16_t prev[4096];                    /* Previous position + 1 with the same hash, by position modulo the size */
+} GzipState_t;
+
+/**
+ * Compress a buffer into a gzip member: a single deflate block with the fixed Huffman codes, and LZ77 matches found
+ * through a hash chain. It is meant for small, repetitive documents like the JSON of a batch, where the fixed codes
+ * do nearly as well as dynamic ones at a fraction of the code and memory.
+ *
+ * @param[in] pState Working memory
+ * @param[in] pInput The data to compress
+ * @param[in] inputLen Length of the data, at most GZIP_MAX_INPUT_SIZE
+ * @param[out] pOutput The gzip output buffer
+ * @param[in] outputSize Size of the output buffer
+ * @param[out] pOutputLen Length of the gzip output
+ * @return 0 on success, GZIP_ERROR_BUFFER_TOO_SMALL if the output doesn't fit, GZIP_ERROR_INPUT_TOO_LARGE otherwise
+ */
+int Gzip_compress(GzipState_t *pState, const uint8_t *pInput, size_t inputLen, uint8_t *pOutput, size_t outputSize,
+                  size_t *pOutputLen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _GZIP_H_ */
@@ -0,0 +1,24 @@
+#ifndef _HEX_H_
+#define _HEX_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ *  Encode bytes as lowercase hex digits.
+ *
+ * @param[out] pOutput Buffer of at least 2 * inputLen + 1 characters, NUL-terminated on return
+ * @param[in] pInput The bytes to encode
+ * @param[in] inputLen Number of bytes
+ */
+void Hex_encode(char *pOutput, const uint8_t *pInput, size_t inputLen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _HEX_H_ */
@@ -60,5 +60,5 @@ void app_main(void)
 
     wait_for_sntp();
 
-    sitewise_uploader_start();
+    ESP_ERROR_CHECK(sitewise_uploader_start());
 };
@@ -1,94 +1,497 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <float.h>
 
 #include "esp_random.h"
 
 #include "cJSON.h"
 
+#include "hex.h"
+
 #include "sitewise.h"
 
 /**
- * Fill UUID 128-bit into buffer.
+ * A JSON writer that prints straight into the caller's buffer.
+ *
+ * The length keeps counting after the buffer is exhausted, so that the caller can learn how large the buffer should
+ * have been.
+ */
+typedef struct JsonWriter
+{
+    char *pBuffer;
+    size_t bufferSize;
+    size_t len;
+    bool overflow;
+
+    SitewiseChunkCallback_t chunkCallback;
+    void *pUserData;
+    size_t flushedLen;
+} JsonWriter_t;
+
+/* Stands in for the UUID when only the length of an entry matters. */
+#define SITEWISE_ENTRY_ID_PLACEHOLDER "00000000000000000000000000000000"
+
+#define writeLiteral(pWriter, literal) writeBytes(pWriter, literal, sizeof(literal) - 1)
+
+static void writeBytes(JsonWriter_t *pWriter, const char *pData, size_t dataLen)
+{
+    /* Always reserve one byte for the null terminator. */
+    if (!pWriter->overflow && pWriter->len + dataLen < pWriter->bufferSize)
+    {
+        memcpy(pWriter->pBuffer + pWriter->len, pData, dataLen);
+    }
+    else
+    {
+        pWriter->overflow = true;
+    }
+    pWriter->len += dataLen;
+}
+
+/**
+ * Hand everything written since the last flush to the chunk callback.
+ */
+static void flushChunk(JsonWriter_t *pWriter)
+{
+    if (pWriter->chunkCallback != NULL && !pWriter->overflow && pWriter->len > pWriter->flushedLen)
+    {
+        pWriter->chunkCallback(pWriter->pBuffer + pWriter->flushedLen, pWriter->len - pWriter->flushedLen, pWriter->pUserData);
+    }
+    pWriter->flushedLen = pWriter->len;
+}
+
+static void writeChar(JsonWriter_t *pWriter, char c)
+{
+    writeBytes(pWriter, &c, 1);
+}
+
+/**
+ * Write a string with quotes, escaping the same characters as cJSON does.
+ */
+static void writeString(JsonWriter_t *pWriter, const char *pString)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    const char *pRun = pString;
+    const char *p = pString;
+
+    writeChar(pWriter, '\"');
+    for (; *p != '\0'; p++)
+    {
+        unsigned char c = (unsigned char)*p;
+        char escaped[6] = { '\\', 0 };
+        size_t escapedLen = 2;
+
+        if (c >= 32 && c != '\"' && c != '\\')
+        {
+            continue;
+        }
+
+        switch (c)
+        {
+            case '\"': escaped[1] = '\"'; break;
+            case '\\': escaped[1] = '\\'; break;
+            case '\b': escaped[1] = 'b'; break;
+            case '\f': escaped[1] = 'f'; break;
+            case '\n': escaped[1] = 'n'; break;
+            case '\r': escaped[1] = 'r'; break;
+            case '\t': escaped[1] = 't'; break;
+            default:
+                escaped[1] = 'u';
+                escaped[2] = '0';
+                escaped[3] = '0';
+                escaped[4] = hexDigits[c >> 4];
+                escaped[5] = hexDigits[c & 0x0F];
+                escapedLen = 6;
+                break;
+        }
+
+        writeBytes(pWriter, pRun, p - pRun);
+        writeBytes(pWriter, escaped, escapedLen);
+        pRun = p + 1;
+    }
+    writeBytes(pWriter, pRun, p - pRun);
+    writeChar(pWriter, '\"');
+}
+
+static void writeInteger(JsonWriter_t *pWriter, long long value)
+{
+    char digits[24];
+    char *p = digits + sizeof(digits);
+    unsigned long long magnitude = (value < 0) ? (0ULL - (unsigned long long)value) : (unsigned long long)value;
+
+    do
+    {
+        *(--p) = (char)('0' + (magnitude % 10));
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    if (value < 0)
+    {
+        *(--p) = '-';
+    }
+
+    writeBytes(pWriter, p, digits + sizeof(digits) - p);
+}
+
+/**
+ * Write a number exactly the way cJSON prints it, so the wire format stays unchanged.
+ */
+static void writeNumber(JsonWriter_t *pWriter, double value)
+{
+    char number[26];
+    int numberLen = 0;
+    int valueInt = 0;
+    double test = 0.0;
+
+    /* cJSON saturates the integer view of a number to the range of int. */
+    if (value >= INT_MAX)
+    {
+        valueInt = INT_MAX;
+    }
+    else if (value <= (double)INT_MIN)
+    {
+        valueInt = INT_MIN;
+    }
+    else
+    {
+        valueInt = (int)value;
+    }
+
+    if (isnan(value) || isinf(value))
+    {
+        writeLiteral(pWriter, "null");
+    }
+    else if (value == (double)valueInt)
+    {
+        writeInteger(pWriter, valueInt);
+    }
+    else
+    {
+        /* Try 15 decimal places of precision first, and fall back to 17 if the value can't be recovered. */
+        numberLen = snprintf(number, sizeof(number), "%1.15g", value);
+        test = strtod(number, NULL);
+        if (fabs(test - value) > fmax(fabs(test), fabs(value)) * DBL_EPSILON)
+        {
+            numberLen = snprintf(number, sizeof(number), "%1.17g", value);
+        }
+        writeBytes(pWriter, number, numberLen);
+    }
+}
+
+/**
+ * Write a string member, where the prefix holds the key and any leading comma. Like cJSON_AddStringToObject, a NULL
+ * string leaves the member out.
+ */
+static void writeStringMember(JsonWriter_t *pWriter, const char *pPrefix, size_t prefixLen, const char *pValue)
+{
+    if (pValue != NULL)
+    {
+        writeBytes(pWriter, pPrefix, prefixLen);
+        writeString(pWriter, pValue);
+    }
+}
+
+#define writeStringMemberLiteral(pWriter, prefixLiteral, pValue) \
+    writeStringMember(pWriter, prefixLiteral, sizeof(prefixLiteral) - 1, pValue)
+
+static void writePropertyValue(JsonWriter_t *pWriter, PropertyValue_t *pPropertyValue)
+{
+    writeLiteral(pWriter, "{\"value\":{");
+    switch(pPropertyValue->type)
+    {
+        case PROPERTY_VALUE_TYPE_BOOLEAN:
+        {
+            if (pPropertyValue->booleanValue)
+            {
+                writeLiteral(pWriter, "\"booleanValue\":true");
+            }
+            else
+            {
+                writeLiteral(pWriter, "\"booleanValue\":false");
+            }
+            break;
+        }
+        case PROPERTY_VALUE_TYPE_DOUBLE:
+        {
+            writeLiteral(pWriter, "\"doubleValue\":");
+            writeNumber(pWriter, pPropertyValue->doubleValue);
+            break;
+        }
+        case PROPERTY_VALUE_TYPE_INTEGER:
+        {
+            writeLiteral(pWriter, "\"integerValue\":");
+            writeNumber(pWriter, pPropertyValue->integerValue);
+            break;
+        }
+        case PROPERTY_VALUE_TYPE_STRING:
+        {
+            writeStringMemberLiteral(pWriter, "\"stringValue\":", pPropertyValue->stringValue);
+            break;
+        }
+        default:
+            break;
+    }
+    writeLiteral(pWriter, "},\"timestamp\":{\"timeInSeconds\":");
+    writeNumber(pWriter, pPropertyValue->timeInSeconds);
+    writeLiteral(pWriter, ",\"offsetInNanos\":");
+    writeInteger(pWriter, pPropertyValue->offsetInNanos);
+    writeLiteral(pWriter, "},\"quality\":\"GOOD\"}");
+}
+
+static void writeEntry(JsonWriter_t *pWriter, Entry_t *pEntry, const char *pEntryId)
+{
+    writeLiteral(pWriter, "{\"entryId\":");
+    writeString(pWriter, pEntryId);
+    if (pEntry->propertyAlias != NULL)
+    {
+        writeStringMemberLiteral(pWriter, ",\"propertyAlias\":", pEntry->propertyAlias);
+    }
+    else
+    {
+        writeStringMemberLiteral(pWriter, ",\"assetId\":", pEntry->assetId);
+        writeStringMemberLiteral(pWriter, ",\"propertyId\":", pEntry->propertyId);
+    }
+    writeLiteral(pWriter, ",\"propertyValues\":[");
+
+    for (size_t propertyValuesIndex = 0; propertyValuesIndex < pEntry->propertyValuesLen; propertyValuesIndex++)
+    {
+        if (propertyValuesIndex > 0)
+        {
+            writeChar(pWriter, ',');
+        }
+        writePropertyValue(pWriter, &(pEntry->propertyValues[propertyValuesIndex]));
+    }
+
+    writeLiteral(pWriter, "]}");
+}
+
+/**
+ * Give every entry a random 128-bit entry ID in hex. The random bytes of all entries come from one call.
  *
- * @param[in] uuidbuf
+ * @param[in] entriesArray The entries
+ * @param[in] entriesLen Number of entries, at most MAX_SITEWISE_ENTRY_SIZE
  */
-static void createUUID128(char uuidbuf[33])
+static void createEntryIds(Entry_t *entriesArray, size_t entriesLen)
 {
-    char *p = uuidbuf;
-    uint8_t uuid[16];
+    uint8_t uuids[MAX_SITEWISE_ENTRY_SIZE][SITEWISE_ENTRY_ID_LENGTH / 2];
 
-    esp_fill_random(uuid, 16);
-    for (int i = 0; i < 16; i++)
+    esp_fill_random(uuids, entriesLen * sizeof(uuids[0]));
+    for (size_t i = 0; i < entriesLen; i++)
     {
-        p += sprintf(p, "%02x", uuid[i]);
+        Hex_encode(entriesArray[i].entryId, uuids[i], sizeof(uuids[i]));
     }
 }
 
 int Sitewise_printEntriesAsJson(char *payloadBuffer, size_t payloadBufferSize, Entry_t *entriesArray, size_t entriesLen)
+{
+    return Sitewise_printEntriesAsJsonStreaming(payloadBuffer, payloadBufferSize, entriesArray, entriesLen, NULL, NULL, NULL);
+}
+
+int Sitewise_printEntriesAsJsonStreaming(char *payloadBuffer, size_t payloadBufferSize, Entry_t *entriesArray, size_t entriesLen,
+                                         SitewiseChunkCallback_t chunkCallback, void *pUserData, size_t *pPayloadLen)
 {
     int result = SITEWISE_ERROR_NONE;
-    cJSON *root = cJSON_CreateObject();
-    cJSON *entries = cJSON_AddArrayToObject(root, "entries");
+    JsonWriter_t writer = {
+        .pBuffer = payloadBuffer,
+        .bufferSize = payloadBufferSize,
+        .len = 0,
+        .overflow = false,
+        .chunkCallback = chunkCallback,
+        .pUserData = pUserData,
+        .flushedLen = 0,
+    };
+
+    if (entriesLen > MAX_SITEWISE_ENTRY_SIZE)
+    {
+        if (payloadBufferSize > 0)
+        {
+            payloadBuffer[0] = '\0';
+        }
+        return SITEWISE_ERROR_INVALID_PARAMETER;
+    }
+
+    createEntryIds(entriesArray, entriesLen);
+
+    writeLiteral(&writer, "{\"entries\":[");
 
     for (size_t entriesIndex = 0; entriesIndex < entriesLen; entriesIndex++)
     {
         Entry_t *pEntry = &(entriesArray[entriesIndex]);
 
-        char uuid[33];
-        createUUID128(uuid);
-
-        cJSON *entry = cJSON_CreateObject();
-        cJSON_AddItemToArray(entries, entry);
+        if (entriesIndex > 0)
+        {
+            writeChar(&writer, ',');
+        }
+        writeEntry(&writer, pEntry, pEntry->entryId);
+        flushChunk(&writer);
+    }
 
-        cJSON *entryId = cJSON_AddStringToObject(entry, "entryId", uuid);
-        cJSON *assetId = cJSON_AddStringToObject(entry, "assetId", pEntry->assetId);
-        cJSON *propertyId = cJSON_AddStringToObject(entry, "propertyId", pEntry->propertyId);
-        cJSON *propertyValues = cJSON_AddArrayToObject(entry, "propertyValues");
+    writeLiteral(&writer, "]}");
+    flushChunk(&writer);
 
-        for (size_t propertyValuesIndex = 0; propertyValuesIndex < pEntry->propertyValuesLen; propertyValuesIndex++)
+    if (writer.overflow)
+    {
+        /* Never hand out a truncated document. */
+        if (payloadBufferSize > 0)
+        {
+            payloadBuffer[0] = '\0';
+        }
+        result = SITEWISE_ERROR_BUFFER_TOO_SMALL;
+    }
+    else
+    {
+        payloadBuffer[writer.len] = '\0';
+        if (pPayloadLen != NULL)
         {
-            PropertyValue_t *pPropertyValue = &(pEntry->propertyValues[propertyValuesIndex]);
+            *pPayloadLen = writer.len;
+        }
+    }
+
+    return result;
+}
+
+size_t Sitewise_getEntryJsonLength(Entry_t *pEntry)
+{
+    /* Measure only, the entry ID always has the length of a UUID. */
+    JsonWriter_t writer = { 0 };
+
+    writeEntry(&writer, pEntry, SITEWISE_ENTRY_ID_PLACEHOLDER);
+
+    return writer.len;
+}
+
+size_t Sitewise_getPropertyValueJsonLength(PropertyValue_t *pPropertyValue)
+{
+    JsonWriter_t writer = { 0 };
+
+    writePropertyValue(&writer, pPropertyValue);
+
+    return writer.len;
+}
+
+/**
+ * Check if a timestamp of errorEntries is the one of a property value. A timestamp without offsetInNanos matches any
+ * offset.
+ */
+static bool isSameTimestamp(cJSON *timestamp, PropertyValue_t *pPropertyValue)
+{
+    cJSON *timeInSeconds = cJSON_GetObjectItemCaseSensitive(timestamp, "timeInSeconds");
+    cJSON *offsetInNanos = cJSON_GetObjectItemCaseSensitive(timestamp, "offsetInNanos");
 
-            cJSON *propertyValue = cJSON_CreateObject();
-            cJSON_AddItemToArray(propertyValues, propertyValue);
+    if (!cJSON_IsNumber(timeInSeconds) || (long)timeInSeconds->valuedouble != pPropertyValue->timeInSeconds)
+    {
+        return false;
+    }
+
+    return !cJSON_IsNumber(offsetInNanos) || (long)offsetInNanos->valuedouble == pPropertyValue->offsetInNanos;
+}
 
-            cJSON *value = cJSON_AddObjectToObject(propertyValue, "value");
-            switch(pPropertyValue->type)
+/**
+ * Report the property values of an entry that carry one of the failed timestamps, or all of them if no timestamp is
+ * given.
+ */
+static void reportFailedValues(Entry_t *pEntry, size_t entryIndex, const char *errorCode, cJSON *timestamps,
+                               SitewiseErrorCallback_t errorCallback, void *pUserData)
+{
+    cJSON *timestamp = NULL;
+
+    for (size_t propertyValuesIndex = 0; propertyValuesIndex < pEntry->propertyValuesLen; propertyValuesIndex++)
+    {
+        bool failed = (cJSON_GetArraySize(timestamps) == 0);
+
+        cJSON_ArrayForEach(timestamp, timestamps)
+        {
+            if (isSameTimestamp(timestamp, &(pEntry->propertyValues[propertyValuesIndex])))
             {
-                case PROPERTY_VALUE_TYPE_BOOLEAN:
-                {
-                    cJSON *booleanValue = cJSON_AddBoolToObject(value, "booleanValue", pPropertyValue->booleanValue);
-                    break;
-                }
-                case PROPERTY_VALUE_TYPE_DOUBLE:
-                {
-                    cJSON *doubleValue = cJSON_AddNumberToObject(value, "doubleValue", pPropertyValue->doubleValue);
-                    break;
-                }
-                case PROPERTY_VALUE_TYPE_INTEGER:
-                {
-                    cJSON *integerValue = cJSON_AddNumberToObject(value, "integerValue", pPropertyValue->integerValue);
-                    break;
-                }
-                case PROPERTY_VALUE_TYPE_STRING:
-                {
-                    cJSON *stringValue = cJSON_AddStringToObject(value, "stringValue", pPropertyValue->stringValue);
-                    break;
-                }
-                default:
-                    break;
+                failed = true;
+                break;
             }
-            cJSON *timestamp = cJSON_AddObjectToObject(propertyValue, "timestamp");
-            cJSON *timeInSeconds = cJSON_AddNumberToObject(timestamp, "timeInSeconds", pPropertyValue->timeInSeconds);
-            cJSON *offsetInNanos = cJSON_AddNumberToObject(timestamp, "offsetInNanos", 0);
-            cJSON *quality = cJSON_AddStringToObject(propertyValue, "quality", "GOOD");
         }
+
+        if (failed)
+        {
+            errorCallback(entryIndex, propertyValuesIndex, errorCode, pUserData);
+        }
+    }
+}
+
+int Sitewise_parseErrorEntries(const char *pResponse, size_t responseLen, Entry_t *entriesArray, size_t entriesLen,
+                               SitewiseErrorCallback_t errorCallback, void *pUserData)
+{
+    cJSON *root = cJSON_ParseWithLength(pResponse, responseLen);
+    cJSON *errorEntries = NULL;
+    cJSON *errorEntry = NULL;
+
+    if (root == NULL)
+    {
+        return SITEWISE_ERROR_CJSON;
+    }
+
+    errorEntries = cJSON_GetObjectItemCaseSensitive(root, "errorEntries");
+    if (!cJSON_IsArray(errorEntries))
+    {
+        cJSON_Delete(root);
+        return SITEWISE_ERROR_CJSON;
     }
 
-    cJSON_PrintPreallocated(root, payloadBuffer, payloadBufferSize, 0);
+    cJSON_ArrayForEach(errorEntry, errorEntries)
+    {
+        const char *entryId = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(errorEntry, "entryId"));
+        cJSON *errors = cJSON_GetObjectItemCaseSensitive(errorEntry, "errors");
+        cJSON *error = NULL;
+        size_t entriesIndex = 0;
+
+        if (entryId == NULL)
+        {
+            continue;
+        }
+        for (entriesIndex = 0; entriesIndex < entriesLen; entriesIndex++)
+        {
+            if (strcmp(entriesArray[entriesIndex].entryId, entryId) == 0)
+            {
+                break;
+            }
+        }
+        if (entriesIndex == entriesLen)
+        {
+            continue;
+        }
+
+        cJSON_ArrayForEach(error, errors)
+        {
+            const char *errorCode = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(error, "errorCode"));
+
+            reportFailedValues(&(entriesArray[entriesIndex]), entriesIndex, (errorCode != NULL) ? errorCode : "",
+                               cJSON_GetObjectItemCaseSensitive(error, "timestamps"), errorCallback, pUserData);
+        }
+    }
 
     cJSON_Delete(root);
 
-    return result;
-}
\ No newline at end of file
+    return SITEWISE_ERROR_NONE;
+}
+
+bool Sitewise_isRetryableError(const char *errorCode)
+{
+    static const char *retryableErrors[] = {
+        "ThrottlingException",
+        "LimitExceededException",
+        "InternalFailureException",
+        "ServiceUnavailableException",
+        "ConflictingOperationException",
+    };
+
+    for (size_t i = 0; i < sizeof(retryableErrors) / sizeof(retryableErrors[0]); i++)
+    {
+        if (strcmp(errorCode, retryableErrors[i]) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
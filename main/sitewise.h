@@ -9,9 +9,18 @@ extern "C" {
 #include <stddef.h>
 
 #define MAX_SITEWISE_PROPERTY_VALUE_SIZE 10
+#define MAX_SITEWISE_ENTRY_SIZE 10
+
+/* An entry ID is a 128-bit UUID in hex */
+#define SITEWISE_ENTRY_ID_LENGTH 32
+
+/* Length of an empty BatchPutAssetPropertyValue document, i.e. {"entries":[]} */
+#define SITEWISE_EMPTY_PAYLOAD_LENGTH 14
 
 #define SITEWISE_ERROR_NONE         (0)
 #define SITEWISE_ERROR_CJSON        (-1)
+#define SITEWISE_ERROR_BUFFER_TOO_SMALL (-2)
+#define SITEWISE_ERROR_INVALID_PARAMETER (-3)
 
 #define PROPERTY_VALUE_TYPE_BOOLEAN (0)
 #define PROPERTY_VALUE_TYPE_DOUBLE  (1)
@@ -29,28 +38,105 @@ typedef struct PropertyValue
         char *stringValue;    
     };
     long timeInSeconds;
+    long offsetInNanos;     /* Nanoseconds past timeInSeconds, 0 to 999999999 */
 } PropertyValue_t;
 
+/**
+ * Called by the streaming serializer for every chunk of JSON it has just written into the payload buffer.
+ */
+typedef void (*SitewiseChunkCallback_t)(const char *pChunk, size_t chunkLen, void *pUserData);
+
+/**
+ * Called by Sitewise_parseErrorEntries for every property value that the service failed to store.
+ *
+ * @param[in] entryIndex The index of the entry in the entries array
+ * @param[in] propertyValueIndex The index of the property value in the entry
+ * @param[in] errorCode The error code, e.g. ThrottlingException
+ * @param[in] pUserData The user data given to the parser
+ */
+typedef void (*SitewiseErrorCallback_t)(size_t entryIndex, size_t propertyValueIndex, const char *errorCode, void *pUserData);
+
 typedef struct Entry
 {
+    char entryId[SITEWISE_ENTRY_ID_LENGTH + 1];     /* Filled by the serializer */
     char *assetId;
     char *propertyId;
+    char *propertyAlias;    /* Identifies the property instead of assetId and propertyId if not NULL */
 
     size_t propertyValuesLen;
     PropertyValue_t propertyValues[MAX_SITEWISE_PROPERTY_VALUE_SIZE];
 } Entry_t;
 
 /**
- *  Given a array of entries, print them into JSON format into a buffer.
+ *  Given a array of entries, print them into JSON format into a buffer. Every entry gets a new entry ID.
+ *
+ *  The JSON is written straight into the buffer without any heap allocation. If it doesn't fit, the buffer is left
+ *  holding an empty string and SITEWISE_ERROR_BUFFER_TOO_SMALL is returned.
  *
  * @param[in] payloadBuffer The JSON string buffer
  * @param[in] payloadBufferSize Buffer size of the JSON string buffer
  * @param[in] entriesArray Array of entries
- * @param[in] entriesLen Length of the entries array
+ * @param[in] entriesLen Length of the entries array, at most MAX_SITEWISE_ENTRY_SIZE like a request of
+ *                       BatchPutAssetPropertyValue, or SITEWISE_ERROR_INVALID_PARAMETER is returned
  * @return 0 on success, non-zero value otherwise
  */
 int Sitewise_printEntriesAsJson(char *payloadBuffer, size_t size, Entry_t *entriesArray, size_t entriesLen);
 
+/**
+ *  Same as Sitewise_printEntriesAsJson, but hand each chunk to a callback as soon as it has been written, so that the
+ *  caller can consume the payload (e.g. hash it) while it is being produced. A chunk is flushed after every entry.
+ *  If the buffer turns out to be too small the chunks delivered so far must be discarded.
+ *
+ * @param[in] payloadBuffer The JSON string buffer
+ * @param[in] payloadBufferSize Buffer size of the JSON string buffer
+ * @param[in] entriesArray Array of entries
+ * @param[in] entriesLen Length of the entries array, at most MAX_SITEWISE_ENTRY_SIZE
+ * @param[in] chunkCallback Callback for every chunk written, can be NULL
+ * @param[in] pUserData User data passed to the callback
+ * @param[out] pPayloadLen Length of the JSON string on success, can be NULL
+ * @return 0 on success, non-zero value otherwise
+ */
+int Sitewise_printEntriesAsJsonStreaming(char *payloadBuffer, size_t payloadBufferSize, Entry_t *entriesArray, size_t entriesLen,
+                                         SitewiseChunkCallback_t chunkCallback, void *pUserData, size_t *pPayloadLen);
+
+/**
+ *  Get the length of an entry in JSON format, including all of its property values.
+ *
+ * @param[in] pEntry The entry
+ * @return The length in bytes
+ */
+size_t Sitewise_getEntryJsonLength(Entry_t *pEntry);
+
+/**
+ *  Get the length of a property value in JSON format.
+ *
+ * @param[in] pPropertyValue The property value
+ * @return The length in bytes
+ */
+size_t Sitewise_getPropertyValueJsonLength(PropertyValue_t *pPropertyValue);
+
+/**
+ *  Parse the response of BatchPutAssetPropertyValue, and report every property value listed in its errorEntries.
+ *
+ * @param[in] pResponse The response body
+ * @param[in] responseLen The length of the response body
+ * @param[in] entriesArray The entries that were sent, with the entry IDs filled by the serializer
+ * @param[in] entriesLen Length of the entries array
+ * @param[in] errorCallback The callback for every failed property value
+ * @param[in] pUserData User data passed to the callback
+ * @return 0 on success, non-zero value otherwise
+ */
+int Sitewise_parseErrorEntries(const char *pResponse, size_t responseLen, Entry_t *entriesArray, size_t entriesLen,
+                               SitewiseErrorCallback_t errorCallback, void *pUserData);
+
+/**
+ *  Check if an error code of errorEntries is worth retrying, like throttling, or is permanent, like an invalid value.
+ *
+ * @param[in] errorCode The error code
+ * @return true if the property value may succeed when it is sent again
+ */
+bool Sitewise_isRetryableError(const char *errorCode);
+
 #ifdef __cplusplus
 }
 #endif
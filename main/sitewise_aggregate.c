@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sitewise_aggregate.h"
+
+static SitewiseAggregate_t aggregates[MAX_SITEWISE_AGGREGATE_SIZE];
+static size_t aggregatesLen = 0;
+
+int SitewiseAggregate_register(size_t sourceIndex, uint32_t windowMs, bool keepRaw, char *assetId,
+                               char *propertyIds[SITEWISE_AGGREGATE_KIND_SIZE])
+{
+    SitewiseAggregate_t *pAggregate = NULL;
+
+    if (SitewiseSource_get(sourceIndex) == NULL)
+    {
+        return SITEWISE_AGGREGATE_ERROR_NOT_FOUND;
+    }
+    if (aggregatesLen == MAX_SITEWISE_AGGREGATE_SIZE)
+    {
+        return SITEWISE_AGGREGATE_ERROR_FULL;
+    }
+
+    pAggregate = &(aggregates[aggregatesLen]);
+    pAggregate->sourceIndex = sourceIndex;
+    pAggregate->windowMs = (windowMs > 0) ? windowMs : 1;
+    pAggregate->keepRaw = keepRaw;
+    pAggregate->count = 0;
+
+    for (size_t kind = 0; kind < SITEWISE_AGGREGATE_KIND_SIZE; kind++)
+    {
+        pAggregate->outputs[kind] = -1;
+        if (propertyIds[kind] != NULL && propertyIds[kind][0] != '\0')
+        {
+            /* The statistics are pushed, never read, so the output source has no read callback. */
+            pAggregate->outputs[kind] = SitewiseSource_register(assetId, propertyIds[kind], 0, NULL, NULL);
+            if (pAggregate->outputs[kind] < 0)
+            {
+                return SITEWISE_AGGREGATE_ERROR_FULL;
+            }
+        }
+    }
+
+    aggregatesLen++;
+    return SITEWISE_AGGREGATE_ERROR_NONE;
+}
+
+static void emitOutput(SitewiseAggregate_t *pAggregate, int kind, PropertyValue_t *pPropertyValue,
+                       SitewiseSourceEmit_t emit, void *pUserData)
+{
+    if (pAggregate->outputs[kind] >= 0)
+    {
+        pPropertyValue->timeInSeconds = pAggregate->windowTimeInSeconds;
+        pPropertyValue->offsetInNanos = pAggregate->windowOffsetInNanos;
+        emit((size_t)(pAggregate->outputs[kind]), pPropertyValue, pUserData);
+    }
+}
+
+/**
+ * Emit the statistics of the open window and start over.
+ */
+static void closeWindow(SitewiseAggregate_t *pAggregate, SitewiseSourceEmit_t emit, void *pUserData)
+{
+    PropertyValue_t propertyValue = { .type = PROPERTY_VALUE_TYPE_DOUBLE };
+
+    if (pAggregate->count == 0)
+    {
+        return;
+    }
+
+    propertyValue.doubleValue = pAggregate->min;
+    emitOutput(pAggregate, SITEWISE_AGGREGATE_MIN, &propertyValue, emit, pUserData);
+    propertyValue.doubleValue = pAggregate->max;
+    emitOutput(pAggregate, SITEWISE_AGGREGATE_MAX, &propertyValue, emit, pUserData);
+    propertyValue.doubleValue = pAggregate->sum / pAggregate->count;
+    emitOutput(pAggregate, SITEWISE_AGGREGATE_MEAN, &propertyValue, emit, pUserData);
+
+    propertyValue.type = PROPERTY_VALUE_TYPE_INTEGER;
+    propertyValue.integerValue = (int)(pAggregate->count);
+    emitOutput(pAggregate, SITEWISE_AGGREGATE_COUNT, &propertyValue, emit, pUserData);
+
+    pAggregate->count = 0;
+}
+
+bool SitewiseAggregate_process(size_t sourceIndex, PropertyValue_t *pPropertyValue, int64_t nowMs,
+                               SitewiseSourceEmit_t emit, void *pUserData)
+{
+    bool keepRaw = true;
+    double value = 0;
+
+    if (pPropertyValue->type == PROPERTY_VALUE_TYPE_DOUBLE)
+    {
+        value = pPropertyValue->doubleValue;
+    }
+    else if (pPropertyValue->type == PROPERTY_VALUE_TYPE_INTEGER)
+    {
+        value = (double)(pPropertyValue->integerValue);
+    }
+    else
+    {
+        /* Only numbers have statistics. */
+        return true;
+    }
+
+    for (size_t i = 0; i < aggregatesLen; i++)
+    {
+        SitewiseAggregate_t *pAggregate = &(aggregates[i]);
+
+        if (pAggregate->sourceIndex != sourceIndex)
+        {
+            continue;
+        }
+
+        if (pAggregate->count > 0 && nowMs >= pAggregate->windowEndMs)
+        {
+            closeWindow(pAggregate, emit, pUserData);
+        }
+
+        if (pAggregate->count == 0)
+        {
+            /* Windows are aligned to multiples of their length. */
+            pAggregate->windowEndMs = nowMs - (nowMs % pAggregate->windowMs) + pAggregate->windowMs;
+            pAggregate->windowTimeInSeconds = pPropertyValue->timeInSeconds;
+            pAggregate->windowOffsetInNanos = pPropertyValue->offsetInNanos;
+            pAggregate->min = value;
+            pAggregate->max = value;
+            pAggregate->sum = 0;
+        }
+
+        pAggregate->min = (value < pAggregate->min) ? value : pAggregate->min;
+        pAggregate->max = (value > pAggregate->max) ? value : pAggregate->max;
+        pAggregate->sum += value;
+        pAggregate->count++;
+
+        keepRaw = keepRaw && pAggregate->keepRaw;
+    }
+
+    return keepRaw;
+}
+
+uint32_t SitewiseAggregate_poll(int64_t nowMs, SitewiseSourceEmit_t emit, void *pUserData)
+{
+    int64_t nextEndMs = INT64_MAX;
+
+    for (size_t i = 0; i < aggregatesLen; i++)
+    {
+        SitewiseAggregate_t *pAggregate = &(aggregates[i]);
+
+        if (pAggregate->count > 0 && nowMs >= pAggregate->windowEndMs)
+        {
+            closeWindow(pAggregate, emit, pUserData);
+        }
+
+        if (pAggregate->count > 0 && pAggregate->windowEndMs < nextEndMs)
+        {
+            nextEndMs = pAggregate->windowEndMs;
+        }
+    }
+
+    if (nextEndMs == INT64_MAX)
+    {
+        return UINT32_MAX;
+    }
+
+    return (nextEndMs > nowMs) ? (uint32_t)(nextEndMs - nowMs) : 0;
+}
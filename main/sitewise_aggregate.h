@@ -0,0 +1,93 @@
+#ifndef _SITEWISE_AGGREGATE_H_
+#define _SITEWISE_AGGREGATE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sitewise.h"
+#include "sitewise_source.h"
+
+#define MAX_SITEWISE_AGGREGATE_SIZE 8
+
+#define SITEWISE_AGGREGATE_ERROR_NONE       (0)
+#define SITEWISE_AGGREGATE_ERROR_FULL       (-1)
+#define SITEWISE_AGGREGATE_ERROR_NOT_FOUND  (-2)
+
+#define SITEWISE_AGGREGATE_MIN      (0)
+#define SITEWISE_AGGREGATE_MAX      (1)
+#define SITEWISE_AGGREGATE_MEAN     (2)
+#define SITEWISE_AGGREGATE_COUNT    (3)
+#define SITEWISE_AGGREGATE_KIND_SIZE (4)
+
+/**
+ * Tumbling-window statistics of the numeric values of one source.
+ *
+ * Every statistic is uploaded as a property of its own. The output properties are registered as sources without a
+ * read callback, so that their values travel through the ring, the batch and the spool like any other sample.
+ */
+typedef struct SitewiseAggregate
+{
+    size_t sourceIndex;
+    uint32_t windowMs;
+    bool keepRaw;                                   /* Also upload the raw values */
+    int outputs[SITEWISE_AGGREGATE_KIND_SIZE];      /* Source index of every statistic, or -1 if it isn't uploaded */
+
+    int64_t windowEndMs;                            /* Maintained by the aggregator */
+    long windowTimeInSeconds;                       /* Timestamp of the first value in the window */
+    long windowOffsetInNanos;
+    uint32_t count;
+    double min;
+    double max;
+    double sum;
+} SitewiseAggregate_t;
+
+/**
+ *  Aggregate the values of a source over tumbling windows. Aggregates are expected to be set up at start-up, before
+ *  the scheduler runs.
+ *
+ * @param[in] sourceIndex The index of the source to be aggregated
+ * @param[in] windowMs The window length in milliseconds
+ * @param[in] keepRaw true to upload the raw values as well as the statistics
+ * @param[in] assetId The asset ID of the output properties
+ * @param[in] propertyIds The property ID of every statistic, indexed by SITEWISE_AGGREGATE_MIN etc. NULL or an empty
+ *            string leaves the statistic out.
+ * @return 0 on success, SITEWISE_AGGREGATE_ERROR_NOT_FOUND if there is no such source, SITEWISE_AGGREGATE_ERROR_FULL
+ *         if there is no room for the aggregate or its output properties
+ */
+int SitewiseAggregate_register(size_t sourceIndex, uint32_t windowMs, bool keepRaw, char *assetId,
+                               char *propertyIds[SITEWISE_AGGREGATE_KIND_SIZE]);
+
+/**
+ *  Feed a sampled value to the aggregates of its source. The statistics of a window are emitted when the first value
+ *  after the window arrives, or when SitewiseAggregate_poll finds the window over.
+ *
+ * @param[in] sourceIndex The index of the source of the value
+ * @param[in] pPropertyValue The sampled value
+ * @param[in] nowMs Current time in milliseconds
+ * @param[in] emit The callback for the statistics
+ * @param[in] pUserData User data passed to the callback
+ * @return true if the raw value should be uploaded as well
+ */
+bool SitewiseAggregate_process(size_t sourceIndex, PropertyValue_t *pPropertyValue, int64_t nowMs,
+                               SitewiseSourceEmit_t emit, void *pUserData);
+
+/**
+ *  Emit the statistics of every window that is over.
+ *
+ * @param[in] nowMs Current time in milliseconds
+ * @param[in] emit The callback for the statistics
+ * @param[in] pUserData User data passed to the callback
+ * @return Milliseconds until the next window is over, UINT32_MAX if no window is open
+ */
+uint32_t SitewiseAggregate_poll(int64_t nowMs, SitewiseSourceEmit_t emit, void *pUserData);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SITEWISE_AGGREGATE_H_ */
@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdalign.h>
+
+#include "sitewise_arena.h"
+
+#define ARENA_ALIGNMENT (alignof(max_align_t))
+
+void SitewiseArena_init(SitewiseArena_t *pArena, void *pBuffer, size_t size)
+{
+    pArena->pBuffer = (uint8_t *)pBuffer;
+    pArena->size = size;
+    pArena->used = 0;
+    pArena->highWater = 0;
+    pArena->failures = 0;
+}
+
+void *SitewiseArena_alloc(SitewiseArena_t *pArena, size_t size)
+{
+    /* Align the address, the buffer itself may not be aligned. */
+    uintptr_t address = (uintptr_t)(pArena->pBuffer + pArena->used);
+    size_t padding = (ARENA_ALIGNMENT - address % ARENA_ALIGNMENT) % ARENA_ALIGNMENT;
+    void *pMemory = NULL;
+
+    if (size > pArena->size - pArena->used || padding > pArena->size - pArena->used - size)
+    {
+        pArena->failures++;
+        return NULL;
+    }
+
+    pMemory = pArena->pBuffer + pArena->used + padding;
+    pArena->used += padding + size;
+    if (pArena->used > pArena->highWater)
+    {
+        pArena->highWater = pArena->used;
+    }
+
+    return pMemory;
+}
+
+void SitewiseArena_reset(SitewiseArena_t *pArena)
+{
+    pArena->used = 0;
+}
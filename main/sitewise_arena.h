@@ -0,0 +1,53 @@
+#ifndef _SITEWISE_ARENA_H_
+#define _SITEWISE_ARENA_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A bump allocator over a buffer owned by the caller. Memory is only given back all at once, by resetting the arena,
+ * so it can't fragment and its peak use is known.
+ */
+typedef struct SitewiseArena
+{
+    uint8_t *pBuffer;
+    size_t size;
+    size_t used;
+    size_t highWater;       /* Most bytes ever in use at once */
+    uint32_t failures;      /* Allocations that didn't fit */
+} SitewiseArena_t;
+
+/**
+ *  Initialize an empty arena.
+ *
+ * @param[in] pArena The arena
+ * @param[in] pBuffer The memory of the arena, which has to outlive it
+ * @param[in] size The size of the memory in bytes
+ */
+void SitewiseArena_init(SitewiseArena_t *pArena, void *pBuffer, size_t size);
+
+/**
+ *  Allocate memory aligned for any type from the arena.
+ *
+ * @param[in] pArena The arena
+ * @param[in] size The number of bytes
+ * @return The memory, or NULL if the arena has no room left
+ */
+void *SitewiseArena_alloc(SitewiseArena_t *pArena, size_t size);
+
+/**
+ *  Give all the memory of the arena back at once.
+ *
+ * @param[in] pArena The arena
+ */
+void SitewiseArena_reset(SitewiseArena_t *pArena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SITEWISE_ARENA_H_ */
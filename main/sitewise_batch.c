@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "sitewise_batch.h"
+
+static bool isSameId(const char *id, const char *otherId)
+{
+    return (id == NULL || otherId == NULL) ? (id == otherId) : (strcmp(id, otherId) == 0);
+}
+
+/**
+ * Find the latest entry of the property if it still has room for another value.
+ */
+static Entry_t *findOpenEntry(SitewiseBatch_t *pBatch, char *assetId, char *propertyId, char *propertyAlias)
+{
+    for (size_t i = pBatch->entriesLen; i > 0; i--)
+    {
+        Entry_t *pEntry = &(pBatch->entries[i - 1]);
+
+        if (isSameId(pEntry->assetId, assetId) && isSameId(pEntry->propertyId, propertyId) &&
+            isSameId(pEntry->propertyAlias, propertyAlias))
+        {
+            return (pEntry->propertyValuesLen < MAX_SITEWISE_PROPERTY_VALUE_SIZE) ? pEntry : NULL;
+        }
+    }
+
+    return NULL;
+}
+
+void SitewiseBatch_init(SitewiseBatch_t *pBatch, size_t maxValues, size_t maxPayloadSize, uint32_t maxAgeMs)
+{
+    pBatch->maxValues = maxValues;
+    pBatch->maxPayloadSize = maxPayloadSize;
+    pBatch->maxAgeMs = maxAgeMs;
+
+    SitewiseBatch_reset(pBatch);
+}
+
+void SitewiseBatch_reset(SitewiseBatch_t *pBatch)
+{
+    pBatch->entriesLen = 0;
+    pBatch->valuesLen = 0;
+    pBatch->payloadLen = SITEWISE_EMPTY_PAYLOAD_LENGTH;
+    pBatch->firstValueMs = 0;
+}
+
+int SitewiseBatch_add(SitewiseBatch_t *pBatch, char *assetId, char *propertyId, char *propertyAlias, PropertyValue_t *pPropertyValue,
+                      int64_t nowMs)
+{
+    Entry_t *pEntry = findOpenEntry(pBatch, assetId, propertyId, propertyAlias);
+    size_t payloadLen = pBatch->payloadLen;
+
+    if (pEntry == NULL)
+    {
+        if (pBatch->entriesLen == MAX_SITEWISE_ENTRY_SIZE)
+        {
+            return SITEWISE_BATCH_ERROR_FULL;
+        }
+
+        Entry_t emptyEntry = {
+            .assetId = assetId,
+            .propertyId = propertyId,
+            .propertyAlias = propertyAlias,
+            .propertyValuesLen = 0,
+        };
+        payloadLen += ((pBatch->entriesLen > 0) ? 1 : 0) + Sitewise_getEntryJsonLength(&emptyEntry);
+        payloadLen += Sitewise_getPropertyValueJsonLength(pPropertyValue);
+    }
+    else
+    {
+        payloadLen += 1 + Sitewise_getPropertyValueJsonLength(pPropertyValue);
+    }
+
+    /* Every batch has to fit into the payload buffer, so a value too large for a batch of its own can't be sent. */
+    if (payloadLen > pBatch->maxPayloadSize)
+    {
+        return (pBatch->valuesLen > 0) ? SITEWISE_BATCH_ERROR_FULL : SITEWISE_BATCH_ERROR_TOO_LARGE;
+    }
+
+    if (pEntry == NULL)
+    {
+        pEntry = &(pBatch->entries[pBatch->entriesLen++]);
+        pEntry->assetId = assetId;
+        pEntry->propertyId = propertyId;
+        pEntry->propertyAlias = propertyAlias;
+        pEntry->propertyValuesLen = 0;
+    }
+
+    pEntry->propertyValues[pEntry->propertyValuesLen++] = *pPropertyValue;
+    if (pBatch->valuesLen == 0)
+    {
+        pBatch->firstValueMs = nowMs;
+    }
+    pBatch->valuesLen++;
+    pBatch->payloadLen = payloadLen;
+
+    return SITEWISE_BATCH_ERROR_NONE;
+}
+
+bool SitewiseBatch_isReady(SitewiseBatch_t *pBatch, int64_t nowMs)
+{
+    if (pBatch->valuesLen == 0)
+    {
+        return false;
+    }
+
+    return pBatch->valuesLen >= pBatch->maxValues ||
+           pBatch->payloadLen >= pBatch->maxPayloadSize ||
+           SitewiseBatch_getTimeToDeadline(pBatch, nowMs) == 0;
+}
+
+int64_t SitewiseBatch_getTimeToDeadline(SitewiseBatch_t *pBatch, int64_t nowMs)
+{
+    int64_t remainingMs = 0;
+
+    if (pBatch->valuesLen == 0)
+    {
+        return -1;
+    }
+
+    remainingMs = pBatch->firstValueMs + pBatch->maxAgeMs - nowMs;
+
+    return (remainingMs > 0) ? remainingMs : 0;
+}
@@ -0,0 +1,93 @@
+#ifndef _SITEWISE_BATCH_H_
+#define _SITEWISE_BATCH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sitewise.h"
+
+#define SITEWISE_BATCH_ERROR_NONE   (0)
+#define SITEWISE_BATCH_ERROR_FULL   (-1)
+#define SITEWISE_BATCH_ERROR_TOO_LARGE (-2)
+
+/**
+ * A batch of property values for one BatchPutAssetPropertyValue request.
+ *
+ * The batch is ready to be uploaded on whichever comes first: the number of values, the payload size, or the age of
+ * the oldest value reaching its limit.
+ */
+typedef struct SitewiseBatch
+{
+    Entry_t entries[MAX_SITEWISE_ENTRY_SIZE];
+    size_t entriesLen;
+
+    size_t valuesLen;       /* Number of property values in all entries */
+    size_t payloadLen;      /* Exact length of the batch in JSON format */
+    int64_t firstValueMs;   /* When the oldest value was added */
+
+    size_t maxValues;
+    size_t maxPayloadSize;
+    uint32_t maxAgeMs;
+} SitewiseBatch_t;
+
+/**
+ *  Initialize an empty batch with its flushing limits.
+ *
+ * @param[in] pBatch The batch
+ * @param[in] maxValues Number of property values that makes the batch ready
+ * @param[in] maxPayloadSize Payload size in bytes that the batch must not exceed, e.g. to fit into the payload buffer
+ * @param[in] maxAgeMs Age of the oldest value in milliseconds that makes the batch ready
+ */
+void SitewiseBatch_init(SitewiseBatch_t *pBatch, size_t maxValues, size_t maxPayloadSize, uint32_t maxAgeMs);
+
+/**
+ *  Empty the batch and keep its limits.
+ *
+ * @param[in] pBatch The batch
+ */
+void SitewiseBatch_reset(SitewiseBatch_t *pBatch);
+
+/**
+ *  Add a property value into the batch. The value joins the latest entry of the same property if that entry still has
+ *  room, otherwise it starts a new entry.
+ *
+ * @param[in] pBatch The batch
+ * @param[in] assetId The asset ID of the property
+ * @param[in] propertyId The property ID
+ * @param[in] propertyAlias The property alias, or NULL if the property is identified by assetId and propertyId
+ * @param[in] pPropertyValue The property value to be copied into the batch
+ * @param[in] nowMs Current time in milliseconds
+ * @return 0 on success, SITEWISE_BATCH_ERROR_FULL if the value doesn't fit and the batch has to be uploaded first,
+ *         SITEWISE_BATCH_ERROR_TOO_LARGE if the value doesn't even fit into an empty batch
+ */
+int SitewiseBatch_add(SitewiseBatch_t *pBatch, char *assetId, char *propertyId, char *propertyAlias, PropertyValue_t *pPropertyValue,
+                      int64_t nowMs);
+
+/**
+ *  Check if the batch should be uploaded now.
+ *
+ * @param[in] pBatch The batch
+ * @param[in] nowMs Current time in milliseconds
+ * @return true if the batch is ready
+ */
+bool SitewiseBatch_isReady(SitewiseBatch_t *pBatch, int64_t nowMs);
+
+/**
+ *  Get the time left until the batch gets ready by its age.
+ *
+ * @param[in] pBatch The batch
+ * @param[in] nowMs Current time in milliseconds
+ * @return Milliseconds until the deadline, or -1 if the batch is empty and has no deadline
+ */
+int64_t SitewiseBatch_getTimeToDeadline(SitewiseBatch_t *pBatch, int64_t nowMs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SITEWISE_BATCH_H_ */
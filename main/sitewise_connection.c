@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "sitewise_connection.h"
+#include "sitewise_metrics.h"
+
+static const char *TAG = "sitewise_connection";
+
+void SitewiseConnection_init(SitewiseConnection_t *pConnection, esp_http_client_handle_t client, char *pRecvBuffer,
+                             size_t recvBufferSize)
+{
+    pConnection->client = client;
+    pConnection->pRecvBuffer = pRecvBuffer;
+    pConnection->recvBufferSize = recvBufferSize;
+    pConnection->pRecvBuffer[0] = '\0';
+    pConnection->connectStartUs = 0;
+}
+
+void SitewiseConnection_onConnected(SitewiseConnection_t *pConnection)
+{
+    /* A new connection, so it is a new TLS handshake as well. */
+    pConnection->stats.handshakes++;
+    SitewiseMetrics_record(SITEWISE_HISTOGRAM_CONNECT, (uint32_t)(esp_timer_get_time() - pConnection->connectStartUs));
+}
+
+/**
+ * Send the request once and read the response.
+ *
+ * @param[out] pReused true if the request went out on a connection that was open already
+ */
+static esp_err_t sendOnce(SitewiseConnection_t *pConnection, const char *pBody, size_t bodyLen, int *pStatusCode,
+                          bool *pReused)
+{
+    esp_http_client_handle_t client = pConnection->client;
+    uint32_t handshakes = pConnection->stats.handshakes;
+    int64_t writeStartUs = 0;
+    int64_t contentLength = 0;
+    int dataRead = 0;
+    esp_err_t err = ESP_OK;
+
+    *pReused = false;
+    pConnection->pRecvBuffer[0] = '\0';
+    pConnection->connectStartUs = esp_timer_get_time();
+    err = esp_http_client_open(client, (int)bodyLen);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to open HTTP connection: %s", esp_err_to_name(err));
+        SitewiseMetrics_add(SITEWISE_COUNTER_FAILED_CONNECT, 1);
+        return err;
+    }
+    *pReused = (handshakes == pConnection->stats.handshakes);
+
+    writeStartUs = esp_timer_get_time();
+    if (esp_http_client_write(client, pBody, (int)bodyLen) < 0)
+    {
+        ESP_LOGE(TAG, "Write failed");
+        SitewiseMetrics_add(SITEWISE_COUNTER_FAILED_WRITE, 1);
+        return ESP_FAIL;
+    }
+
+    if (esp_http_client_fetch_headers(client) < 0)
+    {
+        ESP_LOGE(TAG, "HTTP client fetch headers failed");
+        SitewiseMetrics_add(SITEWISE_COUNTER_FAILED_RESPONSE, 1);
+        return ESP_FAIL;
+    }
+
+    dataRead = esp_http_client_read_response(client, pConnection->pRecvBuffer, (int)(pConnection->recvBufferSize - 1));
+    if (dataRead < 0)
+    {
+        ESP_LOGE(TAG, "Failed to read response");
+        SitewiseMetrics_add(SITEWISE_COUNTER_FAILED_RESPONSE, 1);
+        return ESP_FAIL;
+    }
+    pConnection->pRecvBuffer[dataRead] = '\0';
+    SitewiseMetrics_record(SITEWISE_HISTOGRAM_REQUEST_RTT, (uint32_t)(esp_timer_get_time() - writeStartUs));
+    SitewiseMetrics_add(SITEWISE_COUNTER_BYTES_SENT, (uint32_t)bodyLen);
+
+    *pStatusCode = esp_http_client_get_status_code(client);
+    contentLength = esp_http_client_get_content_length(client);
+    ESP_LOGI(TAG, "HTTP POST Status = %d, content_length = %" PRId64, *pStatusCode, contentLength);
+    ESP_LOGD(TAG, "%s", pConnection->pRecvBuffer);
+
+    if (!esp_http_client_is_complete_data_received(client))
+    {
+        /* Leftovers of this response would be taken as the next response, so start over on a new connection. */
+        ESP_LOGW(TAG, "Response is larger than the receiving buffer, closing the connection");
+        esp_http_client_close(client);
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t SitewiseConnection_send(SitewiseConnection_t *pConnection, const char *pBody, size_t bodyLen, int *pStatusCode)
+{
+    bool reused = false;
+    esp_err_t err = sendOnce(pConnection, pBody, bodyLen, pStatusCode, &reused);
+
+    if (err != ESP_OK && reused)
+    {
+        /* The server may have closed the idle connection. Try once more on a new connection. */
+        ESP_LOGW(TAG, "Request failed on a reused connection, reconnecting");
+        esp_http_client_close(pConnection->client);
+        pConnection->stats.reconnects++;
+        err = sendOnce(pConnection, pBody, bodyLen, pStatusCode, &reused);
+    }
+
+    pConnection->stats.requests++;
+    SitewiseMetrics_add(SITEWISE_COUNTER_REQUESTS, 1);
+    if (err != ESP_OK)
+    {
+        esp_http_client_close(pConnection->client);
+        return err;
+    }
+    if (reused)
+    {
+        pConnection->stats.reused_requests++;
+    }
+
+    return ESP_OK;
+}
@@ -0,0 +1,80 @@
+#ifndef _SITEWISE_CONNECTION_H_
+#define _SITEWISE_CONNECTION_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_http_client.h"
+
+/**
+ * Counters of the long-lived connection to the SiteWise endpoint.
+ */
+typedef struct
+{
+    uint32_t requests;          /* Requests sent, including the failed ones */
+    uint32_t handshakes;        /* New connections, each with a TLS handshake when TLS is used */
+    uint32_t reused_requests;   /* Requests that were served on an already established connection */
+    uint32_t reconnects;        /* Requests retried on a new connection after the old one had gone stale */
+    uint32_t payload_bytes;     /* JSON bytes of the requests */
+    uint32_t body_bytes;        /* Bytes of the request bodies as sent, smaller than payload_bytes with compression */
+} sitewise_connection_stats_t;
+
+/**
+ * A HTTP client that keeps its connection alive across requests, with the buffer its responses are read into.
+ *
+ * The client has to be created with keep-alive, and its event handler has to call SitewiseConnection_onConnected on
+ * HTTP_EVENT_ON_CONNECTED, which is how a new connection is told from a reused one.
+ */
+typedef struct SitewiseConnection
+{
+    esp_http_client_handle_t client;
+    char *pRecvBuffer;
+    size_t recvBufferSize;
+    sitewise_connection_stats_t stats;
+    int64_t connectStartUs;     /* When the connection was last opened, for the connect time */
+} SitewiseConnection_t;
+
+/**
+ *  Initialize a connection. Nothing is connected until the first request.
+ *
+ * @param[in] pConnection The connection
+ * @param[in] client The HTTP client
+ * @param[in] pRecvBuffer The buffer for the responses, which are NUL-terminated
+ * @param[in] recvBufferSize The size of the buffer
+ */
+void SitewiseConnection_init(SitewiseConnection_t *pConnection, esp_http_client_handle_t client, char *pRecvBuffer,
+                             size_t recvBufferSize);
+
+/**
+ *  Count a new connection of the client. To be called from the event handler of the client.
+ *
+ * @param[in] pConnection The connection
+ */
+void SitewiseConnection_onConnected(SitewiseConnection_t *pConnection);
+
+/**
+ *  Send a request on the current connection, or on a new one if there is none, and read the response.
+ *
+ *  A request that fails on a reused connection is sent once more on a new connection, as the server may have closed
+ *  the idle one. A request that fails on a new connection isn't. After a failure the connection is closed, so the next
+ *  request starts on a new one.
+ *
+ * @param[in] pConnection The connection
+ * @param[in] pBody The body of the request, whose headers have been set on the client
+ * @param[in] bodyLen The length of the body
+ * @param[out] pStatusCode The HTTP status code
+ * @return ESP_OK if a response has been received into the buffer, the error of the last attempt otherwise
+ */
+esp_err_t SitewiseConnection_send(SitewiseConnection_t *pConnection, const char *pBody, size_t bodyLen, int *pStatusCode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SITEWISE_CONNECTION_H_ */
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <sys/time.h>
+
+#include "sitewise_metrics.h"
+
+#define PUBLISHED_PERCENTILE_SIZE (2)
+
+/**
+ * A histogram with power-of-two buckets. Every field is updated on its own, so a reader may see a value in the count
+ * but not yet in its bucket. That's good enough for statistics and needs no lock.
+ *
+ * The sum is 64 bits wide, as a few seconds-long queue waits in microseconds would overflow 32 bits. Targets without
+ * 64-bit atomic instructions, e.g. the ESP32, get them from the toolchain's libatomic, which uses a short critical
+ * section.
+ */
+typedef struct SitewiseHistogram
+{
+    _Atomic uint32_t count;
+    _Atomic uint64_t sum;
+    _Atomic uint32_t max;
+    _Atomic uint32_t buckets[SITEWISE_HISTOGRAM_BUCKET_SIZE];
+} SitewiseHistogram_t;
+
+static SitewiseHistogram_t histograms[SITEWISE_HISTOGRAM_SIZE];
+static _Atomic uint32_t counters[SITEWISE_COUNTER_SIZE];
+
+static const char *histogramNames[SITEWISE_HISTOGRAM_SIZE] = {
+    [SITEWISE_HISTOGRAM_SAMPLE_TO_ENQUEUE] = "sample_to_enqueue_us",
+    [SITEWISE_HISTOGRAM_QUEUE_WAIT] = "queue_wait_us",
+    [SITEWISE_HISTOGRAM_SERIALIZE] = "serialize_us",
+    [SITEWISE_HISTOGRAM_SIGN] = "sign_us",
+    [SITEWISE_HISTOGRAM_CONNECT] = "connect_us",
+    [SITEWISE_HISTOGRAM_REQUEST_RTT] = "request_rtt_us",
+    [SITEWISE_HISTOGRAM_REQUEST_BYTES] = "request_bytes",
+};
+
+static const char *counterNames[SITEWISE_COUNTER_SIZE] = {
+    [SITEWISE_COUNTER_REQUESTS] = "requests",
+    [SITEWISE_COUNTER_BYTES_SENT] = "bytes_sent",
+    [SITEWISE_COUNTER_FAILED_CONNECT] = "failed_connect",
+    [SITEWISE_COUNTER_FAILED_WRITE] = "failed_write",
+    [SITEWISE_COUNTER_FAILED_RESPONSE] = "failed_response",
+    [SITEWISE_COUNTER_THROTTLED] = "throttled",
+    [SITEWISE_COUNTER_SERVER_ERROR] = "server_error",
+    [SITEWISE_COUNTER_REJECTED] = "rejected",
+    [SITEWISE_COUNTER_OVERSIZED] = "oversized",
+    [SITEWISE_COUNTER_RING_FULL] = "ring_full",
+    [SITEWISE_COUNTER_ARENA_FULL] = "arena_full",
+};
+
+static const uint32_t publishedPercentiles[PUBLISHED_PERCENTILE_SIZE] = { 50, 99 };
+
+/* The aliases of the published metrics, and the sources they are registered as */
+static char histogramAliases[SITEWISE_HISTOGRAM_SIZE][PUBLISHED_PERCENTILE_SIZE][SITEWISE_METRICS_ALIAS_LENGTH];
+static char counterAliases[SITEWISE_COUNTER_SIZE][SITEWISE_METRICS_ALIAS_LENGTH];
+static int histogramSources[SITEWISE_HISTOGRAM_SIZE][PUBLISHED_PERCENTILE_SIZE];
+static int counterSources[SITEWISE_COUNTER_SIZE];
+static bool published = false;
+
+static size_t getBucket(uint32_t value)
+{
+    size_t bucket = (value == 0) ? 0 : (size_t)(32 - __builtin_clz(value));
+
+    return (bucket < SITEWISE_HISTOGRAM_BUCKET_SIZE) ? bucket : SITEWISE_HISTOGRAM_BUCKET_SIZE - 1;
+}
+
+static uint32_t getBucketUpperBound(size_t bucket)
+{
+    /* The last bucket has no upper bound but the maximum. */
+    return (bucket == SITEWISE_HISTOGRAM_BUCKET_SIZE - 1) ? UINT32_MAX : (uint32_t)((1ULL << bucket) - 1);
+}
+
+void SitewiseMetrics_record(size_t histogram, uint32_t value)
+{
+    SitewiseHistogram_t *pHistogram = &(histograms[histogram]);
+    uint32_t max = atomic_load_explicit(&(pHistogram->max), memory_order_relaxed);
+
+    atomic_fetch_add_explicit(&(pHistogram->buckets[getBucket(value)]), 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&(pHistogram->sum), value, memory_order_relaxed);
+    atomic_fetch_add_explicit(&(pHistogram->count), 1, memory_order_relaxed);
+
+    while (value > max && !atomic_compare_exchange_weak_explicit(&(pHistogram->max), &max, value,
+                                                                 memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+}
+
+void SitewiseMetrics_add(size_t counter, uint32_t n)
+{
+    atomic_fetch_add_explicit(&(counters[counter]), n, memory_order_relaxed);
+}
+
+void SitewiseMetrics_getSnapshot(SitewiseMetricsSnapshot_t *pSnapshot)
+{
+    for (size_t i = 0; i < SITEWISE_HISTOGRAM_SIZE; i++)
+    {
+        SitewiseHistogram_t *pHistogram = &(histograms[i]);
+        SitewiseHistogramSnapshot_t *pHistogramSnapshot = &(pSnapshot->histograms[i]);
+
+        pHistogramSnapshot->count = atomic_exchange_explicit(&(pHistogram->count), 0, memory_order_relaxed);
+        pHistogramSnapshot->sum = atomic_exchange_explicit(&(pHistogram->sum), 0, memory_order_relaxed);
+        pHistogramSnapshot->max = atomic_exchange_explicit(&(pHistogram->max), 0, memory_order_relaxed);
+        for (size_t bucket = 0; bucket < SITEWISE_HISTOGRAM_BUCKET_SIZE; bucket++)
+        {
+            pHistogramSnapshot->buckets[bucket] = atomic_exchange_explicit(&(pHistogram->buckets[bucket]), 0, memory_order_relaxed);
+        }
+    }
+
+    for (size_t i = 0; i < SITEWISE_COUNTER_SIZE; i++)
+    {
+        pSnapshot->counters[i] = atomic_load_explicit(&(counters[i]), memory_order_relaxed);
+    }
+}
+
+uint32_t SitewiseMetrics_getPercentile(const SitewiseHistogramSnapshot_t *pHistogram, uint32_t percent)
+{
+    uint64_t total = 0;
+    uint64_t rank = 0;
+    uint64_t seen = 0;
+
+    /* The buckets are the truth, the count may be off by a value recorded during the snapshot. */
+    for (size_t bucket = 0; bucket < SITEWISE_HISTOGRAM_BUCKET_SIZE; bucket++)
+    {
+        total += pHistogram->buckets[bucket];
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    rank = (total * percent + 99) / 100;
+    rank = (rank > 0) ? rank : 1;
+    for (size_t bucket = 0; bucket < SITEWISE_HISTOGRAM_BUCKET_SIZE; bucket++)
+    {
+        seen += pHistogram->buckets[bucket];
+        if (seen >= rank)
+        {
+            uint32_t upperBound = getBucketUpperBound(bucket);
+            return (pHistogram->max > 0 && pHistogram->max < upperBound) ? pHistogram->max : upperBound;
+        }
+    }
+
+    return pHistogram->max;
+}
+
+size_t SitewiseMetrics_format(char *pBuffer, size_t bufferSize, const SitewiseMetricsSnapshot_t *pSnapshot)
+{
+    size_t len = 0;
+    int written = 0;
+
+    for (size_t i = 0; i < SITEWISE_HISTOGRAM_SIZE && len < bufferSize; i++)
+    {
+        const SitewiseHistogramSnapshot_t *pHistogram = &(pSnapshot->histograms[i]);
+
+        written = snprintf(pBuffer + len, bufferSize - len, "%s%s=%" PRIu32 "/%" PRIu32 "/%" PRIu32 "/%" PRIu32,
+                           (len > 0) ? " " : "", histogramNames[i], pHistogram->count,
+                           SitewiseMetrics_getPercentile(pHistogram, 50), SitewiseMetrics_getPercentile(pHistogram, 99),
+                           pHistogram->max);
+        len += (written > 0) ? (size_t)written : 0;
+    }
+
+    for (size_t i = 0; i < SITEWISE_COUNTER_SIZE && len < bufferSize; i++)
+    {
+        written = snprintf(pBuffer + len, bufferSize - len, " %s=%" PRIu32, counterNames[i], pSnapshot->counters[i]);
+        len += (written > 0) ? (size_t)written : 0;
+    }
+
+    return len;
+}
+
+static int registerAlias(char *pAlias, const char *aliasPrefix, const char *name, const char *suffix)
+{
+    snprintf(pAlias, SITEWISE_METRICS_ALIAS_LENGTH, "%s/%s%s", aliasPrefix, name, suffix);
+
+    /* The metrics are pushed, never read, so their sources have no read callback. */
+    return SitewiseSource_registerAlias(pAlias, 0, NULL, NULL);
+}
+
+int SitewiseMetrics_registerProperties(const char *aliasPrefix)
+{
+    char suffix[8];
+
+    for (size_t i = 0; i < SITEWISE_HISTOGRAM_SIZE; i++)
+    {
+        for (size_t p = 0; p < PUBLISHED_PERCENTILE_SIZE; p++)
+        {
+            snprintf(suffix, sizeof(suffix), "/p%" PRIu32, publishedPercentiles[p]);
+            histogramSources[i][p] = registerAlias(histogramAliases[i][p], aliasPrefix, histogramNames[i], suffix);
+            if (histogramSources[i][p] < 0)
+            {
+                return SITEWISE_METRICS_ERROR_FULL;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < SITEWISE_COUNTER_SIZE; i++)
+    {
+        counterSources[i] = registerAlias(counterAliases[i], aliasPrefix, counterNames[i], "");
+        if (counterSources[i] < 0)
+        {
+            return SITEWISE_METRICS_ERROR_FULL;
+        }
+    }
+
+    published = true;
+    return SITEWISE_METRICS_ERROR_NONE;
+}
+
+void SitewiseMetrics_publish(const SitewiseMetricsSnapshot_t *pSnapshot, SitewiseSourceEmit_t emit, void *pUserData)
+{
+    PropertyValue_t propertyValue = { 0 };
+    struct timeval tv;
+
+    if (!published)
+    {
+        return;
+    }
+
+    gettimeofday(&tv, NULL);
+    propertyValue.timeInSeconds = (long)(tv.tv_sec);
+    propertyValue.offsetInNanos = (long)(tv.tv_usec) * 1000;
+
+    propertyValue.type = PROPERTY_VALUE_TYPE_INTEGER;
+    for (size_t i = 0; i < SITEWISE_HISTOGRAM_SIZE; i++)
+    {
+        /* An empty histogram has no percentiles, rather than percentiles of 0. */
+        if (pSnapshot->histograms[i].count == 0)
+        {
+            continue;
+        }
+        for (size_t p = 0; p < PUBLISHED_PERCENTILE_SIZE; p++)
+        {
+            propertyValue.integerValue = (int)SitewiseMetrics_getPercentile(&(pSnapshot->histograms[i]), publishedPercentiles[p]);
+            emit((size_t)(histogramSources[i][p]), &propertyValue, pUserData);
+        }
+    }
+
+    propertyValue.type = PROPERTY_VALUE_TYPE_DOUBLE;
+    for (size_t i = 0; i < SITEWISE_COUNTER_SIZE; i++)
+    {
+        propertyValue.doubleValue = (double)(pSnapshot->counters[i]);
+        emit((size_t)(counterSources[i]), &propertyValue, pUserData);
+    }
+}
@@ -0,0 +1,137 @@
+#ifndef _SITEWISE_METRICS_H_
+#define _SITEWISE_METRICS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sitewise.h"
+#include "sitewise_source.h"
+
+#define SITEWISE_METRICS_ERROR_NONE (0)
+#define SITEWISE_METRICS_ERROR_FULL (-1)
+
+/* Bucket 0 counts the value 0, bucket n > 0 counts the values from 2^(n-1) to 2^n - 1, the last bucket the rest. */
+#define SITEWISE_HISTOGRAM_BUCKET_SIZE (32)
+
+/* Histograms of the upload path, in microseconds unless named otherwise */
+#define SITEWISE_HISTOGRAM_SAMPLE_TO_ENQUEUE    (0)     /* From the sample timestamp until the sample is in the ring */
+#define SITEWISE_HISTOGRAM_QUEUE_WAIT           (1)     /* From the sample timestamp until the sample is in a batch */
+#define SITEWISE_HISTOGRAM_SERIALIZE            (2)     /* Serializing a batch, including compression */
+#define SITEWISE_HISTOGRAM_SIGN                 (3)     /* Signing a request whose payload hash is known */
+#define SITEWISE_HISTOGRAM_CONNECT              (4)     /* Opening a new connection, including the TLS handshake */
+#define SITEWISE_HISTOGRAM_REQUEST_RTT          (5)     /* From writing a request until its response has been read */
+#define SITEWISE_HISTOGRAM_REQUEST_BYTES        (6)     /* Body size of a request in bytes */
+#define SITEWISE_HISTOGRAM_SIZE                 (7)
+
+/* Counters since boot */
+#define SITEWISE_COUNTER_REQUESTS               (0)
+#define SITEWISE_COUNTER_BYTES_SENT             (1)
+#define SITEWISE_COUNTER_FAILED_CONNECT         (2)     /* No connection could be opened */
+#define SITEWISE_COUNTER_FAILED_WRITE           (3)     /* The request couldn't be written */
+#define SITEWISE_COUNTER_FAILED_RESPONSE        (4)     /* No response could be read */
+#define SITEWISE_COUNTER_THROTTLED              (5)     /* HTTP 429 or 503 */
+#define SITEWISE_COUNTER_SERVER_ERROR           (6)     /* Any other HTTP 5xx */
+#define SITEWISE_COUNTER_REJECTED               (7)     /* Any other HTTP status of 300 and above */
+#define SITEWISE_COUNTER_OVERSIZED              (8)     /* A batch that doesn't fit into the payload buffer */
+#define SITEWISE_COUNTER_RING_FULL              (9)     /* A sample that didn't fit into the ring */
+#define SITEWISE_COUNTER_ARENA_FULL             (10)    /* A response that didn't fit into the response arena */
+#define SITEWISE_COUNTER_SIZE                   (11)
+
+/* Room for the snapshot of SitewiseMetrics_format with values of any size */
+#define SITEWISE_METRICS_FORMAT_SIZE (768)
+
+/* Longest property alias of a published metric, including the prefix */
+#define SITEWISE_METRICS_ALIAS_LENGTH (96)
+
+/**
+ * A copy of a histogram at a point in time.
+ */
+typedef struct SitewiseHistogramSnapshot
+{
+    uint32_t count;
+    uint64_t sum;
+    uint32_t max;
+    uint32_t buckets[SITEWISE_HISTOGRAM_BUCKET_SIZE];
+} SitewiseHistogramSnapshot_t;
+
+/**
+ * A copy of all metrics: the histograms since the previous snapshot and the counters since boot.
+ */
+typedef struct SitewiseMetricsSnapshot
+{
+    SitewiseHistogramSnapshot_t histograms[SITEWISE_HISTOGRAM_SIZE];
+    uint32_t counters[SITEWISE_COUNTER_SIZE];
+} SitewiseMetricsSnapshot_t;
+
+/**
+ *  Record a value into a histogram. Safe to call from any task without a lock.
+ *
+ * @param[in] histogram The histogram, e.g. SITEWISE_HISTOGRAM_SIGN
+ * @param[in] value The value, e.g. a duration in microseconds
+ */
+void SitewiseMetrics_record(size_t histogram, uint32_t value);
+
+/**
+ *  Add to a counter. Safe to call from any task without a lock.
+ *
+ * @param[in] counter The counter, e.g. SITEWISE_COUNTER_THROTTLED
+ * @param[in] n The amount to add
+ */
+void SitewiseMetrics_add(size_t counter, uint32_t n);
+
+/**
+ *  Take a snapshot of the metrics and start the histograms over. Values recorded while the snapshot is being taken
+ *  go into either this snapshot or the next one.
+ *
+ * @param[out] pSnapshot The snapshot
+ */
+void SitewiseMetrics_getSnapshot(SitewiseMetricsSnapshot_t *pSnapshot);
+
+/**
+ *  Get a percentile of a histogram snapshot, as the upper bound of its bucket but no more than the maximum.
+ *
+ * @param[in] pHistogram The histogram snapshot
+ * @param[in] percent The percentile, 0 to 100
+ * @return The percentile, or 0 if the histogram is empty
+ */
+uint32_t SitewiseMetrics_getPercentile(const SitewiseHistogramSnapshot_t *pHistogram, uint32_t percent);
+
+/**
+ *  Print a snapshot into one compact line for the serial log. Every histogram reads as count/p50/p99/max.
+ *
+ * @param[in] pBuffer The buffer, SITEWISE_METRICS_FORMAT_SIZE bytes fit any snapshot
+ * @param[in] bufferSize The size of the buffer
+ * @param[in] pSnapshot The snapshot
+ * @return The length of the line, which is cut short if it is bufferSize or more
+ */
+size_t SitewiseMetrics_format(char *pBuffer, size_t bufferSize, const SitewiseMetricsSnapshot_t *pSnapshot);
+
+/**
+ *  Register the metrics as properties identified by their alias, e.g. <aliasPrefix>/request_rtt_us/p99, so that they
+ *  need no set-up in the asset model. Like the aggregates, they are sources without a read callback.
+ *
+ * @param[in] aliasPrefix The prefix of the property aliases, e.g. /factory/line1/node7/metrics
+ * @return 0 on success, SITEWISE_METRICS_ERROR_FULL if there is no room for the sources
+ */
+int SitewiseMetrics_registerProperties(const char *aliasPrefix);
+
+/**
+ *  Emit the p50 and p99 of every histogram that has values, and every counter, on the registered properties.
+ *  Percentiles are integers, counters are doubles so that they don't wrap around as a SiteWise integer.
+ *
+ * @param[in] pSnapshot The snapshot
+ * @param[in] emit The callback for the values
+ * @param[in] pUserData User data passed to the callback
+ */
+void SitewiseMetrics_publish(const SitewiseMetricsSnapshot_t *pSnapshot, SitewiseSourceEmit_t emit, void *pUserData);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SITEWISE_METRICS_H_ */
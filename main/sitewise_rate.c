@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sitewise_rate.h"
+
+/* The rates never drop below this fraction of the configured rate, and grow back by this fraction per success. */
+#define MIN_RATE_FRACTION       (1.0 / 16)
+#define RATE_INCREASE_FRACTION  (1.0 / 20)
+
+static void initBucket(SitewiseTokenBucket_t *pBucket, uint32_t maxRate, int64_t nowMs)
+{
+    pBucket->maxRate = maxRate;
+    pBucket->rate = maxRate;
+    pBucket->tokens = maxRate;
+    pBucket->lastRefillMs = nowMs;
+}
+
+static void refillBucket(SitewiseTokenBucket_t *pBucket, int64_t nowMs)
+{
+    if (nowMs > pBucket->lastRefillMs)
+    {
+        pBucket->tokens += pBucket->rate * (nowMs - pBucket->lastRefillMs) / 1000.0;
+        pBucket->lastRefillMs = nowMs;
+    }
+
+    /* Allow a burst of one second, at the configured rate so a burst can't be refused for good. */
+    if (pBucket->tokens > pBucket->maxRate)
+    {
+        pBucket->tokens = pBucket->maxRate;
+    }
+}
+
+/**
+ * Get the milliseconds until the bucket holds the tokens. A request larger than the bucket waits for a full bucket.
+ */
+static uint32_t getBucketDelay(SitewiseTokenBucket_t *pBucket, double tokens, int64_t nowMs)
+{
+    if (pBucket->maxRate <= 0)
+    {
+        return 0;
+    }
+
+    refillBucket(pBucket, nowMs);
+    tokens = (tokens < pBucket->maxRate) ? tokens : pBucket->maxRate;
+    if (pBucket->tokens >= tokens)
+    {
+        return 0;
+    }
+
+    return (uint32_t)((tokens - pBucket->tokens) * 1000.0 / pBucket->rate) + 1;
+}
+
+static void consumeBucket(SitewiseTokenBucket_t *pBucket, double tokens, int64_t nowMs)
+{
+    if (pBucket->maxRate > 0)
+    {
+        refillBucket(pBucket, nowMs);
+        pBucket->tokens -= tokens;
+    }
+}
+
+static void updateBucket(SitewiseTokenBucket_t *pBucket, bool throttled)
+{
+    if (pBucket->maxRate <= 0)
+    {
+        return;
+    }
+
+    if (throttled)
+    {
+        /* Back off multiplicatively, and give up the burst. */
+        pBucket->rate /= 2;
+        if (pBucket->rate < pBucket->maxRate * MIN_RATE_FRACTION)
+        {
+            pBucket->rate = pBucket->maxRate * MIN_RATE_FRACTION;
+        }
+        pBucket->tokens = (pBucket->tokens > 0) ? 0 : pBucket->tokens;
+    }
+    else
+    {
+        pBucket->rate += pBucket->maxRate * RATE_INCREASE_FRACTION;
+        if (pBucket->rate > pBucket->maxRate)
+        {
+            pBucket->rate = pBucket->maxRate;
+        }
+    }
+}
+
+void SitewiseRateLimiter_init(SitewiseRateLimiter_t *pLimiter, uint32_t requestsPerS, uint32_t entriesPerS, int64_t startMs)
+{
+    initBucket(&(pLimiter->requests), requestsPerS, startMs);
+    initBucket(&(pLimiter->entries), entriesPerS, startMs);
+    pLimiter->notBeforeMs = startMs;
+    pLimiter->throttled = 0;
+}
+
+uint32_t SitewiseRateLimiter_getDelay(SitewiseRateLimiter_t *pLimiter, size_t entriesLen, int64_t nowMs)
+{
+    uint32_t delayMs = (pLimiter->notBeforeMs > nowMs) ? (uint32_t)(pLimiter->notBeforeMs - nowMs) : 0;
+    uint32_t requestsDelayMs = getBucketDelay(&(pLimiter->requests), 1, nowMs);
+    uint32_t entriesDelayMs = getBucketDelay(&(pLimiter->entries), entriesLen, nowMs);
+
+    delayMs = (requestsDelayMs > delayMs) ? requestsDelayMs : delayMs;
+    delayMs = (entriesDelayMs > delayMs) ? entriesDelayMs : delayMs;
+
+    return delayMs;
+}
+
+void SitewiseRateLimiter_consume(SitewiseRateLimiter_t *pLimiter, size_t entriesLen, int64_t nowMs)
+{
+    consumeBucket(&(pLimiter->requests), 1, nowMs);
+    consumeBucket(&(pLimiter->entries), entriesLen, nowMs);
+}
+
+void SitewiseRateLimiter_update(SitewiseRateLimiter_t *pLimiter, bool throttled)
+{
+    updateBucket(&(pLimiter->requests), throttled);
+    updateBucket(&(pLimiter->entries), throttled);
+    pLimiter->throttled += throttled ? 1 : 0;
+}
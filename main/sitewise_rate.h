@@ -0,0 +1,77 @@
+#ifndef _SITEWISE_RATE_H_
+#define _SITEWISE_RATE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A token bucket that refills at a rate, up to one second worth of tokens.
+ */
+typedef struct SitewiseTokenBucket
+{
+    double maxRate;             /* Configured tokens per second, 0 for no limit */
+    double rate;                /* Current tokens per second, lowered while the service throttles */
+    double tokens;
+    int64_t lastRefillMs;
+} SitewiseTokenBucket_t;
+
+/**
+ * Client-side pacing of the requests to the ingestion quotas of SiteWise: a bucket of requests and a bucket of
+ * entries. Both rates are halved when the service throttles and grow back step by step on every accepted request, so
+ * the uploader settles just below the rate that the service sustains.
+ */
+typedef struct SitewiseRateLimiter
+{
+    SitewiseTokenBucket_t requests;
+    SitewiseTokenBucket_t entries;
+    int64_t notBeforeMs;        /* No request before this time, e.g. the start-up jitter */
+    uint32_t throttled;         /* Number of throttled requests */
+} SitewiseRateLimiter_t;
+
+/**
+ *  Initialize a rate limiter with full buckets.
+ *
+ * @param[in] pLimiter The rate limiter
+ * @param[in] requestsPerS Maximum requests per second, 0 for no limit
+ * @param[in] entriesPerS Maximum entries per second, 0 for no limit
+ * @param[in] startMs No request goes out before this time in milliseconds
+ */
+void SitewiseRateLimiter_init(SitewiseRateLimiter_t *pLimiter, uint32_t requestsPerS, uint32_t entriesPerS, int64_t startMs);
+
+/**
+ *  Get how long a request has to wait.
+ *
+ * @param[in] pLimiter The rate limiter
+ * @param[in] entriesLen Number of entries of the request
+ * @param[in] nowMs Current time in milliseconds
+ * @return Milliseconds until the request may go out, 0 if it may go out now
+ */
+uint32_t SitewiseRateLimiter_getDelay(SitewiseRateLimiter_t *pLimiter, size_t entriesLen, int64_t nowMs);
+
+/**
+ *  Take the tokens of a request that goes out now.
+ *
+ * @param[in] pLimiter The rate limiter
+ * @param[in] entriesLen Number of entries of the request
+ * @param[in] nowMs Current time in milliseconds
+ */
+void SitewiseRateLimiter_consume(SitewiseRateLimiter_t *pLimiter, size_t entriesLen, int64_t nowMs);
+
+/**
+ *  Adapt the rates to the response of a request.
+ *
+ * @param[in] pLimiter The rate limiter
+ * @param[in] throttled true if the service throttled the request, e.g. with HTTP 429 or 503
+ */
+void SitewiseRateLimiter_update(SitewiseRateLimiter_t *pLimiter, bool throttled);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SITEWISE_RATE_H_ */
@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sitewise_ring.h"
+
+int SitewiseRing_init(SitewiseRing_t *pRing, SitewiseSample_t *pSlots, uint32_t capacity)
+{
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+    {
+        return SITEWISE_RING_ERROR_CAPACITY;
+    }
+
+    pRing->pSlots = pSlots;
+    pRing->capacity = capacity;
+    pRing->mask = capacity - 1;
+    atomic_init(&(pRing->head), 0);
+    atomic_init(&(pRing->tail), 0);
+    atomic_init(&(pRing->dropped), 0);
+
+    return SITEWISE_RING_ERROR_NONE;
+}
+
+SitewiseSample_t *SitewiseRing_reserve(SitewiseRing_t *pRing)
+{
+    uint32_t head = atomic_load_explicit(&(pRing->head), memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&(pRing->tail), memory_order_acquire);
+
+    if (head - tail == pRing->capacity)
+    {
+        atomic_fetch_add_explicit(&(pRing->dropped), 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    return &(pRing->pSlots[head & pRing->mask]);
+}
+
+void SitewiseRing_commit(SitewiseRing_t *pRing)
+{
+    uint32_t head = atomic_load_explicit(&(pRing->head), memory_order_relaxed);
+
+    /* Release: the slot content becomes visible before the new head. */
+    atomic_store_explicit(&(pRing->head), head + 1, memory_order_release);
+}
+
+SitewiseSample_t *SitewiseRing_peek(SitewiseRing_t *pRing)
+{
+    uint32_t tail = atomic_load_explicit(&(pRing->tail), memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&(pRing->head), memory_order_acquire);
+
+    if (head == tail)
+    {
+        return NULL;
+    }
+
+    return &(pRing->pSlots[tail & pRing->mask]);
+}
+
+void SitewiseRing_release(SitewiseRing_t *pRing)
+{
+    uint32_t tail = atomic_load_explicit(&(pRing->tail), memory_order_relaxed);
+
+    /* Release: the slot has been read before the producer may reuse it. */
+    atomic_store_explicit(&(pRing->tail), tail + 1, memory_order_release);
+}
+
+uint32_t SitewiseRing_getCount(SitewiseRing_t *pRing)
+{
+    return atomic_load_explicit(&(pRing->head), memory_order_acquire) -
+           atomic_load_explicit(&(pRing->tail), memory_order_acquire);
+}
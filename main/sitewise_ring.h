@@ -0,0 +1,88 @@
+#ifndef _SITEWISE_RING_H_
+#define _SITEWISE_RING_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sitewise_sample.h"
+
+#define SITEWISE_RING_ERROR_NONE        (0)
+#define SITEWISE_RING_ERROR_CAPACITY    (-1)
+
+/**
+ * A lock-free ring of samples for exactly one producer task and one consumer task.
+ *
+ * The producer fills a slot in place and commits it, the consumer reads the oldest slot in place and releases it.
+ * Head and tail are free-running counters, so the ring can hold all of its slots. The capacity is a power of two, so
+ * that the slot of a counter stays the same when the counter wraps around at 2^32.
+ */
+typedef struct SitewiseRing
+{
+    SitewiseSample_t *pSlots;
+    uint32_t capacity;
+    uint32_t mask;              /* capacity - 1 */
+
+    _Atomic uint32_t head;      /* Written by the producer only */
+    _Atomic uint32_t tail;      /* Written by the consumer only */
+    _Atomic uint32_t dropped;   /* Samples the producer couldn't put in because the ring was full */
+} SitewiseRing_t;
+
+/**
+ *  Initialize an empty ring over caller-provided storage.
+ *
+ * @param[in] pRing The ring
+ * @param[in] pSlots Storage of the slots
+ * @param[in] capacity Number of slots in the storage, a power of two
+ * @return 0 on success, SITEWISE_RING_ERROR_CAPACITY if the capacity is not a power of two
+ */
+int SitewiseRing_init(SitewiseRing_t *pRing, SitewiseSample_t *pSlots, uint32_t capacity);
+
+/**
+ *  Producer: get the next free slot to be filled in place.
+ *
+ * @param[in] pRing The ring
+ * @return The slot, or NULL if the ring is full. A full ring counts the sample as dropped.
+ */
+SitewiseSample_t *SitewiseRing_reserve(SitewiseRing_t *pRing);
+
+/**
+ *  Producer: publish the slot returned by SitewiseRing_reserve.
+ *
+ * @param[in] pRing The ring
+ */
+void SitewiseRing_commit(SitewiseRing_t *pRing);
+
+/**
+ *  Consumer: get the oldest sample without removing it.
+ *
+ * @param[in] pRing The ring
+ * @return The sample, or NULL if the ring is empty
+ */
+SitewiseSample_t *SitewiseRing_peek(SitewiseRing_t *pRing);
+
+/**
+ *  Consumer: remove the sample returned by SitewiseRing_peek.
+ *
+ * @param[in] pRing The ring
+ */
+void SitewiseRing_release(SitewiseRing_t *pRing);
+
+/**
+ *  Get the number of samples in the ring.
+ *
+ * @param[in] pRing The ring
+ * @return The number of samples
+ */
+uint32_t SitewiseRing_getCount(SitewiseRing_t *pRing);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SITEWISE_RING_H_ */
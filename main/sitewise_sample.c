@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "sitewise_sample.h"
+
+_Static_assert(sizeof(SitewiseSample_t) == SITEWISE_SAMPLE_SIZE, "The sample record must have a fixed width");
+_Static_assert(sizeof(double) == sizeof(((SitewiseSample_t *)0)->value), "A double must fit into the value bits");
+_Static_assert(sizeof(char *) <= sizeof(((SitewiseSample_t *)0)->value), "A pointer must fit into the value bits");
+
+void SitewiseSample_encode(SitewiseSample_t *pSample, size_t sourceIndex, const PropertyValue_t *pPropertyValue)
+{
+    pSample->sourceIndex = (uint16_t)sourceIndex;
+    pSample->type = (uint8_t)(pPropertyValue->type);
+    pSample->reserved = 0;
+    pSample->timeInSeconds = (uint32_t)(pPropertyValue->timeInSeconds);
+    pSample->offsetInNanos = (uint32_t)(pPropertyValue->offsetInNanos);
+    pSample->value[0] = 0;
+    pSample->value[1] = 0;
+
+    switch (pPropertyValue->type)
+    {
+        case PROPERTY_VALUE_TYPE_BOOLEAN:
+            pSample->value[0] = pPropertyValue->booleanValue ? 1 : 0;
+            break;
+        case PROPERTY_VALUE_TYPE_DOUBLE:
+            memcpy(pSample->value, &(pPropertyValue->doubleValue), sizeof(double));
+            break;
+        case PROPERTY_VALUE_TYPE_INTEGER:
+            pSample->value[0] = (uint32_t)(pPropertyValue->integerValue);
+            break;
+        case PROPERTY_VALUE_TYPE_STRING:
+            memcpy(pSample->value, &(pPropertyValue->stringValue), sizeof(char *));
+            break;
+        default:
+            break;
+    }
+}
+
+void SitewiseSample_decode(const SitewiseSample_t *pSample, PropertyValue_t *pPropertyValue)
+{
+    memset(pPropertyValue, 0, sizeof(PropertyValue_t));
+    pPropertyValue->type = pSample->type;
+    pPropertyValue->timeInSeconds = (long)(pSample->timeInSeconds);
+    pPropertyValue->offsetInNanos = (long)(pSample->offsetInNanos);
+
+    switch (pSample->type)
+    {
+        case PROPERTY_VALUE_TYPE_BOOLEAN:
+            pPropertyValue->booleanValue = (pSample->value[0] != 0);
+            break;
+        case PROPERTY_VALUE_TYPE_DOUBLE:
+            memcpy(&(pPropertyValue->doubleValue), pSample->value, sizeof(double));
+            break;
+        case PROPERTY_VALUE_TYPE_INTEGER:
+            pPropertyValue->integerValue = (int)(int32_t)(pSample->value[0]);
+            break;
+        case PROPERTY_VALUE_TYPE_STRING:
+            memcpy(&(pPropertyValue->stringValue), pSample->value, sizeof(char *));
+            break;
+        default:
+            break;
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef _SITEWISE_SAMPLE_H_
+#define _SITEWISE_SAMPLE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sitewise.h"
+
+/* Version of the record layout, stored in the header of the spool file. Bump it whenever the layout changes. */
+#define SITEWISE_SAMPLE_VERSION (1)
+
+/* Size of a record in bytes, the same on every target */
+#define SITEWISE_SAMPLE_SIZE (20)
+
+/* Type of a record whose value has been dropped, e.g. a string spilled to the spool file. It keeps the place of the
+ * sample in the backlog, and is consumed along with the samples around it without being uploaded. */
+#define SITEWISE_SAMPLE_TYPE_DROPPED (0xFF)
+
+/**
+ * A property value and the index of its source in a fixed-width record, as it is buffered in the ring and the spool.
+ * It is only expanded into a PropertyValue_t when it goes into a batch.
+ *
+ * The value is kept as its bits: a double as is, an integer or a boolean in the low word. A string value is kept by
+ * its pointer, which has to stay valid, so a string record must never be persisted.
+ */
+typedef struct SitewiseSample
+{
+    uint16_t sourceIndex;
+    uint8_t type;               /* PROPERTY_VALUE_TYPE_BOOLEAN etc. */
+    uint8_t reserved;           /* 0 */
+    uint32_t timeInSeconds;
+    uint32_t offsetInNanos;
+    uint32_t value[2];          /* Word-aligned, so the record needs no padding */
+} SitewiseSample_t;
+
+/**
+ *  Pack a property value into a record.
+ *
+ * @param[out] pSample The record
+ * @param[in] sourceIndex The index of the source of the value
+ * @param[in] pPropertyValue The property value with its timestamp
+ */
+void SitewiseSample_encode(SitewiseSample_t *pSample, size_t sourceIndex, const PropertyValue_t *pPropertyValue);
+
+/**
+ *  Expand a record into a property value.
+ *
+ * @param[in] pSample The record
+ * @param[out] pPropertyValue The property value with its timestamp
+ */
+void SitewiseSample_decode(const SitewiseSample_t *pSample, PropertyValue_t *pPropertyValue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SITEWISE_SAMPLE_H_ */
@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "sitewise_source.h"
+
+static SitewiseSource_t sources[MAX_SITEWISE_SOURCE_SIZE];
+static size_t sourcesLen = 0;
+
+int SitewiseSource_register(char *assetId, char *propertyId, uint32_t periodMs, SitewiseSourceRead_t read, void *pContext)
+{
+    SitewiseSource_t *pSource = NULL;
+
+    if (sourcesLen == MAX_SITEWISE_SOURCE_SIZE)
+    {
+        return SITEWISE_SOURCE_ERROR_FULL;
+    }
+
+    pSource = &(sources[sourcesLen]);
+    pSource->assetId = assetId;
+    pSource->propertyId = propertyId;
+    pSource->propertyAlias = NULL;
+    pSource->periodMs = (periodMs > 0) ? periodMs : 1;
+    pSource->read = read;
+    pSource->pContext = pContext;
+    pSource->deadband.enabled = false;
+    pSource->nextSampleMs = -1;
+    pSource->suppressed = 0;
+    pSource->samples = 0;
+    pSource->overruns = 0;
+    pSource->latenessSumMs = 0;
+    pSource->maxLatenessMs = 0;
+
+    return (int)(sourcesLen++);
+}
+
+int SitewiseSource_registerAlias(char *propertyAlias, uint32_t periodMs, SitewiseSourceRead_t read, void *pContext)
+{
+    int sourceIndex = SitewiseSource_register(NULL, NULL, periodMs, read, pContext);
+
+    if (sourceIndex >= 0)
+    {
+        sources[sourceIndex].propertyAlias = propertyAlias;
+    }
+
+    return sourceIndex;
+}
+
+int SitewiseSource_setDeadband(size_t sourceIndex, double absolute, double percent, uint32_t heartbeatMs)
+{
+    SitewiseDeadband_t *pDeadband = NULL;
+
+    if (sourceIndex >= sourcesLen)
+    {
+        return SITEWISE_SOURCE_ERROR_NOT_FOUND;
+    }
+
+    pDeadband = &(sources[sourceIndex].deadband);
+    pDeadband->enabled = true;
+    pDeadband->absolute = absolute;
+    pDeadband->percent = percent;
+    pDeadband->heartbeatMs = heartbeatMs;
+    pDeadband->hasLastValue = false;
+
+    return SITEWISE_SOURCE_ERROR_NONE;
+}
+
+size_t SitewiseSource_getCount(void)
+{
+    return sourcesLen;
+}
+
+SitewiseSource_t *SitewiseSource_get(size_t sourceIndex)
+{
+    return (sourceIndex < sourcesLen) ? &(sources[sourceIndex]) : NULL;
+}
+
+static double numericValue(PropertyValue_t *pPropertyValue)
+{
+    return (pPropertyValue->type == PROPERTY_VALUE_TYPE_DOUBLE) ? pPropertyValue->doubleValue : (double)(pPropertyValue->integerValue);
+}
+
+/**
+ * Check if a value differs enough from the last reported one.
+ */
+static bool isSignificantChange(SitewiseDeadband_t *pDeadband, PropertyValue_t *pPropertyValue)
+{
+    PropertyValue_t *pLastValue = &(pDeadband->lastValue);
+    double delta = 0;
+
+    if (pPropertyValue->type != pLastValue->type)
+    {
+        return true;
+    }
+
+    switch (pPropertyValue->type)
+    {
+        case PROPERTY_VALUE_TYPE_BOOLEAN:
+            return pPropertyValue->booleanValue != pLastValue->booleanValue;
+        case PROPERTY_VALUE_TYPE_STRING:
+            /* A string too long for the copy differs from it in its last byte, and is always reported. */
+            return strncmp((pPropertyValue->stringValue != NULL) ? pPropertyValue->stringValue : "",
+                           pDeadband->lastString, sizeof(pDeadband->lastString)) != 0;
+        default:
+            break;
+    }
+
+    delta = fabs(numericValue(pPropertyValue) - numericValue(pLastValue));
+    if (pDeadband->absolute <= 0 && pDeadband->percent <= 0)
+    {
+        return delta > 0;
+    }
+    if (pDeadband->absolute > 0 && delta > pDeadband->absolute)
+    {
+        return true;
+    }
+    return pDeadband->percent > 0 && delta > fabs(numericValue(pLastValue)) * pDeadband->percent / 100.0;
+}
+
+/**
+ * Apply the deadband of a source to a new value, and remember the value if it gets reported.
+ */
+static bool passesDeadband(SitewiseSource_t *pSource, PropertyValue_t *pPropertyValue, int64_t nowMs)
+{
+    SitewiseDeadband_t *pDeadband = &(pSource->deadband);
+
+    if (!pDeadband->enabled)
+    {
+        return true;
+    }
+
+    if (pDeadband->hasLastValue &&
+        !(pDeadband->heartbeatMs > 0 && nowMs - pDeadband->lastReportMs >= pDeadband->heartbeatMs) &&
+        !isSignificantChange(pDeadband, pPropertyValue))
+    {
+        pSource->suppressed++;
+        return false;
+    }
+
+    pDeadband->hasLastValue = true;
+    pDeadband->lastValue = *pPropertyValue;
+    if (pPropertyValue->type == PROPERTY_VALUE_TYPE_STRING)
+    {
+        /* The string of the read callback may not outlive the next read. */
+        strncpy(pDeadband->lastString, (pPropertyValue->stringValue != NULL) ? pPropertyValue->stringValue : "",
+                sizeof(pDeadband->lastString) - 1);
+        pDeadband->lastString[sizeof(pDeadband->lastString) - 1] = '\0';
+        pDeadband->lastValue.stringValue = pDeadband->lastString;
+    }
+    pDeadband->lastReportMs = nowMs;
+    return true;
+}
+
+int SitewiseSource_getStats(size_t sourceIndex, SitewiseSourceStats_t *pStats)
+{
+    SitewiseSource_t *pSource = SitewiseSource_get(sourceIndex);
+
+    if (pSource == NULL)
+    {
+        return SITEWISE_SOURCE_ERROR_NOT_FOUND;
+    }
+
+    pStats->samples = pSource->samples;
+    pStats->overruns = pSource->overruns;
+    pStats->suppressed = pSource->suppressed;
+    pStats->meanLatenessMs = (pSource->samples > 0) ? (uint32_t)(pSource->latenessSumMs / pSource->samples) : 0;
+    pStats->maxLatenessMs = pSource->maxLatenessMs;
+
+    return SITEWISE_SOURCE_ERROR_NONE;
+}
+
+/**
+ * Move the deadline of a source past the current time. The deadlines stay on the grid of the period, so that late
+ * samples don't make the schedule drift, and the deadlines missed altogether are counted as overruns.
+ */
+static void advanceDeadline(SitewiseSource_t *pSource, int64_t nowMs)
+{
+    int64_t latenessMs = nowMs - pSource->nextSampleMs;
+    int64_t missed = latenessMs / pSource->periodMs;
+
+    pSource->samples++;
+    pSource->overruns += (uint32_t)missed;
+    latenessMs -= missed * pSource->periodMs;
+    pSource->latenessSumMs += (uint64_t)latenessMs;
+    if (latenessMs > pSource->maxLatenessMs)
+    {
+        pSource->maxLatenessMs = (uint32_t)latenessMs;
+    }
+
+    pSource->nextSampleMs += (missed + 1) * pSource->periodMs;
+}
+
+int64_t SitewiseSource_poll(int64_t nowMs, SitewiseSourceEmit_t emit, void *pUserData)
+{
+    int64_t nextDueMs = INT64_MAX;
+    PropertyValue_t propertyValue;
+    struct timeval tv;
+
+    for (size_t sourceIndex = 0; sourceIndex < sourcesLen; sourceIndex++)
+    {
+        SitewiseSource_t *pSource = &(sources[sourceIndex]);
+
+        if (pSource->read == NULL)
+        {
+            /* The values of this source are pushed, not sampled. */
+            continue;
+        }
+
+        if (pSource->nextSampleMs < 0)
+        {
+            /* The schedule of a source starts at its first poll. */
+            pSource->nextSampleMs = nowMs;
+        }
+
+        if (pSource->nextSampleMs <= nowMs)
+        {
+            advanceDeadline(pSource, nowMs);
+
+            if (pSource->read(pSource->pContext, &propertyValue) == SITEWISE_SOURCE_ERROR_NONE &&
+                passesDeadband(pSource, &propertyValue, nowMs))
+            {
+                gettimeofday(&tv, NULL);
+                propertyValue.timeInSeconds = (long)(tv.tv_sec);
+                propertyValue.offsetInNanos = (long)(tv.tv_usec) * 1000;
+                emit(sourceIndex, &propertyValue, pUserData);
+            }
+        }
+
+        if (pSource->nextSampleMs < nextDueMs)
+        {
+            nextDueMs = pSource->nextSampleMs;
+        }
+    }
+
+    if (nextDueMs == INT64_MAX)
+    {
+        /* No source at all, check back later. */
+        return nowMs + 1000;
+    }
+
+    return nextDueMs;
+}
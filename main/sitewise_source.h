@@ -0,0 +1,167 @@
+#ifndef _SITEWISE_SOURCE_H_
+#define _SITEWISE_SOURCE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sitewise.h"
+
+#define MAX_SITEWISE_SOURCE_SIZE 48
+
+#define SITEWISE_SOURCE_ERROR_NONE  (0)
+#define SITEWISE_SOURCE_ERROR_FULL  (-1)
+#define SITEWISE_SOURCE_ERROR_READ  (-2)
+#define SITEWISE_SOURCE_ERROR_NOT_FOUND (-3)
+
+/* Size of the copy of the last reported string a deadband compares against, a longer string is always reported */
+#define SITEWISE_DEADBAND_STRING_SIZE 64
+
+/**
+ * Read the current value of a source. The type and the value have to be filled, the timestamp is filled by the
+ * scheduler with microsecond resolution. A string value is kept by its pointer until it has been uploaded, so it has to
+ * point to storage that stays valid and unchanged, e.g. a string constant.
+ *
+ * @param[in] pContext The context given at registration
+ * @param[out] pPropertyValue The value
+ * @return 0 on success, non-zero value otherwise
+ */
+typedef int (*SitewiseSourceRead_t)(void *pContext, PropertyValue_t *pPropertyValue);
+
+/**
+ * Called by the scheduler for every value it has sampled.
+ *
+ * @param[in] sourceIndex The index of the source in the registry
+ * @param[in] pPropertyValue The sampled value with its timestamp
+ * @param[in] pUserData The user data given to the scheduler
+ */
+typedef void (*SitewiseSourceEmit_t)(size_t sourceIndex, PropertyValue_t *pPropertyValue, void *pUserData);
+
+/**
+ * Report-by-exception filter of a source. A value is reported when it moves away from the last reported value by more
+ * than the absolute or the percent threshold, or when the heartbeat interval has passed since the last report.
+ * Booleans and strings are reported when they change. Strings are compared against a copy of the last reported one.
+ */
+typedef struct SitewiseDeadband
+{
+    bool enabled;
+    double absolute;        /* Threshold in units of the value, 0 to disable */
+    double percent;         /* Threshold in percent of the last reported value, 0 to disable */
+    uint32_t heartbeatMs;   /* Report at least this often, 0 to disable */
+
+    bool hasLastValue;      /* Maintained by the scheduler */
+    PropertyValue_t lastValue;
+    char lastString[SITEWISE_DEADBAND_STRING_SIZE];
+    int64_t lastReportMs;
+} SitewiseDeadband_t;
+
+typedef struct SitewiseSource
+{
+    char *assetId;
+    char *propertyId;
+    char *propertyAlias;    /* Identifies the property instead of assetId and propertyId if not NULL */
+    uint32_t periodMs;
+    SitewiseSourceRead_t read;
+    void *pContext;
+    SitewiseDeadband_t deadband;
+
+    int64_t nextSampleMs;   /* Maintained by the scheduler */
+    uint32_t suppressed;    /* Number of values held back by the deadband */
+    uint32_t samples;
+    uint32_t overruns;
+    uint64_t latenessSumMs;
+    uint32_t maxLatenessMs;
+} SitewiseSource_t;
+
+/**
+ * Sampling fidelity of a source.
+ */
+typedef struct SitewiseSourceStats
+{
+    uint32_t samples;           /* Number of deadlines met, late or not */
+    uint32_t overruns;          /* Number of deadlines skipped because the sampler was more than a period late */
+    uint32_t suppressed;        /* Number of values held back by the deadband */
+    uint32_t meanLatenessMs;    /* How late a sample was taken after its deadline, on average */
+    uint32_t maxLatenessMs;
+} SitewiseSourceStats_t;
+
+/**
+ *  Register a sampling source. Sources are expected to be registered at start-up, before the scheduler runs.
+ *
+ * @param[in] assetId The asset ID of the property
+ * @param[in] propertyId The property ID
+ * @param[in] periodMs The sampling period in milliseconds
+ * @param[in] read The read callback, or NULL for a source whose values are pushed by the application, e.g. aggregates
+ * @param[in] pContext The context passed to the read callback
+ * @return The index of the source on success, SITEWISE_SOURCE_ERROR_FULL if the registry is full
+ */
+int SitewiseSource_register(char *assetId, char *propertyId, uint32_t periodMs, SitewiseSourceRead_t read, void *pContext);
+
+/**
+ *  Register a sampling source of a property identified by its alias, e.g. a data stream that isn't part of an asset.
+ *
+ * @param[in] propertyAlias The property alias
+ * @param[in] periodMs The sampling period in milliseconds
+ * @param[in] read The read callback, or NULL for a source whose values are pushed by the application
+ * @param[in] pContext The context passed to the read callback
+ * @return The index of the source on success, SITEWISE_SOURCE_ERROR_FULL if the registry is full
+ */
+int SitewiseSource_registerAlias(char *propertyAlias, uint32_t periodMs, SitewiseSourceRead_t read, void *pContext);
+
+/**
+ *  Only report the values of a source that change significantly. If both thresholds are 0, every change is reported.
+ *
+ * @param[in] sourceIndex The index returned at registration
+ * @param[in] absolute Threshold in units of the value, 0 to disable
+ * @param[in] percent Threshold in percent of the last reported value, 0 to disable
+ * @param[in] heartbeatMs Report an unchanged value again after this many milliseconds, 0 to disable
+ * @return 0 on success, SITEWISE_SOURCE_ERROR_NOT_FOUND if there is no such source
+ */
+int SitewiseSource_setDeadband(size_t sourceIndex, double absolute, double percent, uint32_t heartbeatMs);
+
+/**
+ *  Get the number of registered sources.
+ *
+ * @return The number of sources
+ */
+size_t SitewiseSource_getCount(void);
+
+/**
+ *  Get a registered source.
+ *
+ * @param[in] sourceIndex The index returned at registration
+ * @return The source, or NULL if the index is out of range
+ */
+SitewiseSource_t *SitewiseSource_get(size_t sourceIndex);
+
+/**
+ *  Get the sampling statistics of a source.
+ *
+ * @param[in] sourceIndex The index returned at registration
+ * @param[out] pStats The statistics
+ * @return 0 on success, SITEWISE_SOURCE_ERROR_NOT_FOUND if there is no such source
+ */
+int SitewiseSource_getStats(size_t sourceIndex, SitewiseSourceStats_t *pStats);
+
+/**
+ *  Sample every source that is due, and hand each value that passes its deadband to the emit callback.
+ *
+ *  Every source has absolute deadlines at multiples of its period from its first poll, so the time spent reading the
+ *  sources doesn't add up to drift.
+ *
+ * @param[in] nowMs Current time in milliseconds
+ * @param[in] emit The callback for the sampled values
+ * @param[in] pUserData User data passed to the callback
+ * @return The time in milliseconds when the next source is due
+ */
+int64_t SitewiseSource_poll(int64_t nowMs, SitewiseSourceEmit_t emit, void *pUserData);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SITEWISE_SOURCE_H_ */
@@ -0,0 +1,296 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "sitewise_spool.h"
+
+#define RECORD_SIZE sizeof(SitewiseSample_t)
+
+/* The spool file starts with a header, so that a file of another layout is never replayed. The magic tells the
+ * circular file from the append-only one of earlier versions. */
+#define FILE_MAGIC "SWS2"
+
+typedef struct SpoolFileHeader
+{
+    char magic[4];
+    uint16_t version;       /* SITEWISE_SAMPLE_VERSION */
+    uint16_t recordSize;
+    uint32_t capacity;      /* Number of slots */
+    uint32_t readIndex;     /* Slot of the oldest record */
+    uint32_t depth;         /* Number of records */
+} SpoolFileHeader_t;
+
+#define HEADER_SIZE sizeof(SpoolFileHeader_t)
+
+static long getRecordOffset(uint32_t slot)
+{
+    return (long)(HEADER_SIZE + (size_t)slot * RECORD_SIZE);
+}
+
+/**
+ * Get the slot of the file that is a number of records past the oldest one.
+ */
+static uint32_t getFileSlot(SitewiseSpool_t *pSpool, uint32_t index)
+{
+    return (uint32_t)(((uint64_t)pSpool->fileReadIndex + index) % pSpool->fileMaxSamples);
+}
+
+static uint32_t getRamSlot(SitewiseSpool_t *pSpool, uint32_t index)
+{
+    return (uint32_t)(((uint64_t)pSpool->tail + index) % pSpool->capacity);
+}
+
+static void closeFile(SitewiseSpool_t *pSpool)
+{
+    if (pSpool->pFile != NULL)
+    {
+        fclose(pSpool->pFile);
+        pSpool->pFile = NULL;
+    }
+}
+
+/**
+ * Persist where the records of the file start and how many there are.
+ */
+static int writeHeader(SitewiseSpool_t *pSpool)
+{
+    SpoolFileHeader_t header = {
+        .version = SITEWISE_SAMPLE_VERSION,
+        .recordSize = RECORD_SIZE,
+        .capacity = pSpool->fileMaxSamples,
+        .readIndex = pSpool->fileReadIndex,
+        .depth = pSpool->fileDepth,
+    };
+    memcpy(header.magic, FILE_MAGIC, sizeof(header.magic));
+
+    if (fseek(pSpool->pFile, 0, SEEK_SET) != 0 || fwrite(&header, HEADER_SIZE, 1, pSpool->pFile) != 1 ||
+        fflush(pSpool->pFile) != 0)
+    {
+        return SITEWISE_SPOOL_ERROR_IO;
+    }
+
+    return SITEWISE_SPOOL_ERROR_NONE;
+}
+
+/**
+ * Resume the records of an open spool file if it has been written with the current layout and size, and all of its
+ * records are there.
+ */
+static bool resumeFile(SitewiseSpool_t *pSpool)
+{
+    SpoolFileHeader_t header;
+    long fileSize = 0;
+
+    if (fseek(pSpool->pFile, 0, SEEK_SET) != 0 || fread(&header, HEADER_SIZE, 1, pSpool->pFile) != 1 ||
+        memcmp(header.magic, FILE_MAGIC, sizeof(header.magic)) != 0 || header.version != SITEWISE_SAMPLE_VERSION ||
+        header.recordSize != RECORD_SIZE || header.capacity != pSpool->fileMaxSamples ||
+        header.readIndex >= header.capacity || header.depth > header.capacity)
+    {
+        return false;
+    }
+
+    /* The records are written in order from the first slot on, so the file reaches at least the newest record, or
+     * its end if the records wrap around. */
+    uint64_t end = (uint64_t)header.readIndex + header.depth;
+    if (fseek(pSpool->pFile, 0, SEEK_END) != 0 || (fileSize = ftell(pSpool->pFile)) < 0 ||
+        fileSize < getRecordOffset((end < header.capacity) ? (uint32_t)end : header.capacity))
+    {
+        return false;
+    }
+
+    pSpool->fileReadIndex = header.readIndex;
+    pSpool->fileDepth = header.depth;
+    return true;
+}
+
+/**
+ * Start over with an empty spool file.
+ */
+static int truncateFile(SitewiseSpool_t *pSpool)
+{
+    closeFile(pSpool);
+    pSpool->fileReadIndex = 0;
+    pSpool->fileDepth = 0;
+
+    if ((pSpool->pFile = fopen(pSpool->pPath, "w+b")) == NULL)
+    {
+        return SITEWISE_SPOOL_ERROR_IO;
+    }
+    if (writeHeader(pSpool) != SITEWISE_SPOOL_ERROR_NONE)
+    {
+        closeFile(pSpool);
+        return SITEWISE_SPOOL_ERROR_IO;
+    }
+
+    return SITEWISE_SPOOL_ERROR_NONE;
+}
+
+/**
+ * Move the older half of the RAM ring to the end of the spool file. The records go in before the header counts them,
+ * so a reboot in between loses nothing that had been spilled before. A string sample is replaced by a dropped record,
+ * so that every sample keeps its position in the backlog while it is being replayed.
+ */
+static int spillToFile(SitewiseSpool_t *pSpool)
+{
+    uint32_t count = (pSpool->capacity + 1) / 2;
+    uint32_t written = 0;
+    uint32_t strings = 0;
+    uint32_t slot = 0;
+
+    if (pSpool->pFile == NULL || pSpool->fileDepth + count > pSpool->fileMaxSamples)
+    {
+        return SITEWISE_SPOOL_ERROR_FULL;
+    }
+
+    for (written = 0; written < count; written++)
+    {
+        SitewiseSample_t sample = pSpool->pSlots[getRamSlot(pSpool, written)];
+
+        /* A string value is kept by its pointer, which means nothing once it is read back after a reboot. */
+        if (sample.type == PROPERTY_VALUE_TYPE_STRING)
+        {
+            sample.type = SITEWISE_SAMPLE_TYPE_DROPPED;
+            memset(sample.value, 0, sizeof(sample.value));
+            strings++;
+        }
+
+        slot = getFileSlot(pSpool, pSpool->fileDepth + written);
+        if ((written == 0 || slot == 0) && fseek(pSpool->pFile, getRecordOffset(slot), SEEK_SET) != 0)
+        {
+            return SITEWISE_SPOOL_ERROR_IO;
+        }
+        if (fwrite(&sample, RECORD_SIZE, 1, pSpool->pFile) != 1)
+        {
+            return SITEWISE_SPOOL_ERROR_IO;
+        }
+    }
+
+    pSpool->fileDepth += count;
+    if (writeHeader(pSpool) != SITEWISE_SPOOL_ERROR_NONE)
+    {
+        pSpool->fileDepth -= count;
+        return SITEWISE_SPOOL_ERROR_IO;
+    }
+
+    pSpool->droppedStrings += strings;
+    pSpool->tail = getRamSlot(pSpool, count);
+    pSpool->ramDepth -= count;
+
+    return SITEWISE_SPOOL_ERROR_NONE;
+}
+
+int SitewiseSpool_init(SitewiseSpool_t *pSpool, SitewiseSample_t *pSlots, uint32_t capacity, const char *pPath, uint32_t fileMaxSamples)
+{
+    pSpool->pSlots = pSlots;
+    pSpool->capacity = capacity;
+    pSpool->tail = 0;
+    pSpool->ramDepth = 0;
+    pSpool->pPath = pPath;
+    pSpool->pFile = NULL;
+    pSpool->fileReadIndex = 0;
+    pSpool->fileDepth = 0;
+    pSpool->fileMaxSamples = fileMaxSamples;
+    pSpool->dropped = 0;
+    pSpool->droppedStrings = 0;
+    pSpool->drainStartMs = 0;
+    pSpool->drained = 0;
+
+    if (pPath == NULL)
+    {
+        return SITEWISE_SPOOL_ERROR_NONE;
+    }
+
+    /* Resume the backlog of the previous run, if any. A backlog of another layout can't be read back. */
+    if ((pSpool->pFile = fopen(pPath, "r+b")) != NULL && resumeFile(pSpool))
+    {
+        return SITEWISE_SPOOL_ERROR_NONE;
+    }
+
+    return truncateFile(pSpool);
+}
+
+int SitewiseSpool_push(SitewiseSpool_t *pSpool, const SitewiseSample_t *pSample)
+{
+    if (pSpool->ramDepth == pSpool->capacity && spillToFile(pSpool) != SITEWISE_SPOOL_ERROR_NONE)
+    {
+        pSpool->dropped++;
+        return SITEWISE_SPOOL_ERROR_FULL;
+    }
+
+    pSpool->pSlots[getRamSlot(pSpool, pSpool->ramDepth)] = *pSample;
+    pSpool->ramDepth++;
+
+    return SITEWISE_SPOOL_ERROR_NONE;
+}
+
+int SitewiseSpool_read(SitewiseSpool_t *pSpool, uint32_t index, SitewiseSample_t *pSample)
+{
+    if (index < pSpool->fileDepth)
+    {
+        if (fseek(pSpool->pFile, getRecordOffset(getFileSlot(pSpool, index)), SEEK_SET) != 0 ||
+            fread(pSample, RECORD_SIZE, 1, pSpool->pFile) != 1)
+        {
+            return SITEWISE_SPOOL_ERROR_IO;
+        }
+        return SITEWISE_SPOOL_ERROR_NONE;
+    }
+
+    index -= pSpool->fileDepth;
+    if (index < pSpool->ramDepth)
+    {
+        *pSample = pSpool->pSlots[getRamSlot(pSpool, index)];
+        return SITEWISE_SPOOL_ERROR_NONE;
+    }
+
+    return SITEWISE_SPOOL_ERROR_NOT_FOUND;
+}
+
+void SitewiseSpool_consume(SitewiseSpool_t *pSpool, uint32_t count, int64_t nowMs)
+{
+    uint32_t fromFile = (count < pSpool->fileDepth) ? count : pSpool->fileDepth;
+    uint32_t fromRam = count - fromFile;
+
+    if (pSpool->drainStartMs == 0)
+    {
+        pSpool->drainStartMs = nowMs;
+    }
+    pSpool->drained += count;
+
+    if (fromFile > 0)
+    {
+        pSpool->fileReadIndex = getFileSlot(pSpool, fromFile);
+        pSpool->fileDepth -= fromFile;
+        /* If the header can't be written, the samples are replayed once more after a reboot. */
+        writeHeader(pSpool);
+    }
+
+    if (fromRam > pSpool->ramDepth)
+    {
+        fromRam = pSpool->ramDepth;
+    }
+    pSpool->tail = getRamSlot(pSpool, fromRam);
+    pSpool->ramDepth -= fromRam;
+
+    if (SitewiseSpool_getDepth(pSpool) == 0)
+    {
+        pSpool->drainStartMs = 0;
+        pSpool->drained = 0;
+    }
+}
+
+uint32_t SitewiseSpool_getDepth(SitewiseSpool_t *pSpool)
+{
+    return pSpool->fileDepth + pSpool->ramDepth;
+}
+
+void SitewiseSpool_getStats(SitewiseSpool_t *pSpool, int64_t nowMs, SitewiseSpoolStats_t *pStats)
+{
+    int64_t elapsedMs = nowMs - pSpool->drainStartMs;
+
+    pStats->ramDepth = pSpool->ramDepth;
+    pStats->fileDepth = pSpool->fileDepth;
+    pStats->dropped = pSpool->dropped;
+    pStats->droppedStrings = pSpool->droppedStrings;
+    pStats->drainRate = (pSpool->drainStartMs != 0 && elapsedMs > 0) ? (uint32_t)(pSpool->drained * 1000LL / elapsedMs) : 0;
+}
@@ -0,0 +1,128 @@
+#ifndef _SITEWISE_SPOOL_H_
+#define _SITEWISE_SPOOL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "sitewise_ring.h"
+
+#define SITEWISE_SPOOL_ERROR_NONE       (0)
+#define SITEWISE_SPOOL_ERROR_FULL       (-1)
+#define SITEWISE_SPOOL_ERROR_IO         (-2)
+#define SITEWISE_SPOOL_ERROR_NOT_FOUND  (-3)
+
+/**
+ * Store-and-forward backlog of samples that couldn't be uploaded yet.
+ *
+ * Samples are kept in a RAM ring first. When the ring is full, its older half is appended to a spool file, so the
+ * file always holds older samples than the ring. Samples are replayed oldest-first: the file, then the ring.
+ *
+ * The file is a ring of fixed-width records as well, so the room of the replayed samples is taken again right away.
+ * Its header holds the version of the record layout, the slot of the oldest record and the number of records. The
+ * header is written after every spill and every consume, so a reboot resumes from the first sample that hasn't been
+ * accepted yet.
+ *
+ * The spool is owned by a single task. Samples are stored as their fixed-width records, so a string value is kept by
+ * its pointer, which has to stay valid. Such a pointer can't be read back after a reboot, so string samples are kept in
+ * RAM only. When the RAM ring spills to the file, a string sample is replaced by a record of type
+ * SITEWISE_SAMPLE_TYPE_DROPPED, so that the positions of the samples behind it don't change while they are being read.
+ */
+typedef struct SitewiseSpool
+{
+    SitewiseSample_t *pSlots;
+    uint32_t capacity;
+    uint32_t tail;              /* Slot of the oldest sample in RAM */
+    uint32_t ramDepth;          /* Number of samples in RAM */
+
+    const char *pPath;          /* NULL for a RAM-only spool */
+    FILE *pFile;
+    uint32_t fileReadIndex;     /* Slot of the oldest record, the next one to replay */
+    uint32_t fileDepth;         /* Number of records */
+    uint32_t fileMaxSamples;    /* Number of slots of the file */
+
+    uint32_t dropped;           /* Samples lost because both RAM and file were full */
+    uint32_t droppedStrings;    /* String samples lost because the RAM ring spilled to the file */
+
+    int64_t drainStartMs;       /* Start of the current drain, 0 if the backlog is empty */
+    uint32_t drained;           /* Samples replayed since the drain started */
+} SitewiseSpool_t;
+
+typedef struct SitewiseSpoolStats
+{
+    uint32_t ramDepth;
+    uint32_t fileDepth;
+    uint32_t dropped;
+    uint32_t droppedStrings;
+    uint32_t drainRate;         /* Samples per second replayed in the current drain */
+} SitewiseSpoolStats_t;
+
+/**
+ *  Initialize the spool. An existing spool file is resumed, so the backlog survives a reboot.
+ *
+ * @param[in] pSpool The spool
+ * @param[in] pSlots Storage of the RAM ring
+ * @param[in] capacity Number of slots of the RAM ring
+ * @param[in] pPath Path of the spool file, or NULL to keep the backlog in RAM only
+ * @param[in] fileMaxSamples Maximum number of samples in the spool file
+ * @return 0 on success, SITEWISE_SPOOL_ERROR_IO if the file can't be opened, in which case the spool is RAM-only. A file
+ *         of another record layout or size is started over.
+ */
+int SitewiseSpool_init(SitewiseSpool_t *pSpool, SitewiseSample_t *pSlots, uint32_t capacity, const char *pPath, uint32_t fileMaxSamples);
+
+/**
+ *  Append a sample to the end of the backlog.
+ *
+ * @param[in] pSpool The spool
+ * @param[in] pSample The sample
+ * @return 0 on success, SITEWISE_SPOOL_ERROR_FULL if the sample had to be dropped
+ */
+int SitewiseSpool_push(SitewiseSpool_t *pSpool, const SitewiseSample_t *pSample);
+
+/**
+ *  Read a sample of the backlog without removing it.
+ *
+ * @param[in] pSpool The spool
+ * @param[in] index The position in the backlog, 0 being the oldest sample
+ * @param[out] pSample The sample
+ * @return 0 on success, non-zero value otherwise
+ */
+int SitewiseSpool_read(SitewiseSpool_t *pSpool, uint32_t index, SitewiseSample_t *pSample);
+
+/**
+ *  Remove the oldest samples from the backlog once they have been uploaded. The samples of the file are removed in
+ *  its header as well.
+ *
+ * @param[in] pSpool The spool
+ * @param[in] count The number of samples
+ * @param[in] nowMs Current time in milliseconds, for the drain rate
+ */
+void SitewiseSpool_consume(SitewiseSpool_t *pSpool, uint32_t count, int64_t nowMs);
+
+/**
+ *  Get the number of samples in the backlog.
+ *
+ * @param[in] pSpool The spool
+ * @return The number of samples
+ */
+uint32_t SitewiseSpool_getDepth(SitewiseSpool_t *pSpool);
+
+/**
+ *  Get the statistics of the backlog.
+ *
+ * @param[in] pSpool The spool
+ * @param[in] nowMs Current time in milliseconds
+ * @param[out] pStats The statistics
+ */
+void SitewiseSpool_getStats(SitewiseSpool_t *pSpool, int64_t nowMs, SitewiseSpoolStats_t *pStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SITEWISE_SPOOL_H_ */
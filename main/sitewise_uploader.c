@@ -1,219 +1,1732 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
 #include <sys/time.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "freertos/event_groups.h"
 
 #include "esp_log.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
 #include "nvs_flash.h"
 #include "esp_wifi.h"
 #include "esp_netif.h"
 #include "esp_http_client.h"
 #include "esp_tls.h"
+#include "esp_spiffs.h"
+#include "esp_random.h"
+#include "esp_timer.h"
 #include "sdkconfig.h"
 
 #include "lwip/err.h"
 #include "lwip/apps/sntp.h"
 
+#include "aws_credentials.h"
 #include "aws_sig_v4_signing.h"
+#include "cJSON.h"
 
 #include "dht.h"
+#include "gzip.h"
 #include "sitewise.h"
+#include "sitewise_aggregate.h"
+#include "sitewise_arena.h"
+#include "sitewise_batch.h"
+#include "sitewise_connection.h"
+#include "sitewise_metrics.h"
+#include "sitewise_rate.h"
+#include "sitewise_ring.h"
+#include "sitewise_source.h"
+#include "sitewise_spool.h"
+#include "sitewise_uploader.h"
 
 static const char *TAG = "sitewise_uploader";
 
+/* A DHT sensor can't be read more often than this, so the sources of one sensor share a reading. */
+#define DHT_MIN_READ_INTERVAL_MS (1000)
+
+/* The interval in seconds of older configurations applies until an interval in milliseconds is set. */
+#if CONFIG_MEASUREMENT_INTERVAL_MS > 0
+#define MEASUREMENT_INTERVAL_MS CONFIG_MEASUREMENT_INTERVAL_MS
+#else
+#define MEASUREMENT_INTERVAL_MS (CONFIG_MEASUREMENT_INTERVAL_S * 1000)
+#endif
+
+/* How often the sampler logs the jitter and overruns of the sources */
+#define SAMPLER_STATS_INTERVAL_MS (60 * 1000)
+
+/* How often the upload task logs the drain rate and the memory use */
+#define UPLOAD_STATS_INTERVAL_MS (60 * 1000)
+
+/* A batch has to leave room for the terminating NUL in the payload buffer. */
+#define BATCH_BUFFER_PAYLOAD_SIZE ((CONFIG_SITEWISE_BATCH_MAX_PAYLOAD_SIZE < CONFIG_SITEWISE_PAYLOAD_BUFFER_SIZE) ? \
+                                   CONFIG_SITEWISE_BATCH_MAX_PAYLOAD_SIZE : CONFIG_SITEWISE_PAYLOAD_BUFFER_SIZE - 1)
+
+/* With gzip, a batch also has to fit the input of the compressor, or it would go out uncompressed. */
+#if CONFIG_SITEWISE_GZIP && BATCH_BUFFER_PAYLOAD_SIZE > GZIP_MAX_INPUT_SIZE
+#define BATCH_MAX_PAYLOAD_SIZE GZIP_MAX_INPUT_SIZE
+#else
+#define BATCH_MAX_PAYLOAD_SIZE BATCH_BUFFER_PAYLOAD_SIZE
+#endif
+
+/* How long to wait before fetching the credentials again after a failure */
+#define CREDENTIALS_RETRY_INTERVAL_MS (10 * 1000)
+
+/* The payload limit never shrinks below this on HTTP 413 */
+#define BATCH_MIN_PAYLOAD_SIZE (512)
+
+/* Stack sizes of the tasks in bytes. The upload task parses the responses and fetches the credentials over TLS. */
+#define UPLOAD_TASK_STACK_SIZE (8192)
+#define SAMPLER_TASK_STACK_SIZE (4096)
+#define WORKER_TASK_STACK_SIZE (8192)
+#define CREDENTIALS_TASK_STACK_SIZE (8192)
+
+/**
+ * The latest reading of the DHT sensor, shared by its temperature and humidity sources.
+ */
+typedef struct
+{
+    int64_t readMs;
+    int result;
+    float temperature;
+    float humidity;
+} dht_reading_t;
+
+static dht_reading_t dhtReading = { .readMs = -DHT_MIN_READ_INTERVAL_MS };
+
 /**
- * Whenever the thread dht11_read_task collects enough samples, it'll enqueue entries into this queue.
- * Then sitewise_upload_task dequeue from this queue and upload the entries.
+ * Whenever the thread sampler_task collects a sample, it'll put the sample into this ring and notify the upload task.
+ * Then sitewise_upload_task takes the samples out of the ring in place, batches them and uploads the batch.
  */
-static QueueHandle_t entriesQueue = NULL;
+_Static_assert((CONFIG_SITEWISE_SAMPLE_RING_SIZE & (CONFIG_SITEWISE_SAMPLE_RING_SIZE - 1)) == 0,
+               "The size of the sample ring must be a power of two");
+static SitewiseSample_t sampleSlots[CONFIG_SITEWISE_SAMPLE_RING_SIZE];
+static SitewiseRing_t sampleRing;
+static TaskHandle_t uploadTaskHandle = NULL;
+static TaskHandle_t samplerTaskHandle = NULL;
+
+#if CONFIG_SITEWISE_STATIC_MEMORY
+/* The task stacks and the memory of the responses are allocated up front, so they never come from the heap. */
+static StackType_t uploadTaskStack[UPLOAD_TASK_STACK_SIZE];
+static StaticTask_t uploadTaskBuffer;
+static StackType_t samplerTaskStack[SAMPLER_TASK_STACK_SIZE];
+static StaticTask_t samplerTaskBuffer;
+
+/* The cJSON nodes of a parsed response, given back at once after every batch */
+static uint8_t responseArenaBuffer[CONFIG_SITEWISE_RESPONSE_ARENA_SIZE];
+static SitewiseArena_t responseArena;
 
-/* Payload buffer of the HTTP request*/
-static char http_payload[4096];
+/* Set by the upload task only while it parses a response */
+static bool responseArenaActive = false;
 
-/* Receiving buffer for the response of the HTTP request. */
-static char recv_buffer[2048];
+/* The stack and the control block of a task, which only exist in the static memory mode */
+#define TASK_MEMORY(stack, taskBuffer) (stack), (taskBuffer)
+#else
+#define TASK_MEMORY(stack, taskBuffer) NULL, NULL
+#endif
+
+/* The batch being filled by sitewise_upload_task */
+static SitewiseBatch_t batch;
+
+/* Samples that couldn't be uploaded yet, oldest first. */
+static SitewiseSample_t spoolSlots[CONFIG_SITEWISE_SPOOL_RAM_SIZE];
+static SitewiseSpool_t spool;
+
+/* When the backlog of the spool is tried again, and how many times it has failed in a row */
+static int64_t nextRetryMs = 0;
+static uint32_t retryAttempt = 0;
+
+/* Counters of the property values by their outcome. */
+static sitewise_value_stats_t value_stats;
+
+/* Payload limit of the batches, lowered if the endpoint turns a request down as too large */
+static size_t batchPayloadLimit = BATCH_MAX_PAYLOAD_SIZE;
+
+/* Paces the requests of all workers to the ingestion quotas. */
+static SitewiseRateLimiter_t rateLimiter;
+
+/* The response being handled has throttled some of its values. */
+static bool valuesThrottled = false;
+
+typedef enum
+{
+    POST_RESULT_DONE,
+    POST_RESULT_PARTIAL,
+    POST_RESULT_FAILED,
+} post_result_t;
+
+#define SPOOL_BASE_PATH "/spool"
+#define SPOOL_FILE_PATH SPOOL_BASE_PATH "/samples.bin"
+
+/* The payload buffers of all workers are static, with a second one per worker for gzip. They stay within this. */
+#define PAYLOAD_BUFFERS_MAX_SIZE (128 * 1024)
+#if CONFIG_SITEWISE_GZIP
+#define PAYLOAD_BUFFERS_PER_WORKER (2)
+#else
+#define PAYLOAD_BUFFERS_PER_WORKER (1)
+#endif
+_Static_assert(CONFIG_SITEWISE_UPLOAD_WORKERS * PAYLOAD_BUFFERS_PER_WORKER * CONFIG_SITEWISE_PAYLOAD_BUFFER_SIZE <=
+               PAYLOAD_BUFFERS_MAX_SIZE, "The payload buffers of the upload workers take more than 128 KB of RAM");
 
 /**
- * Send a HTTP POST request to the RESTful API: 
- *      https://docs.aws.amazon.com/iot-sitewise/latest/APIReference/API_BatchPutAssetPropertyValue.html
- * 
- * @param[in] entriesArray The entries to be uploaded
- * @param[in] entriesLen The length of the entries
+ * An upload worker owns a connection and everything a request needs, so that several requests can be in flight while
+ * sitewise_upload_task keeps batching. The upload task hands a batch to an idle worker and takes the results back in
+ * the order it handed the batches out, so the spool sees the same order as with a single connection.
+ */
+typedef struct
+{
+    TaskHandle_t task;
+    SitewiseConnection_t connection;                /* The HTTP client with its connection kept alive */
+    aws_sig_v4_context_t sigv4_context;             /* Keeps the derived signing key across requests */
+    uint32_t credentials_generation;                /* The credentials whose session token the client sends */
+
+    char http_payload[CONFIG_SITEWISE_PAYLOAD_BUFFER_SIZE];     /* Payload buffer of the HTTP request */
+    char recv_buffer[2048];                         /* Receiving buffer for the response of the HTTP request */
+#if CONFIG_SITEWISE_GZIP
+    char gzip_payload[CONFIG_SITEWISE_PAYLOAD_BUFFER_SIZE];     /* The payload compressed with gzip */
+    GzipState_t gzip_state;
+#endif
+
+    /* The job, owned by the upload task unless the worker is busy with it */
+    SitewiseBatch_t batch;
+    bool busy;
+    bool replay;                                    /* The batch has been read from the spool */
+    uint32_t spoolStart;                            /* Position of its first sample in the spool, see spoolConsumed */
+    uint32_t spoolCount;                            /* Number of spool samples of the batch */
+    uint32_t oversizedCount;                        /* Spool samples among them too large for any batch */
+    bool kept;                                      /* An older batch has failed, so its samples are in the spool */
+
+    /* The result, written by the worker */
+    esp_err_t err;
+    int statusCode;
+    atomic_bool done;
+
+#if CONFIG_SITEWISE_STATIC_MEMORY
+    StackType_t task_stack[WORKER_TASK_STACK_SIZE];
+    StaticTask_t task_buffer;
+#endif
+} upload_worker_t;
+
+static upload_worker_t workers[CONFIG_SITEWISE_UPLOAD_WORKERS];
+
+/* The workers with a batch in flight, oldest first. */
+static upload_worker_t *inFlight[CONFIG_SITEWISE_UPLOAD_WORKERS];
+static size_t inFlightHead = 0;
+static size_t inFlightLen = 0;
+
+/* Spool samples read by the replays in flight. The next replay reads the spool behind them. */
+static uint32_t inFlightSpoolCount = 0;
+
+/* Kept batches in flight. No replays go out until they are back, as their samples are in the spool already. */
+static uint32_t keptInFlight = 0;
+
+/* Samples consumed from the spool so far, which makes it the position of the oldest sample. */
+static uint32_t spoolConsumed = 0;
+
+/**
+ * Samples of the spool, by their position, that have been stored by a kept batch. A replay reads over them without
+ * sending them again, and they are consumed along with it. Every worker in flight may add one, so the replays go out
+ * one at a time while there are many.
+ */
+typedef struct
+{
+    uint32_t start;
+    uint32_t count;
+} spool_span_t;
+
+#define SENT_SPANS_MAX (2 * CONFIG_SITEWISE_UPLOAD_WORKERS)
+static spool_span_t sentSpans[SENT_SPANS_MAX];
+static size_t sentSpansLen = 0;
+
+#if CONFIG_SITEWISE_GZIP
+/* The endpoint has turned down a compressed body, so the workers go on without compression. */
+static atomic_bool gzipRejected = false;
+#endif
+
+#if CONFIG_SITEWISE_CREDENTIALS_ENDPOINT
+static aws_credentials_endpoint_t credentialsEndpoint = {
+    .url = CONFIG_SITEWISE_CREDENTIALS_ENDPOINT_URL,
+    .authorization = CONFIG_SITEWISE_CREDENTIALS_ENDPOINT_AUTHORIZATION,
+};
+static const aws_credentials_provider_t credentialsProvider = {
+    .fetch = aws_credentials_fetch_endpoint,
+    .user_data = &credentialsEndpoint,
+};
+#else
+static aws_static_credentials_t staticCredentials = {
+    .access_key = CONFIG_AWS_ACCESS_KEY,
+    .secret_key = CONFIG_AWS_SECRET_KEY,
+};
+static const aws_credentials_provider_t credentialsProvider = {
+    .fetch = aws_credentials_fetch_static,
+    .user_data = &staticCredentials,
+};
+#endif
+
+/**
+ * The credentials the workers sign with. The upload task rotates them ahead of their expiration and derives the
+ * signing key of the day along with them, so no request waits for either. The workers only hold the lock while they
+ * sign.
+ */
+static SemaphoreHandle_t credentialsLock;
+static StaticSemaphore_t credentialsLockBuffer;
+static aws_credentials_t credentials;
+static uint32_t credentialsGeneration = 0;              /* 0 until the first credentials have been fetched */
+static char signingKey[AWS_SIG_V4_SIGNING_KEY_LENGTH];
+static char signingKeyDate[16];                         /* The date stamp that signingKey has been derived for */
+
+/* The state of a fetch, which hands fetchedCredentials over from the credentials task to the upload task */
+typedef enum
+{
+    CREDENTIALS_FETCH_IDLE,     /* The upload task may start a fetch */
+    CREDENTIALS_FETCH_PENDING,  /* fetchedCredentials belongs to the credentials task */
+    CREDENTIALS_FETCH_DONE,     /* fetchedCredentials and credentialsFetchErr belong to the upload task */
+} credentials_fetch_state_t;
+
+static _Atomic credentials_fetch_state_t credentialsFetchState = CREDENTIALS_FETCH_IDLE;
+static aws_credentials_t fetchedCredentials;
+static esp_err_t credentialsFetchErr = ESP_OK;
+static int64_t nextCredentialsFetchMs = 0;              /* Only the upload task touches this. */
+
+#if CONFIG_SITEWISE_CREDENTIALS_ENDPOINT
+/* The endpoint is asked on a task of its own, as a request may take as long as its timeout. */
+static TaskHandle_t credentialsTaskHandle = NULL;
+static TaskHandle_t credentialsRequester = NULL;        /* The task to notify when a fetch is done */
+#if CONFIG_SITEWISE_STATIC_MEMORY
+static StackType_t credentialsTaskStack[CREDENTIALS_TASK_STACK_SIZE];
+static StaticTask_t credentialsTaskBuffer;
+#endif
+#endif
+
+/**
+ * Create a task on the given stack in the static memory mode, or on the heap otherwise.
+ *
+ * @return The handle of the task, NULL if it couldn't be created
+ */
+static TaskHandle_t create_task(TaskFunction_t task_function, const char *name, uint32_t stack_size, void *parameters,
+                                StackType_t *stack, StaticTask_t *task_buffer)
+{
+#if CONFIG_SITEWISE_STATIC_MEMORY
+    return xTaskCreateStatic(task_function, name, stack_size, parameters, 5, stack, task_buffer);
+#else
+    TaskHandle_t handle = NULL;
+    xTaskCreate(task_function, name, stack_size, parameters, 5, &handle);
+    return handle;
+#endif
+}
+
+#if CONFIG_SITEWISE_STATIC_MEMORY
+/**
+ * Allocate the cJSON nodes of the response being parsed by the upload task from the arena. Every other cJSON user,
+ * whichever task it runs on, stays on the heap.
  */
-static void do_http_post(Entry_t *entriesArray, size_t entriesLen)
+static void *response_arena_malloc(size_t size)
+{
+    if (xTaskGetCurrentTaskHandle() == uploadTaskHandle && responseArenaActive) {
+        return SitewiseArena_alloc(&responseArena, size);
+    }
+    return malloc(size);
+}
+
+static void response_arena_free(void *pointer)
+{
+    uint8_t *address = (uint8_t *)pointer;
+
+    /* Memory of the arena is given back all at once when the arena is reset. */
+    if (address < responseArenaBuffer || address >= responseArenaBuffer + sizeof(responseArenaBuffer)) {
+        free(pointer);
+    }
+}
+#endif
+
+/**
+ * Get the microseconds since a time of esp_timer_get_time, for the metrics.
+ */
+static uint32_t elapsed_us(int64_t start_us)
+{
+    return (uint32_t)(esp_timer_get_time() - start_us);
+}
+
+/**
+ * Get the microseconds since the timestamp of a sample, by the wall clock that the timestamp was taken with.
+ */
+static uint32_t sample_age_us(PropertyValue_t *pPropertyValue)
 {
     struct timeval tv;
-    time_t nowtime;
-    struct tm *nowtm = NULL;
-    char amz_date[32];
-    char date_stamp[32];
-    size_t payload_len = 0;
+    int64_t age_us = 0;
+
+    gettimeofday(&tv, NULL);
+    age_us = ((int64_t)tv.tv_sec - pPropertyValue->timeInSeconds) * 1000000 + tv.tv_usec - pPropertyValue->offsetInNanos / 1000;
+
+    /* The clock may have been set back in between. */
+    return (age_us > 0) ? (uint32_t)age_us : 0;
+}
+
+/**
+ * Feed a chunk of the payload into the SigV4 payload hash as soon as the serializer has written it.
+ */
+static void payload_hash_chunk(const char *pChunk, size_t chunkLen, void *pUserData)
+{
+    aws_sig_v4_payload_hash_update((aws_sig_v4_context_t *)pUserData, pChunk, chunkLen);
+}
+
+/* The default endpoint of BatchPutAssetPropertyValue in the configured region. */
+#define SITEWISE_DEFAULT_HOST "data.iotsitewise." CONFIG_AWS_DEFAULT_REGION ".amazonaws.com"
+
+#if CONFIG_SITEWISE_ENDPOINT_USE_TLS
+#define SITEWISE_TRANSPORT_TYPE HTTP_TRANSPORT_OVER_SSL
+#define SITEWISE_TRANSPORT_DEFAULT_PORT (443)
+#else
+#define SITEWISE_TRANSPORT_TYPE HTTP_TRANSPORT_OVER_TCP
+#define SITEWISE_TRANSPORT_DEFAULT_PORT (80)
+#endif
+
+/* The value of the Host header, which is also part of the signature. */
+static char sitewise_host_header[128];
 
+/* The parts of the signature that are the same for every request, shared by the workers */
+static aws_sig_v4_template_t sigv4Template;
+
+static const char *sitewise_host(void)
+{
+    return (strlen(CONFIG_SITEWISE_ENDPOINT_HOST) > 0) ? CONFIG_SITEWISE_ENDPOINT_HOST : SITEWISE_DEFAULT_HOST;
+}
+
+static esp_err_t http_event_handler(esp_http_client_event_t *evt)
+{
+    upload_worker_t *worker = (upload_worker_t *)evt->user_data;
+
+    switch (evt->event_id) {
+        case HTTP_EVENT_ON_CONNECTED:
+            SitewiseConnection_onConnected(&worker->connection);
+            ESP_LOGI(TAG, "Connected to %s", sitewise_host_header);
+            break;
+        case HTTP_EVENT_DISCONNECTED:
+            ESP_LOGI(TAG, "Disconnected from %s", sitewise_host_header);
+            break;
+        default:
+            break;
+    }
+    return ESP_OK;
+}
+
+/**
+ * Compose the Host header and the signing template, which hold everything of a request to be signed but the date, the
+ * credentials and the payload.
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_SIZE if the requests don't fit into the template
+ */
+static esp_err_t init_request_template(void)
+{
+    /* The HTTP client only appends the port to the Host header when it isn't the default one. */
+    if (CONFIG_SITEWISE_ENDPOINT_PORT == SITEWISE_TRANSPORT_DEFAULT_PORT) {
+        snprintf(sitewise_host_header, sizeof(sitewise_host_header), "%s", sitewise_host());
+    } else {
+        snprintf(sitewise_host_header, sizeof(sitewise_host_header), "%s:%d", sitewise_host(), CONFIG_SITEWISE_ENDPOINT_PORT);
+    }
+
+    aws_sig_v4_config_t sigv4_config = {
+        .service_name = "iotsitewise",
+        .region_name = CONFIG_AWS_DEFAULT_REGION,
+        .host = sitewise_host_header,
+        .method = "POST",
+        .path = "/properties",
+        .query = "",
+        .signed_headers = "content-type",
+        .canonical_headers = "content-type:application/json\n",
+    };
+    if (aws_sig_v4_template_init(&sigv4Template, &sigv4_config) != 0) {
+        ESP_LOGE(TAG, "The requests to %s don't fit into the signing template", sitewise_host_header);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+/**
+ * Create a HTTP client of a worker that keeps its connection alive across requests.
+ */
+static esp_http_client_handle_t create_http_client(upload_worker_t *worker)
+{
     // https://docs.aws.amazon.com/iot-sitewise/latest/APIReference/API_BatchPutAssetPropertyValue.html
     esp_http_client_config_t config = {
-        .host = "data.iotsitewise." CONFIG_AWS_DEFAULT_REGION ".amazonaws.com",
+        .host = sitewise_host(),
+        .port = CONFIG_SITEWISE_ENDPOINT_PORT,
         .path = "/properties",
         .query = "",
         .method = HTTP_METHOD_POST,
         .timeout_ms = 10000,
         .disable_auto_redirect = true,
-        .transport_type = HTTP_TRANSPORT_OVER_SSL,
+        .transport_type = SITEWISE_TRANSPORT_TYPE,
+        .keep_alive_enable = true,
+        .event_handler = http_event_handler,
+        .user_data = worker,
     };
+
     esp_http_client_handle_t client = esp_http_client_init(&config);
     esp_http_client_set_header(client, "Content-Type", "application/json");
+    return client;
+}
+
+#if CONFIG_SITEWISE_GZIP
+/**
+ * Tell whether the endpoint has turned a request down for its compression rather than for its content: HTTP 415, or
+ * HTTP 400 with an error that names the Content-Encoding. Any other 400 is about the batch itself.
+ */
+static bool is_encoding_rejected(upload_worker_t *worker, int statusCode)
+{
+    return statusCode == 415 || (statusCode == 400 && strstr(worker->recv_buffer, "Content-Encoding") != NULL);
+}
+
+/**
+ * Compress the payload of a worker, unless that doesn't make it smaller.
+ *
+ * @return true if gzip_payload holds the body to be sent
+ */
+static bool compress_payload(upload_worker_t *worker, size_t payload_len, size_t *pBodyLen)
+{
+    if (Gzip_compress(&worker->gzip_state, (const uint8_t *)worker->http_payload, payload_len,
+                      (uint8_t *)worker->gzip_payload, sizeof(worker->gzip_payload), pBodyLen) != GZIP_ERROR_NONE ||
+        *pBodyLen >= payload_len) {
+        return false;
+    }
+    return true;
+}
+#endif
+
+/**
+ * Send a HTTP POST request to the RESTful API: 
+ *      https://docs.aws.amazon.com/iot-sitewise/latest/APIReference/API_BatchPutAssetPropertyValue.html
+ * 
+ * @param[in] worker The worker with its long-lived HTTP client
+ * @param[in] entriesArray The entries to be uploaded
+ * @param[in] entriesLen The length of the entries
+ * @param[out] pStatusCode The HTTP status code of the response
+ * @return ESP_OK if a response has been received
+ */
+static esp_err_t do_http_post(upload_worker_t *worker, Entry_t *entriesArray, size_t entriesLen, int *pStatusCode)
+{
+    esp_http_client_handle_t client = worker->connection.client;
+    aws_sig_v4_context_t *sigv4_context = &worker->sigv4_context;
+    sitewise_connection_stats_t *connection_stats = &worker->connection.stats;
+    struct timeval tv;
+    time_t nowtime;
+    struct tm nowtm;
+    char amz_date[32];
+    char date_stamp[32];
+    size_t payload_len = 0;
+    char payload_hash[AWS_SIG_V4_HASH_HEX_LENGTH];
 
     gettimeofday(&tv, NULL);
     nowtime = tv.tv_sec;
-    nowtm = localtime(&nowtime);
+    /* SigV4 dates are in UTC whatever the time zone of the device, and gmtime_r is safe across the workers. */
+    gmtime_r(&nowtime, &nowtm);
 
-    strftime(amz_date, sizeof amz_date, "%Y%m%dT%H%M%SZ", nowtm);
-    strftime(date_stamp, sizeof date_stamp, "%Y%m%d", nowtm);
+    strftime(amz_date, sizeof amz_date, "%Y%m%dT%H%M%SZ", &nowtm);
+    strftime(date_stamp, sizeof date_stamp, "%Y%m%d", &nowtm);
 
-    aws_sig_v4_context_t sigv4_context;
-    aws_sig_v4_config_t sigv4_config = {
-        .service_name = "iotsitewise",
-        .region_name = CONFIG_AWS_DEFAULT_REGION,
-        .access_key = CONFIG_AWS_ACCESS_KEY,
-        .secret_key = CONFIG_AWS_SECRET_KEY,
-        .host = "data.iotsitewise." CONFIG_AWS_DEFAULT_REGION ".amazonaws.com",
-        .method = "POST",
-        .path = "/properties",
-        .query = "",
-        .signed_headers = "content-type",
-        .canonical_headers = "content-type:application/json\n",
-    };
+    aws_sig_v4_config_t sigv4_config = { 0 };
 
-    Sitewise_printEntriesAsJson(http_payload, sizeof(http_payload), entriesArray, entriesLen);
-    payload_len = strlen(http_payload);
+#if CONFIG_SITEWISE_GZIP
+    bool gzip = !atomic_load(&gzipRejected);
+#else
+    bool gzip = false;
+#endif
+    const char *body = worker->http_payload;
+    size_t body_len = 0;
+
+    /* Hash the payload while it is being serialized, so the signer doesn't need another pass over it. A compressed
+     * body is hashed once it has been compressed. */
+    int64_t serialize_start_us = esp_timer_get_time();
+    aws_sig_v4_payload_hash_start(sigv4_context);
+    int result = Sitewise_printEntriesAsJsonStreaming(worker->http_payload, sizeof(worker->http_payload), entriesArray, entriesLen,
+                                                      gzip ? NULL : payload_hash_chunk, sigv4_context, &payload_len);
+    body_len = payload_len;
+#if CONFIG_SITEWISE_GZIP
+    if (gzip && result == SITEWISE_ERROR_NONE) {
+        if (compress_payload(worker, payload_len, &body_len)) {
+            body = worker->gzip_payload;
+        } else {
+            body_len = payload_len;
+        }
+        aws_sig_v4_payload_hash_update(sigv4_context, body, body_len);
+    }
+#endif
+    aws_sig_v4_payload_hash_finish(sigv4_context, payload_hash);
+    SitewiseMetrics_record(SITEWISE_HISTOGRAM_SERIALIZE, elapsed_us(serialize_start_us));
+    if (result != SITEWISE_ERROR_NONE)
+    {
+        ESP_LOGE(TAG, "Payload doesn't fit into %d bytes", (int)sizeof(worker->http_payload));
+        return ESP_ERR_INVALID_SIZE;
+    }
     // printf("%s\r\n", http_payload);
 
-    sigv4_config.payload = http_payload;
-    sigv4_config.payload_len = payload_len;
+    if (body != worker->http_payload) {
+        esp_http_client_set_header(client, "Content-Encoding", "gzip");
+    } else {
+        esp_http_client_delete_header(client, "Content-Encoding");
+    }
+    connection_stats->payload_bytes += payload_len;
+    connection_stats->body_bytes += body_len;
+    SitewiseMetrics_record(SITEWISE_HISTOGRAM_REQUEST_BYTES, body_len);
+
     sigv4_config.amz_date = amz_date;
     sigv4_config.date_stamp = date_stamp;
-    char *auth_header = aws_sig_v4_signing_header(&sigv4_context, &sigv4_config);
+    int64_t sign_start_us = esp_timer_get_time();
+    xSemaphoreTake(credentialsLock, portMAX_DELAY);
+    if (credentialsGeneration == 0 || (credentials.expiration != 0 && tv.tv_sec >= credentials.expiration)) {
+        xSemaphoreGive(credentialsLock);
+        /* The batch is retried like after a failed connection, rather than dropped when it is turned down. */
+        ESP_LOGW(TAG, "No valid credentials, keeping the batch for later");
+        return ESP_ERR_INVALID_STATE;
+    }
+    sigv4_config.access_key = credentials.access_key;
+    sigv4_config.secret_key = credentials.secret_key;
+    sigv4_config.session_token = credentials.session_token;
+    /* Just past midnight the key of the new day is derived here, until the upload task has caught up. */
+    sigv4_config.signing_key = (strcmp(signingKeyDate, date_stamp) == 0) ? signingKey : NULL;
+    char *auth_header = aws_sig_v4_template_signing_header(sigv4_context, &sigv4Template, &sigv4_config, payload_hash);
+    if (worker->credentials_generation != credentialsGeneration) {
+        /* The client keeps its headers across requests, so the token is only set when it changes. */
+        if (strlen(credentials.session_token) > 0) {
+            esp_http_client_set_header(client, "X-Amz-Security-Token", credentials.session_token);
+        } else {
+            esp_http_client_delete_header(client, "X-Amz-Security-Token");
+        }
+        worker->credentials_generation = credentialsGeneration;
+    }
+    xSemaphoreGive(credentialsLock);
+    SitewiseMetrics_record(SITEWISE_HISTOGRAM_SIGN, elapsed_us(sign_start_us));
 
-    esp_http_client_set_post_field(client, http_payload, payload_len);
     esp_http_client_set_header(client, "Authorization", auth_header);
     esp_http_client_set_header(client, "X-Amz-Date", amz_date);
 
-    esp_err_t err = esp_http_client_open(client, strlen(http_payload));
+    esp_err_t err = SitewiseConnection_send(&worker->connection, body, body_len, pStatusCode);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to open HTTP connection: %s", esp_err_to_name(err));
-    } else {
-        int wlen = esp_http_client_write(client, http_payload, strlen(http_payload));
-        if (wlen < 0) {
-            ESP_LOGE(TAG, "Write failed");
+        return err;
+    }
+
+#if CONFIG_SITEWISE_GZIP
+    if (body != worker->http_payload && is_encoding_rejected(worker, *pStatusCode)) {
+        /* The endpoint doesn't take compressed bodies at all. This sends the batch once more, uncompressed. */
+        ESP_LOGW(TAG, "Compressed body rejected with status %d, sending uncompressed from now on", *pStatusCode);
+        atomic_store(&gzipRejected, true);
+        return do_http_post(worker, entriesArray, entriesLen, pStatusCode);
+    }
+#endif
+
+    return ESP_OK;
+}
+
+static int64_t now_ms(void)
+{
+    return esp_timer_get_time() / 1000;
+}
+
+/**
+ * Read the DHT sensor, unless the other source of the sensor has just read it.
+ */
+static dht_reading_t *dht_read_shared(void)
+{
+    int64_t nowMs = now_ms();
+
+    if (nowMs - dhtReading.readMs >= DHT_MIN_READ_INTERVAL_MS)
+    {
+        dhtReading.readMs = nowMs;
+        dhtReading.result = DHT_read(CONFIG_DHT_TYPE, CONFIG_DHT_GPIO, &dhtReading.temperature, &dhtReading.humidity);
+        if (dhtReading.result == DHT11_ERROR_NONE)
+        {
+            ESP_LOGI(TAG, "Collect sample: T:%.1f H:%.1f", dhtReading.temperature, dhtReading.humidity);
         }
-        int content_length = esp_http_client_fetch_headers(client);
-        if (content_length < 0) {
-            ESP_LOGE(TAG, "HTTP client fetch headers failed");
-        } else {
-            int data_read = esp_http_client_read_response(client, recv_buffer, sizeof(recv_buffer));
-            if (data_read >= 0) {
-                int statusCode = esp_http_client_get_status_code(client);
-                uint64_t contentLength = esp_http_client_get_content_length(client);
-                ESP_LOGI(TAG, "HTTP POST Status = %d, content_length = %" PRIu64, statusCode, contentLength);
-                printf("%s\r\n", recv_buffer);
-                // ESP_LOG_BUFFER_HEX(TAG, recv_buffer, strlen(recv_buffer));
-            } else {
-                ESP_LOGE(TAG, "Failed to read response");
-            }
+        else
+        {
+            ESP_LOGE(TAG, "Failed to read from DHT11");
         }
     }
-    esp_http_client_cleanup(client);
+
+    return &dhtReading;
 }
 
-static void dht11_read_task(void *pvParameters)
+static int dht_read_temperature(void *pContext, PropertyValue_t *pPropertyValue)
 {
-    QueueHandle_t queue = (QueueHandle_t)pvParameters;
-    Entry_t dht11Entries[2];
-    Entry_t *pTemperatureEntry = &(dht11Entries[0]);
-    Entry_t *pHumidityEntry = &(dht11Entries[1]);
-    int dataCount = 0;
-    float temperature = 0;
-    float humidity = 0;
-    struct timeval tv;
+    dht_reading_t *pReading = dht_read_shared();
 
-    pTemperatureEntry->assetId = CONFIG_SITEWISE_ASSET_ID;
-    pTemperatureEntry->propertyId = CONFIG_SITEWISE_TEMPERATURE_PROPERTY_ID;
-    pTemperatureEntry->propertyValuesLen = 0;
+    pPropertyValue->type = PROPERTY_VALUE_TYPE_DOUBLE;
+    pPropertyValue->doubleValue = (double)pReading->temperature;
 
-    pHumidityEntry->assetId = CONFIG_SITEWISE_ASSET_ID;
-    pHumidityEntry->propertyId = CONFIG_SITEWISE_HUMIDITY_PROPERTY_ID;
-    pHumidityEntry->propertyValuesLen = 0;
+    return (pReading->result == DHT11_ERROR_NONE) ? SITEWISE_SOURCE_ERROR_NONE : SITEWISE_SOURCE_ERROR_READ;
+}
 
-    while (1)
+static int dht_read_humidity(void *pContext, PropertyValue_t *pPropertyValue)
+{
+    dht_reading_t *pReading = dht_read_shared();
+
+    pPropertyValue->type = PROPERTY_VALUE_TYPE_DOUBLE;
+    pPropertyValue->doubleValue = (double)pReading->humidity;
+
+    return (pReading->result == DHT11_ERROR_NONE) ? SITEWISE_SOURCE_ERROR_NONE : SITEWISE_SOURCE_ERROR_READ;
+}
+
+static void enqueue_sample(size_t sourceIndex, PropertyValue_t *pPropertyValue, void *pUserData)
+{
+    SitewiseRing_t *pRing = (SitewiseRing_t *)pUserData;
+    SitewiseSample_t *pSample = SitewiseRing_reserve(pRing);
+
+    if (pSample == NULL)
     {
-        if (DHT_read(CONFIG_DHT_TYPE, CONFIG_DHT_GPIO, &temperature, &humidity) == DHT11_ERROR_NONE)
-        {
-            gettimeofday(&tv, NULL);
+        SitewiseMetrics_add(SITEWISE_COUNTER_RING_FULL, 1);
+        ESP_LOGE(TAG, "Sample ring is full, dropped %" PRIu32 " samples so far", (uint32_t)pRing->dropped);
+        return;
+    }
 
-            pTemperatureEntry->propertyValues[dataCount].type = PROPERTY_VALUE_TYPE_DOUBLE;
-            pTemperatureEntry->propertyValues[dataCount].doubleValue = (double)temperature;
-            pTemperatureEntry->propertyValues[dataCount].timeInSeconds = (long)(tv.tv_sec);
+    SitewiseSample_encode(pSample, sourceIndex, pPropertyValue);
+    SitewiseRing_commit(pRing);
 
-            pHumidityEntry->propertyValues[dataCount].type = PROPERTY_VALUE_TYPE_DOUBLE;
-            pHumidityEntry->propertyValues[dataCount].doubleValue = (double)humidity;
-            pHumidityEntry->propertyValues[dataCount].timeInSeconds = (long)(tv.tv_sec);
+    xTaskNotifyGive(uploadTaskHandle);
+}
 
-            dataCount++;
-            pTemperatureEntry->propertyValuesLen = dataCount;
-            pHumidityEntry->propertyValuesLen = dataCount;
-            ESP_LOGI(TAG, "Collect %dth sample: T:%.1f H:%.1f", dataCount, temperature, humidity);
+/**
+ * Pass a sampled value through the aggregates of its source on its way into the ring.
+ */
+static void process_sample(size_t sourceIndex, PropertyValue_t *pPropertyValue, void *pUserData)
+{
+    if (SitewiseAggregate_process(sourceIndex, pPropertyValue, now_ms(), enqueue_sample, pUserData))
+    {
+        enqueue_sample(sourceIndex, pPropertyValue, pUserData);
+        SitewiseMetrics_record(SITEWISE_HISTOGRAM_SAMPLE_TO_ENQUEUE, sample_age_us(pPropertyValue));
+    }
+}
 
-            if (dataCount == MAX_SITEWISE_PROPERTY_VALUE_SIZE)
-            {
-                /* Now we collect enough data points. We enqueue the entries.*/
-                if (xQueueSend(queue, dht11Entries, portMAX_DELAY) == pdTRUE)
-                {
-                    ESP_LOGI(TAG, "Enqueued DHT11 data samples");
-                }
-                else
-                {
-                    ESP_LOGE(TAG, "Failed to enqueue DHT11 data samples");
-                }
+static void log_source_stats(void)
+{
+    SitewiseSourceStats_t stats;
 
-                dataCount = 0;
-            }
-        }
-        else
+    for (size_t sourceIndex = 0; sourceIndex < SitewiseSource_getCount(); sourceIndex++)
+    {
+        SitewiseSource_t *pSource = SitewiseSource_get(sourceIndex);
+
+        if (pSource->read != NULL && SitewiseSource_getStats(sourceIndex, &stats) == SITEWISE_SOURCE_ERROR_NONE)
         {
-            ESP_LOGE(TAG, "Failed to read from DHT11");
+            ESP_LOGI(TAG, "Source %s: %" PRIu32 " samples, %" PRIu32 " overruns, %" PRIu32 " suppressed, lateness mean %" PRIu32 " ms max %" PRIu32 " ms",
+                     pSource->propertyId, stats.samples, stats.overruns, stats.suppressed, stats.meanLatenessMs, stats.maxLatenessMs);
         }
-
-        vTaskDelay(CONFIG_MEASUREMENT_INTERVAL_S * 1000 / portTICK_PERIOD_MS);
     }
+}
 
-    vTaskDelete(NULL);
+/**
+ * Log a snapshot of the metrics on one line, and upload it as well if the metrics are published. The sampler is the
+ * only producer of the ring, so it publishes them.
+ */
+static void report_metrics(SitewiseRing_t *pRing)
+{
+    static SitewiseMetricsSnapshot_t snapshot;
+    static char line[SITEWISE_METRICS_FORMAT_SIZE];
+
+    SitewiseMetrics_getSnapshot(&snapshot);
+    SitewiseMetrics_format(line, sizeof(line), &snapshot);
+    ESP_LOGI(TAG, "Metrics: %s", line);
+
+    SitewiseMetrics_publish(&snapshot, enqueue_sample, pRing);
 }
 
-static void sitewise_upload_task(void *pvParameters)
+static void sampler_task(void *pvParameters)
 {
-    QueueHandle_t queue = (QueueHandle_t)pvParameters;
-    Entry_t entriesArray[2];
+    SitewiseRing_t *pRing = (SitewiseRing_t *)pvParameters;
+    int64_t nextStatsMs = now_ms() + SAMPLER_STATS_INTERVAL_MS;
+    int64_t nextMetricsMs = now_ms() + CONFIG_SITEWISE_METRICS_INTERVAL_S * 1000;
 
     while (1)
     {
-        if (xQueueReceive(queue, &entriesArray, portMAX_DELAY) == pdTRUE)
+        int64_t nextDueMs = SitewiseSource_poll(now_ms(), process_sample, pRing);
+        uint32_t windowMs = SitewiseAggregate_poll(now_ms(), enqueue_sample, pRing);
+        int64_t nowMs = now_ms();
+
+        if (nowMs >= nextStatsMs)
+        {
+            log_source_stats();
+            nextStatsMs += SAMPLER_STATS_INTERVAL_MS;
+        }
+        if (nowMs >= nextMetricsMs)
         {
-            ESP_LOGI(TAG, "Dequeued DHT11 data samples, and sending them to sitewise");
-            do_http_post(entriesArray, 2);
+            report_metrics(pRing);
+            nextMetricsMs += CONFIG_SITEWISE_METRICS_INTERVAL_S * 1000;
         }
+
+        /* Sleep until the deadline rather than for a period, so the time spent sampling doesn't add up. */
+        uint32_t waitMs = (nextDueMs > nowMs) ? (uint32_t)(nextDueMs - nowMs) : 0;
+        waitMs = (windowMs < waitMs) ? windowMs : waitMs;
+        uint32_t metricsWaitMs = (nextMetricsMs > nowMs) ? (uint32_t)(nextMetricsMs - nowMs) : 0;
+        waitMs = (metricsWaitMs < waitMs) ? metricsWaitMs : waitMs;
+
+        vTaskDelay((waitMs + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS);
     }
+
     vTaskDelete(NULL);
 }
 
-void sitewise_uploader_start(void)
+static size_t find_source_index(Entry_t *pEntry)
+{
+    size_t sourceIndex = 0;
+
+    /* The entries point to the IDs of their source. */
+    for (sourceIndex = 0; sourceIndex < SitewiseSource_getCount(); sourceIndex++) {
+        SitewiseSource_t *pSource = SitewiseSource_get(sourceIndex);
+        if (pSource->assetId == pEntry->assetId && pSource->propertyId == pEntry->propertyId &&
+            pSource->propertyAlias == pEntry->propertyAlias) {
+            break;
+        }
+    }
+
+    return sourceIndex;
+}
+
+static int spool_value(Entry_t *pEntry, PropertyValue_t *pPropertyValue)
+{
+    SitewiseSample_t sample;
+
+    SitewiseSample_encode(&sample, find_source_index(pEntry), pPropertyValue);
+    return SitewiseSpool_push(&spool, &sample);
+}
+
+/**
+ * Put the values of a batch that couldn't be uploaded into the spool.
+ *
+ * @return The number of values that went into the spool, the others have been dropped for lack of room
+ */
+static uint32_t spool_batch(SitewiseBatch_t *pBatch)
 {
-    /* Create a queue with capacity of 10 elements. Each element has size of 2 Entry_t */
-    entriesQueue = xQueueCreate(10, sizeof(Entry_t) * 2);
+    uint32_t count = 0;
+
+    for (size_t entriesIndex = 0; entriesIndex < pBatch->entriesLen; entriesIndex++) {
+        Entry_t *pEntry = &(pBatch->entries[entriesIndex]);
+
+        for (size_t valuesIndex = 0; valuesIndex < pEntry->propertyValuesLen; valuesIndex++) {
+            count += (spool_value(pEntry, &(pEntry->propertyValues[valuesIndex])) == SITEWISE_SPOOL_ERROR_NONE) ? 1 : 0;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * Remove samples from the head of the spool once they have been uploaded or dropped.
+ */
+static void consume_spool(uint32_t count)
+{
+    size_t spansLen = 0;
+
+    SitewiseSpool_consume(&spool, count, now_ms());
+    spoolConsumed += count;
+
+    /* The positions wrap around, so they are compared by their distance. */
+    for (size_t i = 0; i < sentSpansLen; i++) {
+        if ((int32_t)(sentSpans[i].start + sentSpans[i].count - spoolConsumed) > 0) {
+            sentSpans[spansLen++] = sentSpans[i];
+        }
+    }
+    sentSpansLen = spansLen;
+}
+
+/**
+ * Remember the samples of a kept batch that has been stored, so that they are consumed in order without being sent
+ * again.
+ */
+static void mark_sent(uint32_t start, uint32_t count)
+{
+    if (count == 0) {
+        return;
+    }
+    if (sentSpansLen == SENT_SPANS_MAX) {
+        /* Can't happen as the replays are held back, but sending them twice is still better than losing them. */
+        ESP_LOGW(TAG, "Too many stored batches in the backlog, %" PRIu32 " values will be sent again", count);
+        return;
+    }
+    sentSpans[sentSpansLen].start = start;
+    sentSpans[sentSpansLen].count = count;
+    sentSpansLen++;
+}
+
+static bool is_sent(uint32_t position)
+{
+    for (size_t i = 0; i < sentSpansLen; i++) {
+        if (position - sentSpans[i].start < sentSpans[i].count) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Handle a property value listed in errorEntries: retry it later or drop it for good.
+ */
+static void handle_failed_value(size_t entryIndex, size_t propertyValueIndex, const char *errorCode, void *pUserData)
+{
+    upload_worker_t *worker = (upload_worker_t *)pUserData;
+    Entry_t *pEntry = &(worker->batch.entries[entryIndex]);
+
+    if (Sitewise_isRetryableError(errorCode)) {
+        spool_value(pEntry, &(pEntry->propertyValues[propertyValueIndex]));
+        value_stats.retried++;
+        valuesThrottled = valuesThrottled || (strcmp(errorCode, "ThrottlingException") == 0);
+    } else {
+        ESP_LOGW(TAG, "Dropping a value of property %s at %ld.%09ld: %s",
+                 (pEntry->propertyAlias != NULL) ? pEntry->propertyAlias : pEntry->propertyId,
+                 pEntry->propertyValues[propertyValueIndex].timeInSeconds, pEntry->propertyValues[propertyValueIndex].offsetInNanos,
+                 errorCode);
+        value_stats.dropped++;
+    }
+    value_stats.accepted--;
+}
+
+/**
+ * Back off exponentially from the retry interval, with jitter so that devices don't retry in lockstep.
+ */
+static void schedule_retry(void)
+{
+    uint32_t backoffMs = CONFIG_SITEWISE_SPOOL_RETRY_INTERVAL_S * 1000;
+
+    for (uint32_t i = 0; i < retryAttempt && backoffMs < CONFIG_SITEWISE_SPOOL_RETRY_MAX_INTERVAL_S * 1000; i++) {
+        backoffMs *= 2;
+    }
+    if (backoffMs > CONFIG_SITEWISE_SPOOL_RETRY_MAX_INTERVAL_S * 1000) {
+        backoffMs = CONFIG_SITEWISE_SPOOL_RETRY_MAX_INTERVAL_S * 1000;
+    }
+
+    /* Half of the backoff is fixed, the other half is random. */
+    backoffMs = backoffMs / 2 + esp_random() % (backoffMs / 2 + 1);
+
+    nextRetryMs = now_ms() + backoffMs;
+    retryAttempt++;
+    ESP_LOGI(TAG, "Retrying the backlog in %" PRIu32 " ms", backoffMs);
+}
+
+/**
+ * Take the result of a posted batch. The values that the service failed to store are put into the spool if they are
+ * worth retrying.
+ *
+ * @return POST_RESULT_DONE if every value has been accepted or dropped for good, POST_RESULT_PARTIAL if some values
+ *         went into the spool to be retried, POST_RESULT_FAILED if the whole batch should be retried
+ */
+static post_result_t finish_post(upload_worker_t *worker)
+{
+    SitewiseBatch_t *pBatch = &(worker->batch);
+    uint32_t retried = value_stats.retried;
+
+    if (worker->err == ESP_ERR_INVALID_SIZE) {
+        SitewiseMetrics_add(SITEWISE_COUNTER_OVERSIZED, 1);
+        ESP_LOGE(TAG, "Dropping a batch that doesn't fit into the payload buffer");
+        value_stats.dropped += pBatch->valuesLen;
+        return POST_RESULT_DONE;
+    }
+    if (worker->err == ESP_OK && worker->statusCode == 413 && pBatch->valuesLen > 1) {
+        /* The endpoint takes less than configured. The values go into the spool, from where they are sent again in
+         * smaller batches. */
+        batchPayloadLimit = pBatch->payloadLen / 2;
+        batchPayloadLimit = (batchPayloadLimit > BATCH_MIN_PAYLOAD_SIZE) ? batchPayloadLimit : BATCH_MIN_PAYLOAD_SIZE;
+        batch.maxPayloadSize = batchPayloadLimit;
+        ESP_LOGW(TAG, "A batch of %d bytes is too large for the endpoint, splitting the batches at %d bytes",
+                 (int)pBatch->payloadLen, (int)batchPayloadLimit);
+        return POST_RESULT_FAILED;
+    }
+    if (worker->err == ESP_OK && (worker->statusCode == 429 || worker->statusCode == 503)) {
+        SitewiseMetrics_add(SITEWISE_COUNTER_THROTTLED, 1);
+        SitewiseRateLimiter_update(&rateLimiter, true);
+        ESP_LOGW(TAG, "Throttled with status %d, %" PRIu32 " times so far", worker->statusCode, rateLimiter.throttled);
+    }
+    if (worker->err == ESP_OK && worker->statusCode >= 500 && worker->statusCode != 503) {
+        SitewiseMetrics_add(SITEWISE_COUNTER_SERVER_ERROR, 1);
+    }
+    if (worker->err != ESP_OK || worker->statusCode == 429 || worker->statusCode >= 500) {
+        return POST_RESULT_FAILED;
+    }
+    if (worker->statusCode >= 300) {
+        SitewiseMetrics_add(SITEWISE_COUNTER_REJECTED, 1);
+        ESP_LOGE(TAG, "Dropping a batch rejected with status %d", worker->statusCode);
+        value_stats.dropped += pBatch->valuesLen;
+        return POST_RESULT_DONE;
+    }
+
+    /* Accepted, except for the values listed in errorEntries. */
+    value_stats.accepted += pBatch->valuesLen;
+    valuesThrottled = false;
+#if CONFIG_SITEWISE_STATIC_MEMORY
+    uint32_t arenaFailures = responseArena.failures;
+    responseArenaActive = true;
+#endif
+    int parsed = Sitewise_parseErrorEntries(worker->recv_buffer, strlen(worker->recv_buffer), pBatch->entries,
+                                            pBatch->entriesLen, handle_failed_value, worker);
+#if CONFIG_SITEWISE_STATIC_MEMORY
+    /* Nothing of the parsed response outlives the batch. */
+    responseArenaActive = false;
+    SitewiseArena_reset(&responseArena);
+    if (responseArena.failures != arenaFailures) {
+        /* The parse stops before any errorEntries are handled, so which values failed is unknown. */
+        SitewiseMetrics_add(SITEWISE_COUNTER_ARENA_FULL, 1);
+        ESP_LOGE(TAG, "Response doesn't fit into the arena of %d bytes, keeping the batch", (int)responseArena.size);
+        value_stats.accepted -= pBatch->valuesLen;
+        return POST_RESULT_FAILED;
+    }
+#endif
+    if (parsed != SITEWISE_ERROR_NONE) {
+        ESP_LOGW(TAG, "Failed to parse the response, assuming all values have been accepted");
+    }
+    SitewiseRateLimiter_update(&rateLimiter, valuesThrottled);
+    ESP_LOGI(TAG, "Values accepted: %" PRIu32 ", retried: %" PRIu32 ", dropped: %" PRIu32,
+             value_stats.accepted, value_stats.retried, value_stats.dropped);
+
+    return (value_stats.retried != retried) ? POST_RESULT_PARTIAL : POST_RESULT_DONE;
+}
+
+/**
+ * Drop values that are too large for a batch of their own, which no request can take.
+ */
+static void drop_oversized_values(uint32_t count)
+{
+    ESP_LOGE(TAG, "Dropping %" PRIu32 " values that don't fit into a payload of %d bytes", count, (int)batchPayloadLimit);
+    SitewiseMetrics_add(SITEWISE_COUNTER_OVERSIZED, count);
+    value_stats.dropped += count;
+}
+
+static void log_spool_stats(void)
+{
+    SitewiseSpoolStats_t stats;
+
+    SitewiseSpool_getStats(&spool, now_ms(), &stats);
+    ESP_LOGI(TAG, "Backlog: %" PRIu32 " samples in RAM, %" PRIu32 " in flash, %" PRIu32 " dropped, %" PRIu32 " strings not spilled, draining %" PRIu32 " samples/s",
+             stats.ramDepth, stats.fileDepth, stats.dropped, stats.droppedStrings, stats.drainRate);
+}
+
+static void upload_worker_task(void *pvParameters)
+{
+    upload_worker_t *worker = (upload_worker_t *)pvParameters;
+
+    aws_sig_v4_init(&worker->sigv4_context);
+    SitewiseConnection_init(&worker->connection, create_http_client(worker), worker->recv_buffer, sizeof(worker->recv_buffer));
+
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        ESP_LOGI(TAG, "Sending %d values in %d entries (%d bytes) to sitewise",
+                 (int)worker->batch.valuesLen, (int)worker->batch.entriesLen, (int)worker->batch.payloadLen);
+        worker->err = do_http_post(worker, worker->batch.entries, worker->batch.entriesLen, &worker->statusCode);
+        ESP_LOGI(TAG, "Requests: %" PRIu32 ", handshakes: %" PRIu32 ", reused: %" PRIu32 ", bytes: %" PRIu32 " of %" PRIu32 " sent",
+                 worker->connection.stats.requests, worker->connection.stats.handshakes, worker->connection.stats.reused_requests,
+                 worker->connection.stats.body_bytes, worker->connection.stats.payload_bytes);
+
+        atomic_store(&worker->done, true);
+        xTaskNotifyGive(uploadTaskHandle);
+    }
+
+    esp_http_client_cleanup(worker->connection.client);
+    aws_sig_v4_free(&worker->sigv4_context);
+    vTaskDelete(NULL);
+}
+
+static upload_worker_t *find_idle_worker(void)
+{
+    for (size_t i = 0; i < CONFIG_SITEWISE_UPLOAD_WORKERS; i++) {
+        if (!workers[i].busy) {
+            return &workers[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Hand the batch of a worker over to it.
+ */
+static void dispatch(upload_worker_t *worker, bool replay, uint32_t spoolCount)
+{
+    SitewiseRateLimiter_consume(&rateLimiter, worker->batch.entriesLen, now_ms());
+
+    worker->busy = true;
+    worker->replay = replay;
+    worker->kept = false;
+    worker->spoolStart = spoolConsumed + inFlightSpoolCount;
+    worker->spoolCount = spoolCount;
+    atomic_store(&worker->done, false);
+
+    inFlight[(inFlightHead + inFlightLen) % CONFIG_SITEWISE_UPLOAD_WORKERS] = worker;
+    inFlightLen++;
+    inFlightSpoolCount += replay ? spoolCount : 0;
+
+    xTaskNotifyGive(worker->task);
+}
+
+/**
+ * Take the result of a batch of new samples, or move it to the spool if the upload failed.
+ */
+static post_result_t complete_upload(upload_worker_t *worker)
+{
+    post_result_t result = finish_post(worker);
+
+    if (result == POST_RESULT_FAILED)
+    {
+        spool_batch(&worker->batch);
+    }
+    if (result != POST_RESULT_DONE)
+    {
+        schedule_retry();
+        log_spool_stats();
+    }
+
+    return result;
+}
+
+/**
+ * Take the result of a batch read from the spool, and consume it from the spool unless it has to be tried again.
+ */
+static post_result_t complete_replay(upload_worker_t *worker)
+{
+    post_result_t result = POST_RESULT_DONE;
+
+    inFlightSpoolCount -= worker->spoolCount;
+    if (worker->batch.valuesLen > 0)
+    {
+        result = finish_post(worker);
+    }
+
+    /* Retried values have already been appended to the spool, so the batch can go either way. */
+    if (result != POST_RESULT_FAILED)
+    {
+        if (worker->oversizedCount > 0)
+        {
+            drop_oversized_values(worker->oversizedCount);
+        }
+        consume_spool(worker->spoolCount);
+    }
+    if (result == POST_RESULT_DONE)
+    {
+        retryAttempt = 0;
+    }
+    else
+    {
+        schedule_retry();
+    }
+    log_spool_stats();
+
+    return result;
+}
+
+/**
+ * Take the result of a kept batch, whose samples are in the spool behind those of an older batch that has failed. If
+ * it has been stored all the same, its samples are consumed in order later, without being sent and counted twice.
+ */
+static void complete_kept(upload_worker_t *worker)
+{
+    post_result_t result = POST_RESULT_FAILED;
+
+    keptInFlight--;
+    inFlightSpoolCount -= worker->replay ? worker->spoolCount : 0;
+    if (worker->batch.valuesLen > 0)
+    {
+        result = finish_post(worker);
+    }
+    if (result != POST_RESULT_FAILED)
+    {
+        if (worker->replay && worker->oversizedCount > 0)
+        {
+            drop_oversized_values(worker->oversizedCount);
+        }
+        mark_sent(worker->spoolStart, worker->spoolCount);
+    }
+}
+
+/**
+ * Keep the batches in flight once there is a backlog, as they are newer than the samples in the spool. The values of a
+ * batch of new samples go into the spool right away, before any sample that comes after them.
+ *
+ * @param[in] replays Keep the replays as well, which is only needed after a failure
+ */
+static void keep_in_flight_batches(bool replays)
+{
+    for (size_t i = 0; i < inFlightLen; i++)
+    {
+        upload_worker_t *worker = inFlight[(inFlightHead + i) % CONFIG_SITEWISE_UPLOAD_WORKERS];
+
+        if (worker->kept || (worker->replay && !replays))
+        {
+            continue;
+        }
+        if (!worker->replay)
+        {
+            /* The worker only writes the entry IDs of its batch, so the values can be read while it is in flight. */
+            worker->spoolStart = spoolConsumed + SitewiseSpool_getDepth(&spool);
+            worker->spoolCount = spool_batch(&worker->batch);
+        }
+        worker->kept = true;
+        keptInFlight++;
+    }
+}
+
+/**
+ * Take the results of the workers that are done, in the order the batches were handed out.
+ */
+static void complete_uploads(SitewiseBatch_t *pBatch)
+{
+    while (inFlightLen > 0 && atomic_load(&inFlight[inFlightHead]->done))
+    {
+        upload_worker_t *worker = inFlight[inFlightHead];
+        post_result_t result = POST_RESULT_DONE;
+
+        inFlightHead = (inFlightHead + 1) % CONFIG_SITEWISE_UPLOAD_WORKERS;
+        inFlightLen--;
+
+        if (worker->kept)
+        {
+            complete_kept(worker);
+        }
+        else if (worker->replay)
+        {
+            result = complete_replay(worker);
+        }
+        else
+        {
+            result = complete_upload(worker);
+        }
+        SitewiseBatch_reset(&worker->batch);
+        worker->busy = false;
+
+        if (SitewiseSpool_getDepth(&spool) > 0)
+        {
+            keep_in_flight_batches(result == POST_RESULT_FAILED);
+        }
+    }
+
+    /* Once there's a backlog, the samples of the batch being filled queue up behind it to keep them in order. */
+    if (SitewiseSpool_getDepth(&spool) > 0 && pBatch->valuesLen > 0)
+    {
+        spool_batch(pBatch);
+        SitewiseBatch_reset(pBatch);
+    }
+}
+
+/**
+ * Hand the batch of new samples to a worker, waiting for one to be idle and for the rate limiter if needed.
+ */
+static void upload_batch(SitewiseBatch_t *pBatch)
+{
+    upload_worker_t *worker = NULL;
+    uint32_t delayMs = 0;
+
+    while ((worker = find_idle_worker()) == NULL ||
+           (delayMs = SitewiseRateLimiter_getDelay(&rateLimiter, pBatch->entriesLen, now_ms())) > 0)
+    {
+        ulTaskNotifyTake(pdTRUE, (worker == NULL) ? portMAX_DELAY : (delayMs + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS);
+        complete_uploads(pBatch);
+    }
+
+    /* A failed upload may have moved the batch into the spool meanwhile. */
+    if (pBatch->valuesLen > 0)
+    {
+        worker->batch = *pBatch;
+        SitewiseBatch_reset(pBatch);
+        dispatch(worker, false, 0);
+    }
+}
+
+/**
+ * Hand a full batch of the oldest samples in the spool that aren't in flight yet to an idle worker.
+ *
+ * @param[out] pDelayMs How long the rate limiter holds the batch back, 0 if it doesn't
+ * @return true if a batch has been handed out
+ */
+static bool replay_spool(uint32_t *pDelayMs)
+{
+    upload_worker_t *worker = find_idle_worker();
+    SitewiseSample_t sample;
+    PropertyValue_t propertyValue;
+    uint32_t count = 0;
+    uint32_t oversized = 0;
+    int result = SITEWISE_BATCH_ERROR_NONE;
+
+    if (worker == NULL)
+    {
+        return false;
+    }
+    if (sentSpansLen + inFlightLen > SENT_SPANS_MAX)
+    {
+        /* Every replay in flight may leave a stored batch behind. A worker coming back notifies the task. */
+        *pDelayMs = UINT32_MAX;
+        return false;
+    }
+
+    worker->batch.maxPayloadSize = batchPayloadLimit;
+    while (worker->batch.valuesLen < worker->batch.maxValues &&
+           SitewiseSpool_read(&spool, inFlightSpoolCount + count, &sample) == SITEWISE_SPOOL_ERROR_NONE)
+    {
+        SitewiseSource_t *pSource = SitewiseSource_get(sample.sourceIndex);
+
+        /* A sample of a source that no longer exists, one whose value has been dropped, one that has been stored by a
+         * kept batch, or one too large to be sent, is consumed along with the batch. */
+        if (pSource != NULL && sample.type != SITEWISE_SAMPLE_TYPE_DROPPED &&
+            !is_sent(spoolConsumed + inFlightSpoolCount + count))
+        {
+            SitewiseSample_decode(&sample, &propertyValue);
+            result = SitewiseBatch_add(&worker->batch, pSource->assetId, pSource->propertyId, pSource->propertyAlias,
+                                       &propertyValue, now_ms());
+            if (result == SITEWISE_BATCH_ERROR_FULL)
+            {
+                break;
+            }
+            oversized += (result == SITEWISE_BATCH_ERROR_TOO_LARGE) ? 1 : 0;
+        }
+        count++;
+    }
+
+    if (count == 0)
+    {
+        return false;
+    }
+    if (worker->batch.valuesLen == 0)
+    {
+        /* Only samples that can't be sent, which can go once nothing before them is in flight. */
+        if (inFlightSpoolCount > 0)
+        {
+            /* A worker coming back notifies the task. */
+            *pDelayMs = UINT32_MAX;
+            return false;
+        }
+        if (oversized > 0)
+        {
+            drop_oversized_values(oversized);
+        }
+        consume_spool(count);
+        return true;
+    }
+    if ((*pDelayMs = SitewiseRateLimiter_getDelay(&rateLimiter, worker->batch.entriesLen, now_ms())) > 0)
+    {
+        SitewiseBatch_reset(&worker->batch);
+        return false;
+    }
+
+    worker->oversizedCount = oversized;
+    dispatch(worker, true, count);
+    return true;
+}
+
+/**
+ * Log how much memory is left at the lowest, to size the heap, the stacks and the arena for a long uptime.
+ */
+static void log_memory_stats(void)
+{
+    ESP_LOGI(TAG, "Heap: %" PRIu32 " bytes free, %" PRIu32 " at the lowest, largest block %d bytes",
+             esp_get_free_heap_size(), esp_get_minimum_free_heap_size(), (int)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+    ESP_LOGI(TAG, "Stack left at the lowest: upload task %d bytes, sampler %d bytes",
+             (int)uxTaskGetStackHighWaterMark(uploadTaskHandle), (int)uxTaskGetStackHighWaterMark(samplerTaskHandle));
+    for (size_t i = 0; i < CONFIG_SITEWISE_UPLOAD_WORKERS; i++)
+    {
+        ESP_LOGI(TAG, "Stack left at the lowest: worker %d %d bytes", (int)i, (int)uxTaskGetStackHighWaterMark(workers[i].task));
+    }
+#if CONFIG_SITEWISE_CREDENTIALS_ENDPOINT
+    ESP_LOGI(TAG, "Stack left at the lowest: credentials task %d bytes", (int)uxTaskGetStackHighWaterMark(credentialsTaskHandle));
+#endif
+#if CONFIG_SITEWISE_STATIC_MEMORY
+    ESP_LOGI(TAG, "Response arena: %d of %d bytes at the peak, %" PRIu32 " allocations didn't fit",
+             (int)responseArena.highWater, (int)responseArena.size, responseArena.failures);
+#endif
+}
+
+#if CONFIG_SITEWISE_CREDENTIALS_ENDPOINT
+/**
+ * Fetch the credentials whenever the upload task asks for them, and hand them back to it.
+ */
+static void credentials_task(void *pvParameters)
+{
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (atomic_load(&credentialsFetchState) != CREDENTIALS_FETCH_PENDING)
+        {
+            continue;
+        }
+
+        credentialsFetchErr = credentialsProvider.fetch(credentialsProvider.user_data, &fetchedCredentials);
+        atomic_store(&credentialsFetchState, CREDENTIALS_FETCH_DONE);
+        xTaskNotifyGive(credentialsRequester);
+    }
+    vTaskDelete(NULL);
+}
+#endif
+
+/**
+ * Start a fetch of the credentials. The endpoint is asked by the credentials task, credentials built into the firmware
+ * are there right away.
+ */
+static void start_credentials_fetch(void)
+{
+#if CONFIG_SITEWISE_CREDENTIALS_ENDPOINT
+    credentialsRequester = xTaskGetCurrentTaskHandle();
+    atomic_store(&credentialsFetchState, CREDENTIALS_FETCH_PENDING);
+    xTaskNotifyGive(credentialsTaskHandle);
+#else
+    atomic_store(&credentialsFetchState, CREDENTIALS_FETCH_PENDING);
+    credentialsFetchErr = credentialsProvider.fetch(credentialsProvider.user_data, &fetchedCredentials);
+    atomic_store(&credentialsFetchState, CREDENTIALS_FETCH_DONE);
+#endif
+}
+
+/**
+ * Wipe the fetched credentials and let the next fetch start.
+ */
+static void finish_credentials_fetch(void)
+{
+    memset(&fetchedCredentials, 0, sizeof(fetchedCredentials));
+    atomic_store(&credentialsFetchState, CREDENTIALS_FETCH_IDLE);
+}
+
+/**
+ * Start a fetch of new credentials once the current ones are about to expire, take them over when the fetch is done,
+ * and derive the signing key whenever the credentials or the date change. Never waits for the fetch. A failed fetch
+ * is tried again a little later, while the current credentials are still used.
+ */
+static void refresh_credentials(void)
+{
+    time_t now = time(NULL);
+    struct tm nowTm;
+    char dateStamp[sizeof(signingKeyDate)];
+    char key[AWS_SIG_V4_SIGNING_KEY_LENGTH];
+    bool rotate = (credentialsGeneration == 0);
+    const aws_credentials_t *pCredentials = &credentials;
+
+#if CONFIG_SITEWISE_CREDENTIALS_ENDPOINT
+    rotate = rotate || (credentials.expiration != 0 &&
+                        now >= credentials.expiration - CONFIG_SITEWISE_CREDENTIALS_REFRESH_MARGIN_S);
+#endif
+    if (rotate && atomic_load(&credentialsFetchState) == CREDENTIALS_FETCH_IDLE && now_ms() >= nextCredentialsFetchMs)
+    {
+        /* Also keeps an endpoint that hands out credentials close to their expiration from being asked in a loop. */
+        nextCredentialsFetchMs = now_ms() + CREDENTIALS_RETRY_INTERVAL_MS;
+        start_credentials_fetch();
+    }
+
+    if (atomic_load(&credentialsFetchState) == CREDENTIALS_FETCH_DONE)
+    {
+        if (credentialsFetchErr == ESP_OK)
+        {
+            pCredentials = &fetchedCredentials;
+            if (fetchedCredentials.expiration != 0)
+            {
+                ESP_LOGI(TAG, "Rotated the credentials, they expire in %lld s", (long long)(fetchedCredentials.expiration - now));
+            }
+        }
+        else
+        {
+            ESP_LOGE(TAG, "Failed to fetch the credentials, trying again in %d s", CREDENTIALS_RETRY_INTERVAL_MS / 1000);
+            nextCredentialsFetchMs = now_ms() + CREDENTIALS_RETRY_INTERVAL_MS;
+            finish_credentials_fetch();
+        }
+    }
+
+    /* The upload task is the only writer, so it reads the credentials without the lock. */
+    gmtime_r(&now, &nowTm);
+    strftime(dateStamp, sizeof(dateStamp), "%Y%m%d", &nowTm);
+    if (credentialsGeneration == 0 && pCredentials == &credentials)
+    {
+        return;
+    }
+    if (pCredentials == &credentials && strcmp(dateStamp, signingKeyDate) == 0)
+    {
+        return;
+    }
+
+    aws_sig_v4_config_t sigv4_config = {
+        .service_name = "iotsitewise",
+        .region_name = CONFIG_AWS_DEFAULT_REGION,
+        .secret_key = pCredentials->secret_key,
+        .date_stamp = dateStamp,
+    };
+    if (aws_sig_v4_derive_signing_key(&sigv4_config, key) != 0)
+    {
+        ESP_LOGE(TAG, "The secret key is too long to sign with");
+        if (pCredentials != &credentials)
+        {
+            finish_credentials_fetch();
+        }
+        return;
+    }
+
+    xSemaphoreTake(credentialsLock, portMAX_DELAY);
+    if (pCredentials != &credentials)
+    {
+        memcpy(&credentials, pCredentials, sizeof(credentials));
+        credentialsGeneration++;
+    }
+    memcpy(signingKey, key, sizeof(signingKey));
+    memcpy(signingKeyDate, dateStamp, sizeof(signingKeyDate));
+    xSemaphoreGive(credentialsLock);
+
+    memset(key, 0, sizeof(key));
+    if (pCredentials != &credentials)
+    {
+        finish_credentials_fetch();
+    }
+}
+
+static void log_upload_stats(void)
+{
+    static int64_t lastLogMs = 0;
+    static uint32_t lastAccepted = 0;
+    int64_t nowMs = now_ms();
+
+    if (nowMs - lastLogMs >= UPLOAD_STATS_INTERVAL_MS)
+    {
+        if (lastLogMs != 0)
+        {
+            ESP_LOGI(TAG, "Uploaded %" PRIu32 " values/s with %d of %d workers busy",
+                     (uint32_t)((value_stats.accepted - lastAccepted) * 1000LL / (nowMs - lastLogMs)),
+                     (int)inFlightLen, CONFIG_SITEWISE_UPLOAD_WORKERS);
+            log_memory_stats();
+        }
+        lastLogMs = nowMs;
+        lastAccepted = value_stats.accepted;
+    }
+}
+
+static void sitewise_upload_task(void *pvParameters)
+{
+    SitewiseRing_t *pRing = (SitewiseRing_t *)pvParameters;
+    SitewiseSample_t *pSample = NULL;
+    PropertyValue_t propertyValue;
+    TickType_t wait = portMAX_DELAY;
+    uint32_t replayDelayMs = 0;
+
+    /* Nothing can be signed without credentials, so the first fetch is waited for, whatever its outcome. Later ones
+     * run while the task goes on. */
+    refresh_credentials();
+    while (atomic_load(&credentialsFetchState) == CREDENTIALS_FETCH_PENDING)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    refresh_credentials();
+
+    /* Nodes that power up together, e.g. after an outage, spread their first requests. */
+    SitewiseRateLimiter_init(&rateLimiter, CONFIG_SITEWISE_RATE_LIMIT_REQUESTS_PER_S, CONFIG_SITEWISE_RATE_LIMIT_ENTRIES_PER_S,
+                             now_ms() + esp_random() % (CONFIG_SITEWISE_STARTUP_JITTER_MS + 1));
+    SitewiseBatch_init(&batch, CONFIG_SITEWISE_BATCH_MAX_VALUES, batchPayloadLimit,
+                       CONFIG_SITEWISE_BATCH_MAX_AGE_S * 1000);
+#if CONFIG_SITEWISE_SPOOL_FLASH
+    if (SitewiseSpool_init(&spool, spoolSlots, CONFIG_SITEWISE_SPOOL_RAM_SIZE, SPOOL_FILE_PATH, CONFIG_SITEWISE_SPOOL_FLASH_MAX_SAMPLES) != SITEWISE_SPOOL_ERROR_NONE)
+    {
+        ESP_LOGE(TAG, "Failed to open %s, the backlog is kept in RAM only", SPOOL_FILE_PATH);
+    }
+#else
+    SitewiseSpool_init(&spool, spoolSlots, CONFIG_SITEWISE_SPOOL_RAM_SIZE, NULL, 0);
+#endif
+    if (SitewiseSpool_getDepth(&spool) > 0)
+    {
+        log_spool_stats();
+    }
+
+    for (size_t i = 0; i < CONFIG_SITEWISE_UPLOAD_WORKERS; i++)
+    {
+        SitewiseBatch_init(&workers[i].batch, CONFIG_SITEWISE_BATCH_MAX_VALUES, batchPayloadLimit,
+                           CONFIG_SITEWISE_BATCH_MAX_AGE_S * 1000);
+        workers[i].task = create_task(upload_worker_task, "sitewise_upload_worker", WORKER_TASK_STACK_SIZE, &workers[i],
+                                      TASK_MEMORY(workers[i].task_stack, &workers[i].task_buffer));
+    }
+
+    while (1)
+    {
+        complete_uploads(&batch);
+
+        /* Move the samples from the ring into the batch, reading them in place. */
+        while ((pSample = SitewiseRing_peek(pRing)) != NULL)
+        {
+            SitewiseSource_t *pSource = SitewiseSource_get(pSample->sourceIndex);
+
+            /* Only a batch needs the full property value. */
+            SitewiseSample_decode(pSample, &propertyValue);
+            SitewiseMetrics_record(SITEWISE_HISTOGRAM_QUEUE_WAIT, sample_age_us(&propertyValue));
+            if (SitewiseSpool_getDepth(&spool) > 0)
+            {
+                /* There's a backlog, so new samples queue up behind it to keep them in order. */
+                SitewiseSpool_push(&spool, pSample);
+            }
+            else
+            {
+                int result = SitewiseBatch_add(&batch, pSource->assetId, pSource->propertyId, pSource->propertyAlias,
+                                               &propertyValue, now_ms());
+
+                if (result == SITEWISE_BATCH_ERROR_FULL)
+                {
+                    upload_batch(&batch);
+                    if (SitewiseSpool_getDepth(&spool) > 0)
+                    {
+                        SitewiseSpool_push(&spool, pSample);
+                    }
+                    else
+                    {
+                        result = SitewiseBatch_add(&batch, pSource->assetId, pSource->propertyId, pSource->propertyAlias,
+                                                   &propertyValue, now_ms());
+                    }
+                }
+                if (result == SITEWISE_BATCH_ERROR_TOO_LARGE)
+                {
+                    drop_oversized_values(1);
+                }
+            }
+            SitewiseRing_release(pRing);
+
+            if (SitewiseBatch_isReady(&batch, now_ms()))
+            {
+                upload_batch(&batch);
+            }
+        }
+
+        if (SitewiseBatch_isReady(&batch, now_ms()))
+        {
+            upload_batch(&batch);
+        }
+
+        /* The live batch is always empty while there's a backlog. Keep every idle worker busy with it. */
+        replayDelayMs = 0;
+        if (SitewiseSpool_getDepth(&spool) > 0 && keptInFlight == 0 && now_ms() >= nextRetryMs)
+        {
+            while (replay_spool(&replayDelayMs))
+            {
+            }
+        }
+
+        refresh_credentials();
+        log_upload_stats();
+
+        /* Wait for samples and workers, but no longer than the deadline of the batch or the next replay. */
+        int64_t waitMs = SitewiseBatch_getTimeToDeadline(&batch, now_ms());
+        if (SitewiseSpool_getDepth(&spool) > inFlightSpoolCount && keptInFlight == 0)
+        {
+            int64_t retryMs = (nextRetryMs > now_ms()) ? (nextRetryMs - now_ms()) : replayDelayMs;
+            waitMs = (waitMs < 0 || retryMs < waitMs) ? retryMs : waitMs;
+        }
+        if (find_idle_worker() == NULL)
+        {
+            /* A worker coming back notifies the task. */
+            waitMs = -1;
+        }
+        wait = (waitMs < 0) ? portMAX_DELAY : (TickType_t)((waitMs + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS);
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+    vTaskDelete(NULL);
+}
+
+void sitewise_uploader_get_connection_stats(sitewise_connection_stats_t *pStats)
+{
+    memset(pStats, 0, sizeof(*pStats));
+    for (size_t i = 0; i < CONFIG_SITEWISE_UPLOAD_WORKERS; i++) {
+        pStats->requests += workers[i].connection.stats.requests;
+        pStats->handshakes += workers[i].connection.stats.handshakes;
+        pStats->reused_requests += workers[i].connection.stats.reused_requests;
+        pStats->reconnects += workers[i].connection.stats.reconnects;
+        pStats->payload_bytes += workers[i].connection.stats.payload_bytes;
+        pStats->body_bytes += workers[i].connection.stats.body_bytes;
+    }
+}
+
+void sitewise_uploader_get_value_stats(sitewise_value_stats_t *pStats)
+{
+    *pStats = value_stats;
+}
+
+esp_err_t sitewise_uploader_start(void)
+{
+    /* Without a template every request would be signed wrong, so nothing is started. */
+    esp_err_t templateErr = init_request_template();
+    if (templateErr != ESP_OK)
+    {
+        return templateErr;
+    }
+
+    SitewiseRing_init(&sampleRing, sampleSlots, CONFIG_SITEWISE_SAMPLE_RING_SIZE);
+    credentialsLock = xSemaphoreCreateMutexStatic(&credentialsLockBuffer);
+
+#if CONFIG_SITEWISE_SPOOL_FLASH
+    esp_vfs_spiffs_conf_t spiffs_conf = {
+        .base_path = SPOOL_BASE_PATH,
+        .partition_label = "spool",
+        .max_files = 2,
+        .format_if_mount_failed = true,
+    };
+    esp_err_t err = esp_vfs_spiffs_register(&spiffs_conf);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to mount the spool partition: %s", esp_err_to_name(err));
+    }
+#endif
+
+    /* The sensors of this node. More sources can be registered before the uploader is started. */
+    int temperatureSource = SitewiseSource_register(CONFIG_SITEWISE_ASSET_ID, CONFIG_SITEWISE_TEMPERATURE_PROPERTY_ID,
+                                                    MEASUREMENT_INTERVAL_MS, dht_read_temperature, NULL);
+    int humiditySource = SitewiseSource_register(CONFIG_SITEWISE_ASSET_ID, CONFIG_SITEWISE_HUMIDITY_PROPERTY_ID,
+                                                 MEASUREMENT_INTERVAL_MS, dht_read_humidity, NULL);
+
+#if CONFIG_SITEWISE_DEADBAND
+    SitewiseSource_setDeadband(temperatureSource, CONFIG_SITEWISE_DEADBAND_ABSOLUTE_X10 / 10.0,
+                               CONFIG_SITEWISE_DEADBAND_PERCENT, CONFIG_SITEWISE_DEADBAND_HEARTBEAT_S * 1000);
+    SitewiseSource_setDeadband(humiditySource, CONFIG_SITEWISE_DEADBAND_ABSOLUTE_X10 / 10.0,
+                               CONFIG_SITEWISE_DEADBAND_PERCENT, CONFIG_SITEWISE_DEADBAND_HEARTBEAT_S * 1000);
+#endif
+
+#if CONFIG_SITEWISE_AGGREGATE
+    char *temperatureAggregates[SITEWISE_AGGREGATE_KIND_SIZE] = {
+        [SITEWISE_AGGREGATE_MIN] = CONFIG_SITEWISE_TEMPERATURE_MIN_PROPERTY_ID,
+        [SITEWISE_AGGREGATE_MAX] = CONFIG_SITEWISE_TEMPERATURE_MAX_PROPERTY_ID,
+        [SITEWISE_AGGREGATE_MEAN] = CONFIG_SITEWISE_TEMPERATURE_MEAN_PROPERTY_ID,
+        [SITEWISE_AGGREGATE_COUNT] = CONFIG_SITEWISE_TEMPERATURE_COUNT_PROPERTY_ID,
+    };
+    char *humidityAggregates[SITEWISE_AGGREGATE_KIND_SIZE] = {
+        [SITEWISE_AGGREGATE_MIN] = CONFIG_SITEWISE_HUMIDITY_MIN_PROPERTY_ID,
+        [SITEWISE_AGGREGATE_MAX] = CONFIG_SITEWISE_HUMIDITY_MAX_PROPERTY_ID,
+        [SITEWISE_AGGREGATE_MEAN] = CONFIG_SITEWISE_HUMIDITY_MEAN_PROPERTY_ID,
+        [SITEWISE_AGGREGATE_COUNT] = CONFIG_SITEWISE_HUMIDITY_COUNT_PROPERTY_ID,
+    };
+#if CONFIG_SITEWISE_AGGREGATE_KEEP_RAW
+    bool keepRaw = true;
+#else
+    bool keepRaw = false;
+#endif
+
+    if (SitewiseAggregate_register(temperatureSource, CONFIG_SITEWISE_AGGREGATE_WINDOW_S * 1000, keepRaw,
+                                   CONFIG_SITEWISE_ASSET_ID, temperatureAggregates) != SITEWISE_AGGREGATE_ERROR_NONE ||
+        SitewiseAggregate_register(humiditySource, CONFIG_SITEWISE_AGGREGATE_WINDOW_S * 1000, keepRaw,
+                                   CONFIG_SITEWISE_ASSET_ID, humidityAggregates) != SITEWISE_AGGREGATE_ERROR_NONE)
+    {
+        ESP_LOGE(TAG, "Failed to set up the aggregates");
+    }
+#endif
+
+#if CONFIG_SITEWISE_METRICS_PUBLISH
+    if (SitewiseMetrics_registerProperties(CONFIG_SITEWISE_METRICS_ALIAS_PREFIX) != SITEWISE_METRICS_ERROR_NONE)
+    {
+        ESP_LOGE(TAG, "Failed to set up the metrics properties");
+    }
+#endif
+
+    (void)temperatureSource;
+    (void)humiditySource;
+
+#if CONFIG_SITEWISE_STATIC_MEMORY
+    /* The hooks only turn to the arena while the upload task parses a response, see response_arena_malloc. */
+    cJSON_Hooks hooks = {
+        .malloc_fn = response_arena_malloc,
+        .free_fn = response_arena_free,
+    };
+    SitewiseArena_init(&responseArena, responseArenaBuffer, sizeof(responseArenaBuffer));
+    cJSON_InitHooks(&hooks);
+#endif
 
-    xTaskCreate(dht11_read_task, "sitewise_upload_task", 4096, entriesQueue, 5, NULL);
+#if CONFIG_SITEWISE_CREDENTIALS_ENDPOINT
+    /* Waits for the upload task to ask for credentials. */
+    credentialsTaskHandle = create_task(credentials_task, "sitewise_credentials", CREDENTIALS_TASK_STACK_SIZE, NULL,
+                                        TASK_MEMORY(credentialsTaskStack, &credentialsTaskBuffer));
+#endif
 
-    xTaskCreate(sitewise_upload_task, "sitewise_upload_task", 8192, entriesQueue, 5, NULL);
+    /* The upload task goes first, the sampler notifies it for every sample. */
+    uploadTaskHandle = create_task(sitewise_upload_task, "sitewise_upload_task", UPLOAD_TASK_STACK_SIZE, &sampleRing,
+                                   TASK_MEMORY(uploadTaskStack, &uploadTaskBuffer));
+    samplerTaskHandle = create_task(sampler_task, "sampler_task", SAMPLER_TASK_STACK_SIZE, &sampleRing,
+                                    TASK_MEMORY(samplerTaskStack, &samplerTaskBuffer));
+    return ESP_OK;
 }
@@ -5,7 +5,43 @@
 extern "C" {
 #endif
 
-void sitewise_uploader_start(void);
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#include "sitewise_connection.h"
+
+/**
+ * Counters of the uploaded property values by their outcome.
+ */
+typedef struct
+{
+    uint32_t accepted;          /* Values stored by the service */
+    uint32_t retried;           /* Values the service failed to store and that went back into the backlog */
+    uint32_t dropped;           /* Values the service rejected for good, e.g. out of range timestamps */
+} sitewise_value_stats_t;
+
+/**
+ * Register the sensors and start the sampler, the upload task and the upload workers.
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_SIZE if the requests to the configured endpoint don't fit into the signing
+ *         template, in which case nothing is started
+ */
+esp_err_t sitewise_uploader_start(void);
+
+/**
+ * Get a snapshot of the connection counters.
+ *
+ * @param[out] pStats The counters
+ */
+void sitewise_uploader_get_connection_stats(sitewise_connection_stats_t *pStats);
+
+/**
+ * Get a snapshot of the value counters.
+ *
+ * @param[out] pStats The counters
+ */
+void sitewise_uploader_get_value_stats(sitewise_value_stats_t *pStats);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,47 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "alloc_count.h"
+
+/* The allocator of glibc under its internal names, which the replacements forward to. */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *pointer, size_t size);
+extern void __libc_free(void *pointer);
+
+static AllocCount_t count;
+
+void *malloc(size_t size)
+{
+    count.allocs++;
+    count.bytes += size;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    count.allocs++;
+    count.bytes += n * size;
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *pointer, size_t size)
+{
+    count.allocs++;
+    count.bytes += size;
+    return __libc_realloc(pointer, size);
+}
+
+void free(void *pointer)
+{
+    if (pointer != NULL)
+    {
+        count.frees++;
+    }
+    __libc_free(pointer);
+}
+
+void AllocCount_get(AllocCount_t *pCount)
+{
+    *pCount = count;
+}
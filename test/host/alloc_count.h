@@ -0,0 +1,24 @@
+#ifndef _ALLOC_COUNT_H_
+#define _ALLOC_COUNT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Counts of the heap calls of the whole process, taken by replacing malloc and friends of the C library.
+ */
+typedef struct AllocCount
+{
+    uint64_t allocs;        /* malloc, calloc and realloc */
+    uint64_t frees;
+    uint64_t bytes;         /* Bytes requested by the allocations */
+} AllocCount_t;
+
+/**
+ *  Get the counts since the start of the process.
+ *
+ * @param[out] pCount The counts
+ */
+void AllocCount_get(AllocCount_t *pCount);
+
+#endif /* _ALLOC_COUNT_H_ */
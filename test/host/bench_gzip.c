@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "alloc_count.h"
+#include "gzip.h"
+#include "sitewise.h"
+#include "sitewise_batch.h"
+
+/*
+ * Bytes on the wire and CPU time of compressing the JSON of a batch, at several batch sizes. With zlib on the host, the
+ * output is inflated again to check it, and zlib compresses the same JSON for reference.
+ */
+
+#define BENCH_PAYLOAD_BUFFER_SIZE (32768)
+#define BENCH_PROPERTIES (MAX_SITEWISE_ENTRY_SIZE)
+
+static const size_t batchSizes[] = { 1, 10, 20, 50, 100 };
+
+static char *assetIds[BENCH_PROPERTIES];
+static char *propertyIds[BENCH_PROPERTIES];
+static char payloadBuffer[BENCH_PAYLOAD_BUFFER_SIZE];
+static uint8_t gzipBuffer[BENCH_PAYLOAD_BUFFER_SIZE];
+static GzipState_t gzipState;
+
+/* Keeps the compiler from dropping the work of a loop */
+static volatile size_t sink;
+
+static int64_t nowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Fill a batch like the upload task does, with readings of the DHT that change a little from sample to sample.
+ */
+static void fillBatch(SitewiseBatch_t *pBatch, size_t values)
+{
+    SitewiseBatch_init(pBatch, values, BENCH_PAYLOAD_BUFFER_SIZE - 1, 1000);
+    for (size_t i = 0; i < values; i++)
+    {
+        PropertyValue_t propertyValue = {
+            .type = PROPERTY_VALUE_TYPE_DOUBLE,
+            .timeInSeconds = 1714564800 + (long)(i / BENCH_PROPERTIES) * 2,
+            .offsetInNanos = (long)((i * 7919) % 1000) * 1000000,
+            .doubleValue = (i % 2) ? 40.0 + (i % 7) : 27.0 + (i % 5) * 0.1,
+        };
+        SitewiseBatch_add(pBatch, assetIds[i % BENCH_PROPERTIES], propertyIds[i % BENCH_PROPERTIES], NULL, &propertyValue, 0);
+    }
+}
+
+#if HAVE_ZLIB
+/**
+ * Inflate the gzip output and compare it with the input.
+ */
+static bool checkRoundTrip(const uint8_t *pGzip, size_t gzipLen, const char *pExpected, size_t expectedLen)
+{
+    static uint8_t inflated[BENCH_PAYLOAD_BUFFER_SIZE];
+    z_stream stream = { 0 };
+    bool ok = false;
+
+    /* 16 + MAX_WBITS takes a gzip header and trailer, CRC included */
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK)
+    {
+        return false;
+    }
+    stream.next_in = (Bytef *)pGzip;
+    stream.avail_in = (uInt)gzipLen;
+    stream.next_out = inflated;
+    stream.avail_out = sizeof(inflated);
+    ok = (inflate(&stream, Z_FINISH) == Z_STREAM_END && stream.total_out == expectedLen &&
+          memcmp(inflated, pExpected, expectedLen) == 0);
+    inflateEnd(&stream);
+    return ok;
+}
+
+/**
+ * Compress with zlib into a gzip member, at a level, and return the length of the output.
+ */
+static size_t zlibCompress(const char *pInput, size_t inputLen, int level)
+{
+    static uint8_t output[BENCH_PAYLOAD_BUFFER_SIZE];
+    z_stream stream = { 0 };
+    size_t outputLen = 0;
+
+    deflateInit2(&stream, level, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    stream.next_in = (Bytef *)pInput;
+    stream.avail_in = (uInt)inputLen;
+    stream.next_out = output;
+    stream.avail_out = sizeof(output);
+    deflate(&stream, Z_FINISH);
+    outputLen = stream.total_out;
+    deflateEnd(&stream);
+    return outputLen;
+}
+#endif
+
+static void printResult(const char *name, size_t values, size_t jsonLen, size_t bodyLen, double nsPerOp,
+                        double allocsPerOp)
+{
+    printf("%-8s values=%-4zu json=%-6zu body=%-6zu ratio=%-6.1f ns/op=%-9.0f MB/s=%-7.1f allocs/op=%.1f\n",
+           name, values, jsonLen, bodyLen, (double)jsonLen / bodyLen, nsPerOp, jsonLen * 1000.0 / nsPerOp, allocsPerOp);
+}
+
+int main(int argc, char *argv[])
+{
+    bool quick = (argc > 1 && strcmp(argv[1], "--quick") == 0);
+    uint32_t iterations = quick ? 5 : 2000;
+    uint32_t rounds = quick ? 1 : 5;
+    static SitewiseBatch_t batch;
+    char names[2][BENCH_PROPERTIES][40];
+
+    for (size_t i = 0; i < BENCH_PROPERTIES; i++)
+    {
+        snprintf(names[0][i], sizeof(names[0][i]), "a1b2c3d4-0000-4000-8000-%012zu", i);
+        snprintf(names[1][i], sizeof(names[1][i]), "e5f6a7b8-0000-4000-8000-%012zu", i);
+        assetIds[i] = names[0][i];
+        propertyIds[i] = names[1][i];
+    }
+
+    for (size_t i = 0; i < sizeof(batchSizes) / sizeof(batchSizes[0]); i++)
+    {
+        size_t jsonLen = 0;
+        size_t gzipLen = 0;
+        double bestNs = 0.0;
+        AllocCount_t before;
+        AllocCount_t after;
+
+        fillBatch(&batch, batchSizes[i]);
+        if (Sitewise_printEntriesAsJsonStreaming(payloadBuffer, sizeof(payloadBuffer), batch.entries, batch.entriesLen,
+                                                 NULL, NULL, &jsonLen) != SITEWISE_ERROR_NONE ||
+            Gzip_compress(&gzipState, (const uint8_t *)payloadBuffer, jsonLen, gzipBuffer, sizeof(gzipBuffer),
+                          &gzipLen) != GZIP_ERROR_NONE)
+        {
+            fprintf(stderr, "Batch of %zu values is broken\n", batchSizes[i]);
+            return 1;
+        }
+#if HAVE_ZLIB
+        if (!checkRoundTrip(gzipBuffer, gzipLen, payloadBuffer, jsonLen))
+        {
+            fprintf(stderr, "Batch of %zu values doesn't inflate back\n", batchSizes[i]);
+            return 1;
+        }
+#endif
+
+        AllocCount_get(&before);
+        for (uint32_t round = 0; round < rounds; round++)
+        {
+            int64_t startNs = nowNs();
+            for (uint32_t j = 0; j < iterations; j++)
+            {
+                Gzip_compress(&gzipState, (const uint8_t *)payloadBuffer, jsonLen, gzipBuffer, sizeof(gzipBuffer),
+                              &gzipLen);
+                sink = gzipLen;
+            }
+            double ns = (double)(nowNs() - startNs) / iterations;
+            if (round == 0 || ns < bestNs)
+            {
+                bestNs = ns;
+            }
+        }
+        AllocCount_get(&after);
+        printResult("gzip", batchSizes[i], jsonLen, gzipLen, bestNs,
+                    (double)(after.allocs - before.allocs) / ((double)iterations * rounds));
+
+#if HAVE_ZLIB
+        for (int level = 1; level <= 9; level += 5)
+        {
+            char name[16];
+            size_t zlibLen = 0;
+
+            AllocCount_get(&before);
+            for (uint32_t round = 0; round < rounds; round++)
+            {
+                int64_t startNs = nowNs();
+                for (uint32_t j = 0; j < iterations; j++)
+                {
+                    zlibLen = zlibCompress(payloadBuffer, jsonLen, level);
+                    sink = zlibLen;
+                }
+                double ns = (double)(nowNs() - startNs) / iterations;
+                if (round == 0 || ns < bestNs)
+                {
+                    bestNs = ns;
+                }
+            }
+            AllocCount_get(&after);
+            snprintf(name, sizeof(name), "zlib-%d", level);
+            printResult(name, batchSizes[i], jsonLen, zlibLen, bestNs,
+                        (double)(after.allocs - before.allocs) / ((double)iterations * rounds));
+        }
+#endif
+    }
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+#include "alloc_count.h"
+#include "hex.h"
+
+/*
+ * Hex encoding of a SHA-256 hash and of an entry ID, with the lookup table against sprintf("%02x") per byte as the
+ * signer and the serializer did before.
+ */
+
+typedef void (*Encode_t)(char *pOutput, const uint8_t *pInput, size_t inputLen);
+
+/* Keeps the compiler from dropping the work of a loop */
+static volatile char sink;
+
+static int64_t nowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void encodeSprintf(char *pOutput, const uint8_t *pInput, size_t inputLen)
+{
+    for (size_t i = 0; i < inputLen; i++)
+    {
+        sprintf(&(pOutput[i * 2]), "%02x", pInput[i]);
+    }
+}
+
+static void runBench(const char *name, Encode_t encode, size_t inputLen, uint32_t iterations, uint32_t rounds)
+{
+    uint8_t input[32];
+    char output[2 * sizeof(input) + 1];
+    double bestNs = 0.0;
+    AllocCount_t before;
+    AllocCount_t after;
+
+    for (size_t i = 0; i < sizeof(input); i++)
+    {
+        input[i] = (uint8_t)(i * 151 + 7);
+    }
+
+    AllocCount_get(&before);
+    for (uint32_t round = 0; round < rounds; round++)
+    {
+        int64_t startNs = nowNs();
+        for (uint32_t i = 0; i < iterations; i++)
+        {
+            input[0] = (uint8_t)i;
+            encode(output, input, inputLen);
+            sink = output[0];
+        }
+        double ns = (double)(nowNs() - startNs) / iterations;
+        if (round == 0 || ns < bestNs)
+        {
+            bestNs = ns;
+        }
+    }
+    AllocCount_get(&after);
+
+    printf("%-8s bytes=%-3zu ns/op=%-8.1f ns/byte=%-6.2f allocs/op=%.1f\n", name, inputLen, bestNs, bestNs / inputLen,
+           (double)(after.allocs - before.allocs) / ((double)iterations * rounds));
+}
+
+int main(int argc, char *argv[])
+{
+    bool quick = (argc > 1 && strcmp(argv[1], "--quick") == 0);
+    uint32_t iterations = quick ? 100 : 1000000;
+    uint32_t rounds = quick ? 1 : 5;
+
+    /* A SHA-256 hash, and the 16 random bytes of an entry ID */
+    runBench("table", Hex_encode, 32, iterations, rounds);
+    runBench("sprintf", encodeSprintf, 32, iterations, rounds);
+    runBench("table", Hex_encode, 16, iterations, rounds);
+    runBench("sprintf", encodeSprintf, 16, iterations, rounds);
+
+    return 0;
+}
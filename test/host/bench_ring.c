@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "sitewise_ring.h"
+
+/*
+ * Throughput of the sample ring with a producer and a consumer thread, as between the sampler and the upload task.
+ * The consumer checks that the samples come out in order. Either side yields when it has to wait, as the tasks block
+ * on the target. Every try of a producer that finds the ring full counts as dropped.
+ */
+
+#define BENCH_RING_CAPACITY (128)
+
+static SitewiseSample_t slots[BENCH_RING_CAPACITY];
+static SitewiseRing_t ring;
+static uint32_t samples;
+
+static int64_t nowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void *producer(void *pArgument)
+{
+    uint32_t sequence = 0;
+
+    while (sequence < samples)
+    {
+        SitewiseSample_t *pSample = SitewiseRing_reserve(&ring);
+
+        if (pSample == NULL)
+        {
+            sched_yield();
+            continue;
+        }
+        pSample->sourceIndex = 0;
+        pSample->type = 1;
+        pSample->timeInSeconds = sequence;
+        pSample->offsetInNanos = 0;
+        pSample->value[0] = sequence;
+        pSample->value[1] = 0;
+        SitewiseRing_commit(&ring);
+        sequence++;
+    }
+    return NULL;
+}
+
+static void *consumer(void *pArgument)
+{
+    bool *pInOrder = (bool *)pArgument;
+    uint32_t expected = 0;
+
+    while (expected < samples)
+    {
+        SitewiseSample_t *pSample = SitewiseRing_peek(&ring);
+
+        if (pSample == NULL)
+        {
+            sched_yield();
+            continue;
+        }
+        if (pSample->timeInSeconds != expected || pSample->value[0] != expected)
+        {
+            *pInOrder = false;
+        }
+        SitewiseRing_release(&ring);
+        expected++;
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    bool quick = (argc > 1 && strcmp(argv[1], "--quick") == 0);
+    bool inOrder = true;
+    pthread_t producerThread;
+    pthread_t consumerThread;
+
+    samples = quick ? 100000 : 10000000;
+    SitewiseRing_init(&ring, slots, BENCH_RING_CAPACITY);
+
+    int64_t startNs = nowNs();
+    pthread_create(&consumerThread, NULL, consumer, &inOrder);
+    pthread_create(&producerThread, NULL, producer, NULL);
+    pthread_join(producerThread, NULL);
+    pthread_join(consumerThread, NULL);
+    double seconds = (nowNs() - startNs) / 1e9;
+
+    printf("ring capacity=%d samples=%u Msamples/s=%.1f ns/sample=%.1f dropped=%u\n", BENCH_RING_CAPACITY, samples,
+           samples / seconds / 1e6, seconds * 1e9 / samples, (unsigned)atomic_load(&ring.dropped));
+
+    if (!inOrder)
+    {
+        fprintf(stderr, "Samples came out of order\n");
+        return 1;
+    }
+    return 0;
+}
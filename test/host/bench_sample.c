@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+#include "alloc_count.h"
+#include "sitewise_sample.h"
+
+/*
+ * Memory of the ring and the spool with the fixed-width records against the slots they replaced, a source index next to
+ * a PropertyValue_t, and the cost of packing and expanding a record.
+ */
+
+#define BENCH_SAMPLES (1024)
+
+/* The slot of the ring and the spool before the fixed-width records */
+typedef struct
+{
+    size_t sourceIndex;
+    PropertyValue_t propertyValue;
+} LegacySample_t;
+
+/* The default sizes of the ring, the RAM spool and the spool file */
+static const size_t bufferSamples[] = { 128, 256, 8192 };
+
+static SitewiseSample_t samples[BENCH_SAMPLES];
+static PropertyValue_t propertyValues[BENCH_SAMPLES];
+
+/* Keeps the compiler from dropping the work of a loop */
+static volatile uint32_t sink;
+
+static int64_t nowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+    bool quick = (argc > 1 && strcmp(argv[1], "--quick") == 0);
+    uint32_t rounds = quick ? 2 : 2000;
+    double encodeNs = 0.0;
+    double decodeNs = 0.0;
+    AllocCount_t before;
+    AllocCount_t after;
+
+    printf("record=%zu bytes, legacy slot=%zu bytes on this host (32 on the ESP32)\n", sizeof(SitewiseSample_t),
+           sizeof(LegacySample_t));
+    for (size_t i = 0; i < sizeof(bufferSamples) / sizeof(bufferSamples[0]); i++)
+    {
+        printf("samples=%-5zu records=%-7zu legacy=%-7zu esp32-legacy=%zu\n", bufferSamples[i],
+               bufferSamples[i] * sizeof(SitewiseSample_t), bufferSamples[i] * sizeof(LegacySample_t),
+               bufferSamples[i] * 32);
+    }
+
+    for (size_t i = 0; i < BENCH_SAMPLES; i++)
+    {
+        propertyValues[i].type = (i % 2) ? PROPERTY_VALUE_TYPE_DOUBLE : PROPERTY_VALUE_TYPE_INTEGER;
+        propertyValues[i].timeInSeconds = 1714564800 + (long)i;
+        propertyValues[i].offsetInNanos = (long)i * 1000;
+        if (i % 2)
+        {
+            propertyValues[i].doubleValue = 27.0 + i * 0.1;
+        }
+        else
+        {
+            propertyValues[i].integerValue = (int)i;
+        }
+    }
+
+    AllocCount_get(&before);
+    for (uint32_t round = 0; round < rounds; round++)
+    {
+        int64_t startNs = nowNs();
+        for (size_t i = 0; i < BENCH_SAMPLES; i++)
+        {
+            SitewiseSample_encode(&samples[i], i % 16, &propertyValues[i]);
+        }
+        double ns = (double)(nowNs() - startNs) / BENCH_SAMPLES;
+        encodeNs = (round == 0 || ns < encodeNs) ? ns : encodeNs;
+        sink = samples[round % BENCH_SAMPLES].value[0];
+
+        startNs = nowNs();
+        for (size_t i = 0; i < BENCH_SAMPLES; i++)
+        {
+            SitewiseSample_decode(&samples[i], &propertyValues[i]);
+        }
+        ns = (double)(nowNs() - startNs) / BENCH_SAMPLES;
+        decodeNs = (round == 0 || ns < decodeNs) ? ns : decodeNs;
+        sink = (uint32_t)propertyValues[round % BENCH_SAMPLES].timeInSeconds;
+    }
+    AllocCount_get(&after);
+
+    printf("encode ns/op=%.1f decode ns/op=%.1f allocs=%llu\n", encodeNs, decodeNs,
+           (unsigned long long)(after.allocs - before.allocs));
+
+    return 0;
+}
@@ -0,0 +1,292 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cJSON.h"
+
+#include "alloc_count.h"
+#include "aws_sig_v4_signing.h"
+#include "sitewise.h"
+#include "sitewise_batch.h"
+
+/*
+ * Throughput and heap calls of the three steps of the upload path that run for every request:
+ *
+ *   payload   serializing a batch into JSON, next to building the same document with cJSON as the firmware used to
+ *   sign      signing a request whose payload hash is known, deriving the signing key, taking it from the cache of the
+ *             context, or taking the one derived ahead
+ *   prepare   adding the values to a batch, serializing it while hashing it, and signing the request
+ */
+
+#define BENCH_PAYLOAD_BUFFER_SIZE (32768)
+#define BENCH_PROPERTIES (MAX_SITEWISE_ENTRY_SIZE)
+
+static const size_t batchSizes[] = { 1, 10, 50, 100 };
+
+static char *assetIds[BENCH_PROPERTIES];
+static char *propertyIds[BENCH_PROPERTIES];
+static char payloadBuffer[BENCH_PAYLOAD_BUFFER_SIZE];
+
+static aws_sig_v4_context_t sigv4Context;
+static aws_sig_v4_template_t sigv4Template;
+static char signingKey[AWS_SIG_V4_SIGNING_KEY_LENGTH];
+static aws_sig_v4_config_t sigv4Config = {
+    .service_name = "iotsitewise",
+    .region_name = "us-east-1",
+    .secret_key = "wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY",
+    .access_key = "AKIDEXAMPLE",
+    .session_token = "",
+    .host = "data.iotsitewise.us-east-1.amazonaws.com",
+    .method = "POST",
+    .path = "/properties",
+    .query = "",
+    .amz_date = "20240501T120000Z",
+    .date_stamp = "20240501",
+    .signed_headers = "content-type",
+    .canonical_headers = "content-type:application/json\n",
+};
+
+/* Keeps the compiler from dropping the work of a loop */
+static volatile size_t sink;
+
+typedef struct BenchResult
+{
+    double nsPerOp;
+    double allocsPerOp;
+    double bytesPerOp;
+} BenchResult_t;
+
+typedef void (*BenchFunction_t)(void *pContext);
+
+static int64_t nowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Run a function repeatedly and take the best of a few rounds, which is the least disturbed by the rest of the host.
+ */
+static BenchResult_t runBench(BenchFunction_t function, void *pContext, uint32_t iterations, uint32_t rounds)
+{
+    BenchResult_t result = { 0 };
+    AllocCount_t before;
+    AllocCount_t after;
+
+    function(pContext);
+
+    for (uint32_t round = 0; round < rounds; round++)
+    {
+        AllocCount_get(&before);
+        int64_t startNs = nowNs();
+        for (uint32_t i = 0; i < iterations; i++)
+        {
+            function(pContext);
+        }
+        double nsPerOp = (double)(nowNs() - startNs) / iterations;
+        AllocCount_get(&after);
+
+        if (round == 0 || nsPerOp < result.nsPerOp)
+        {
+            result.nsPerOp = nsPerOp;
+        }
+        result.allocsPerOp = (double)(after.allocs - before.allocs) / iterations;
+        result.bytesPerOp = (double)(after.bytes - before.bytes) / iterations;
+    }
+
+    return result;
+}
+
+static void printResult(const char *name, size_t values, size_t payloadLen, BenchResult_t *pResult)
+{
+    double mbPerS = (payloadLen > 0) ? (payloadLen * 1000.0 / pResult->nsPerOp) : 0.0;
+
+    printf("%-16s values=%-4zu bytes=%-6zu ns/op=%-10.0f MB/s=%-8.1f allocs/op=%-8.1f heap-bytes/op=%.0f\n",
+           name, values, payloadLen, pResult->nsPerOp, mbPerS, pResult->allocsPerOp, pResult->bytesPerOp);
+}
+
+/**
+ * Fill a batch like the upload task does, cycling through the properties.
+ */
+static void fillBatch(SitewiseBatch_t *pBatch, size_t values)
+{
+    SitewiseBatch_init(pBatch, values, BENCH_PAYLOAD_BUFFER_SIZE - 1, 1000);
+    for (size_t i = 0; i < values; i++)
+    {
+        PropertyValue_t propertyValue = {
+            .type = (i % 2) ? PROPERTY_VALUE_TYPE_DOUBLE : PROPERTY_VALUE_TYPE_INTEGER,
+            .timeInSeconds = 1714564800 + (long)(i / BENCH_PROPERTIES),
+            .offsetInNanos = (long)(i * 1000),
+        };
+        if (propertyValue.type == PROPERTY_VALUE_TYPE_DOUBLE)
+        {
+            propertyValue.doubleValue = 21.5 + i * 0.01;
+        }
+        else
+        {
+            propertyValue.integerValue = (int)i;
+        }
+        SitewiseBatch_add(pBatch, assetIds[i % BENCH_PROPERTIES], propertyIds[i % BENCH_PROPERTIES], NULL, &propertyValue, 0);
+    }
+}
+
+static void benchPayload(void *pContext)
+{
+    SitewiseBatch_t *pBatch = (SitewiseBatch_t *)pContext;
+    size_t payloadLen = 0;
+
+    Sitewise_printEntriesAsJsonStreaming(payloadBuffer, sizeof(payloadBuffer), pBatch->entries, pBatch->entriesLen,
+                                         NULL, NULL, &payloadLen);
+    sink = payloadLen;
+}
+
+/**
+ * The serializer of the firmware before the streaming one: build a cJSON tree of the batch and print it.
+ */
+static void benchPayloadCJson(void *pContext)
+{
+    SitewiseBatch_t *pBatch = (SitewiseBatch_t *)pContext;
+    cJSON *root = cJSON_CreateObject();
+    cJSON *entries = cJSON_AddArrayToObject(root, "entries");
+
+    for (size_t entriesIndex = 0; entriesIndex < pBatch->entriesLen; entriesIndex++)
+    {
+        Entry_t *pEntry = &(pBatch->entries[entriesIndex]);
+        cJSON *entry = cJSON_CreateObject();
+
+        cJSON_AddItemToArray(entries, entry);
+        cJSON_AddStringToObject(entry, "entryId", pEntry->entryId);
+        cJSON_AddStringToObject(entry, "assetId", pEntry->assetId);
+        cJSON_AddStringToObject(entry, "propertyId", pEntry->propertyId);
+        cJSON *propertyValues = cJSON_AddArrayToObject(entry, "propertyValues");
+
+        for (size_t propertyValuesIndex = 0; propertyValuesIndex < pEntry->propertyValuesLen; propertyValuesIndex++)
+        {
+            PropertyValue_t *pPropertyValue = &(pEntry->propertyValues[propertyValuesIndex]);
+            cJSON *propertyValue = cJSON_CreateObject();
+
+            cJSON_AddItemToArray(propertyValues, propertyValue);
+            cJSON *value = cJSON_AddObjectToObject(propertyValue, "value");
+            if (pPropertyValue->type == PROPERTY_VALUE_TYPE_DOUBLE)
+            {
+                cJSON_AddNumberToObject(value, "doubleValue", pPropertyValue->doubleValue);
+            }
+            else
+            {
+                cJSON_AddNumberToObject(value, "integerValue", pPropertyValue->integerValue);
+            }
+            cJSON *timestamp = cJSON_AddObjectToObject(propertyValue, "timestamp");
+            cJSON_AddNumberToObject(timestamp, "timeInSeconds", pPropertyValue->timeInSeconds);
+            cJSON_AddNumberToObject(timestamp, "offsetInNanos", pPropertyValue->offsetInNanos);
+            cJSON_AddStringToObject(propertyValue, "quality", "GOOD");
+        }
+    }
+
+    cJSON_PrintPreallocated(root, payloadBuffer, sizeof(payloadBuffer), 0);
+    cJSON_Delete(root);
+    sink = payloadBuffer[0];
+}
+
+static void benchSign(void *pContext)
+{
+    char *auth = aws_sig_v4_template_signing_header(&sigv4Context, &sigv4Template, &sigv4Config, (const char *)pContext);
+    sink = (size_t)auth[0];
+}
+
+static void benchSignDerive(void *pContext)
+{
+    /* Forget the cached key, as if the date or the credentials had just changed */
+    sigv4Context.signing_key_valid = 0;
+    benchSign(pContext);
+}
+
+static void payloadHashChunk(const char *pChunk, size_t chunkLen, void *pUserData)
+{
+    aws_sig_v4_payload_hash_update((aws_sig_v4_context_t *)pUserData, pChunk, chunkLen);
+}
+
+static void benchPrepare(void *pContext)
+{
+    static SitewiseBatch_t batch;
+    size_t values = *(size_t *)pContext;
+    size_t payloadLen = 0;
+    char payloadHash[AWS_SIG_V4_HASH_HEX_LENGTH];
+
+    fillBatch(&batch, values);
+    aws_sig_v4_payload_hash_start(&sigv4Context);
+    Sitewise_printEntriesAsJsonStreaming(payloadBuffer, sizeof(payloadBuffer), batch.entries, batch.entriesLen,
+                                         payloadHashChunk, &sigv4Context, &payloadLen);
+    aws_sig_v4_payload_hash_finish(&sigv4Context, payloadHash);
+    char *auth = aws_sig_v4_template_signing_header(&sigv4Context, &sigv4Template, &sigv4Config, payloadHash);
+    sink = payloadLen + (size_t)auth[0];
+}
+
+int main(int argc, char *argv[])
+{
+    bool quick = (argc > 1 && strcmp(argv[1], "--quick") == 0);
+    uint32_t iterations = quick ? 10 : 20000;
+    uint32_t rounds = quick ? 1 : 5;
+    static SitewiseBatch_t batch;
+    char names[2][BENCH_PROPERTIES][40];
+    size_t payloadLen = 0;
+
+    for (size_t i = 0; i < BENCH_PROPERTIES; i++)
+    {
+        snprintf(names[0][i], sizeof(names[0][i]), "a1b2c3d4-0000-4000-8000-%012zu", i);
+        snprintf(names[1][i], sizeof(names[1][i]), "e5f6a7b8-0000-4000-8000-%012zu", i);
+        assetIds[i] = names[0][i];
+        propertyIds[i] = names[1][i];
+    }
+
+    aws_sig_v4_init(&sigv4Context);
+    if (aws_sig_v4_template_init(&sigv4Template, &sigv4Config) != 0 ||
+        aws_sig_v4_derive_signing_key(&sigv4Config, signingKey) != 0)
+    {
+        fprintf(stderr, "Failed to set up the signer\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < sizeof(batchSizes) / sizeof(batchSizes[0]); i++)
+    {
+        fillBatch(&batch, batchSizes[i]);
+        if (batch.valuesLen != batchSizes[i] ||
+            Sitewise_printEntriesAsJsonStreaming(payloadBuffer, sizeof(payloadBuffer), batch.entries, batch.entriesLen,
+                                                 NULL, NULL, &payloadLen) != SITEWISE_ERROR_NONE ||
+            payloadLen != batch.payloadLen)
+        {
+            fprintf(stderr, "Batch of %zu values is broken\n", batchSizes[i]);
+            return 1;
+        }
+
+        BenchResult_t result = runBench(benchPayload, &batch, iterations, rounds);
+        printResult("payload", batchSizes[i], payloadLen, &result);
+        result = runBench(benchPayloadCJson, &batch, iterations, rounds);
+        printResult("payload-cjson", batchSizes[i], strlen(payloadBuffer), &result);
+    }
+
+    const char *payloadHash = "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855";
+    sigv4Config.signing_key = NULL;
+    BenchResult_t result = runBench(benchSignDerive, (void *)payloadHash, iterations, rounds);
+    printResult("sign-derive", 0, 0, &result);
+    result = runBench(benchSign, (void *)payloadHash, iterations, rounds);
+    printResult("sign-cached", 0, 0, &result);
+    sigv4Config.signing_key = signingKey;
+    result = runBench(benchSign, (void *)payloadHash, iterations, rounds);
+    printResult("sign-key", 0, 0, &result);
+
+    for (size_t i = 0; i < sizeof(batchSizes) / sizeof(batchSizes[0]); i++)
+    {
+        fillBatch(&batch, batchSizes[i]);
+        result = runBench(benchPrepare, (void *)&batchSizes[i], iterations, rounds);
+        printResult("prepare", batchSizes[i], batch.payloadLen, &result);
+    }
+
+    aws_sig_v4_free(&sigv4Context);
+    return 0;
+}
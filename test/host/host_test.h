@@ -0,0 +1,59 @@
+#ifndef _HOST_TEST_H_
+#define _HOST_TEST_H_
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Checks of the host tests. A failed check is reported and counted, and the test goes on, so that one run shows all
+ * of the failures. The main function of a test returns HOST_TEST_RESULT().
+ */
+
+static int hostTestFailures = 0;
+
+#define TEST_ASSERT(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            hostTestFailures++; \
+        } \
+    } while (0)
+
+#define TEST_ASSERT_EQUAL_INT(expected, actual) \
+    do \
+    { \
+        long long expectedValue = (long long)(expected); \
+        long long actualValue = (long long)(actual); \
+        if (expectedValue != actualValue) \
+        { \
+            fprintf(stderr, "%s:%d: expected %s == %lld, got %lld\n", __FILE__, __LINE__, #actual, expectedValue, actualValue); \
+            hostTestFailures++; \
+        } \
+    } while (0)
+
+#define TEST_ASSERT_EQUAL_STRING(expected, actual) \
+    do \
+    { \
+        const char *expectedString = (expected); \
+        const char *actualString = (actual); \
+        if (expectedString == NULL || actualString == NULL || strcmp(expectedString, actualString) != 0) \
+        { \
+            fprintf(stderr, "%s:%d: expected %s == \"%s\", got \"%s\"\n", __FILE__, __LINE__, #actual, \
+                    expectedString ? expectedString : "(null)", actualString ? actualString : "(null)"); \
+            hostTestFailures++; \
+        } \
+    } while (0)
+
+#define RUN_TEST(test) \
+    do \
+    { \
+        int failuresBefore = hostTestFailures; \
+        test(); \
+        printf("%s %s\n", (hostTestFailures == failuresBefore) ? "PASS" : "FAIL", #test); \
+    } while (0)
+
+#define HOST_TEST_RESULT() ((hostTestFailures == 0) ? 0 : 1)
+
+#endif /* _HOST_TEST_H_ */
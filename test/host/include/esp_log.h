@@ -0,0 +1,16 @@
+#ifndef _ESP_LOG_H_
+#define _ESP_LOG_H_
+
+/* Host stand-in for the logging of ESP-IDF, printing to stderr */
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "esp_err.h"
+
+#define ESP_LOGE(tag, format, ...) fprintf(stderr, "E (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) fprintf(stderr, "W (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) fprintf(stderr, "I (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) do { } while (0)
+
+#endif /* _ESP_LOG_H_ */
@@ -0,0 +1,13 @@
+#ifndef _ESP_RANDOM_H_
+#define _ESP_RANDOM_H_
+
+/* Host stand-in for the random number generator of ESP-IDF. It is seeded with a constant, so runs repeat. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint32_t esp_random(void);
+
+void esp_fill_random(void *buf, size_t len);
+
+#endif /* _ESP_RANDOM_H_ */
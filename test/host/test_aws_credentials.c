@@ -0,0 +1,289 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_http_client.h"
+
+#include "host_test.h"
+#include "aws_credentials.h"
+
+#define VALID_RESPONSE \
+    "{\"AccessKeyId\": \"ASIAEXAMPLE\", \"SecretAccessKey\": \"wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY\", " \
+    "\"Token\": \"FwoGZXIvYXdzEXAMPLE\", \"Expiration\": \"2024-05-01T12:00:00Z\"}"
+
+/**
+ * A stand-in of the credentials endpoint behind the HTTP client: it answers every request with a canned status and
+ * body, and records what the request looked like.
+ */
+typedef struct StandIn
+{
+    /* The answer */
+    esp_err_t openError;
+    int statusCode;
+    const char *pBody;
+    bool failHeaders;
+
+    /* The request */
+    char url[128];
+    char authorization[128];
+    bool hasAuthorization;
+    int clients;            /* Clients alive */
+    size_t readOffset;
+} StandIn_t;
+
+static StandIn_t standIn;
+
+static void resetStandIn(int statusCode, const char *pBody)
+{
+    memset(&standIn, 0, sizeof(standIn));
+    standIn.statusCode = statusCode;
+    standIn.pBody = pBody;
+}
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config)
+{
+    snprintf(standIn.url, sizeof(standIn.url), "%s", config->url);
+    standIn.clients++;
+    standIn.readOffset = 0;
+    return (esp_http_client_handle_t)&standIn;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value)
+{
+    if (strcmp(key, "Authorization") == 0)
+    {
+        snprintf(standIn.authorization, sizeof(standIn.authorization), "%s", value);
+        standIn.hasAuthorization = true;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len)
+{
+    return standIn.openError;
+}
+
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t client)
+{
+    return standIn.failHeaders ? -1 : (int64_t)strlen(standIn.pBody);
+}
+
+int esp_http_client_read_response(esp_http_client_handle_t client, char *buffer, int len)
+{
+    size_t bodyLen = strlen(standIn.pBody);
+    size_t n = bodyLen - standIn.readOffset;
+
+    n = (n < (size_t)len) ? n : (size_t)len;
+    memcpy(buffer, standIn.pBody + standIn.readOffset, n);
+    standIn.readOffset += n;
+    return (int)n;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client)
+{
+    return standIn.statusCode;
+}
+
+bool esp_http_client_is_complete_data_received(esp_http_client_handle_t client)
+{
+    return standIn.readOffset == strlen(standIn.pBody);
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client)
+{
+    standIn.clients--;
+    return ESP_OK;
+}
+
+/**
+ * Parse a document with only the expiration set, and return the expiration, or -1 if it is refused.
+ */
+static time_t parseExpiration(const char *expiration)
+{
+    char json[256];
+    aws_credentials_t credentials;
+
+    snprintf(json, sizeof(json), "{\"AccessKeyId\": \"A\", \"SecretAccessKey\": \"S\", \"Expiration\": \"%s\"}",
+             expiration);
+    if (aws_credentials_parse(json, strlen(json), &credentials) != ESP_OK)
+    {
+        return -1;
+    }
+    return credentials.expiration;
+}
+
+static void testParse(void)
+{
+    aws_credentials_t credentials;
+
+    TEST_ASSERT_EQUAL_INT(ESP_OK, aws_credentials_parse(VALID_RESPONSE, strlen(VALID_RESPONSE), &credentials));
+    TEST_ASSERT_EQUAL_STRING("ASIAEXAMPLE", credentials.access_key);
+    TEST_ASSERT_EQUAL_STRING("wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY", credentials.secret_key);
+    TEST_ASSERT_EQUAL_STRING("FwoGZXIvYXdzEXAMPLE", credentials.session_token);
+    TEST_ASSERT_EQUAL_INT(1714564800, credentials.expiration);
+
+    /* The token and the expiration are optional */
+    const char *keysOnly = "{\"AccessKeyId\": \"AKIDEXAMPLE\", \"SecretAccessKey\": \"secret\"}";
+    TEST_ASSERT_EQUAL_INT(ESP_OK, aws_credentials_parse(keysOnly, strlen(keysOnly), &credentials));
+    TEST_ASSERT_EQUAL_STRING("", credentials.session_token);
+    TEST_ASSERT_EQUAL_INT(0, credentials.expiration);
+}
+
+static void testParseRefused(void)
+{
+    aws_credentials_t credentials;
+    static char json[AWS_CREDENTIALS_SESSION_TOKEN_SIZE + 128];
+    const char *refused[] = {
+        "",
+        "not json",
+        "{\"SecretAccessKey\": \"secret\"}",
+        "{\"AccessKeyId\": \"AKIDEXAMPLE\"}",
+        "{\"AccessKeyId\": 42, \"SecretAccessKey\": \"secret\"}",
+        "{\"AccessKeyId\": \"A\", \"SecretAccessKey\": \"S\", \"Expiration\": \"tomorrow\"}",
+    };
+
+    for (size_t i = 0; i < sizeof(refused) / sizeof(refused[0]); i++)
+    {
+        /* Nothing of an earlier parse is left behind */
+        aws_credentials_parse(VALID_RESPONSE, strlen(VALID_RESPONSE), &credentials);
+        TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_RESPONSE, aws_credentials_parse(refused[i], strlen(refused[i]), &credentials));
+        TEST_ASSERT_EQUAL_STRING("", credentials.access_key);
+        TEST_ASSERT_EQUAL_STRING("", credentials.secret_key);
+    }
+
+    /* A token one byte too long for its buffer */
+    int len = snprintf(json, sizeof(json), "{\"AccessKeyId\": \"A\", \"SecretAccessKey\": \"S\", \"Token\": \"");
+    memset(json + len, 't', AWS_CREDENTIALS_SESSION_TOKEN_SIZE);
+    snprintf(json + len + AWS_CREDENTIALS_SESSION_TOKEN_SIZE, sizeof(json) - len - AWS_CREDENTIALS_SESSION_TOKEN_SIZE, "\"}");
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_RESPONSE, aws_credentials_parse(json, strlen(json), &credentials));
+    json[len + AWS_CREDENTIALS_SESSION_TOKEN_SIZE - 1] = '"';
+    json[len + AWS_CREDENTIALS_SESSION_TOKEN_SIZE] = '}';
+    json[len + AWS_CREDENTIALS_SESSION_TOKEN_SIZE + 1] = '\0';
+    TEST_ASSERT_EQUAL_INT(ESP_OK, aws_credentials_parse(json, strlen(json), &credentials));
+    TEST_ASSERT_EQUAL_INT(AWS_CREDENTIALS_SESSION_TOKEN_SIZE - 1, strlen(credentials.session_token));
+}
+
+static void testParseTime(void)
+{
+    TEST_ASSERT_EQUAL_INT(0, parseExpiration("1970-01-01T00:00:00Z"));
+    TEST_ASSERT_EQUAL_INT(951782400, parseExpiration("2000-02-29T00:00:00Z"));
+    TEST_ASSERT_EQUAL_INT(951868800, parseExpiration("2000-03-01T00:00:00Z"));
+    TEST_ASSERT_EQUAL_INT(2147483647, parseExpiration("2038-01-19T03:14:07Z"));
+    TEST_ASSERT_EQUAL_INT(4107542400, parseExpiration("2100-03-01T00:00:00Z"));
+
+    /* A fraction of a second is cut off */
+    TEST_ASSERT_EQUAL_INT(1714564800, parseExpiration("2024-05-01T12:00:00.123Z"));
+
+    TEST_ASSERT_EQUAL_INT(-1, parseExpiration("1969-12-31T23:59:59Z"));
+    TEST_ASSERT_EQUAL_INT(-1, parseExpiration("2024-13-01T00:00:00Z"));
+    TEST_ASSERT_EQUAL_INT(-1, parseExpiration("2024-05-00T00:00:00Z"));
+    TEST_ASSERT_EQUAL_INT(-1, parseExpiration("2024-05-01"));
+
+    /* Against timegm of the host, at noon of every day for 200 years and every second of a day */
+    for (time_t t = 43200; t < 200LL * 366 * 86400; t += 86400)
+    {
+        struct tm tm;
+        char text[32];
+
+        gmtime_r(&t, &tm);
+        strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%SZ", &tm);
+        TEST_ASSERT_EQUAL_INT(timegm(&tm), parseExpiration(text));
+    }
+    for (time_t t = 1709164800; t < 1709164800 + 86400; t += 7)
+    {
+        struct tm tm;
+        char text[32];
+
+        gmtime_r(&t, &tm);
+        strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%SZ", &tm);
+        TEST_ASSERT_EQUAL_INT(t, parseExpiration(text));
+    }
+}
+
+static void testStatic(void)
+{
+    aws_credentials_t credentials;
+    aws_static_credentials_t source = { .access_key = "AKIDEXAMPLE", .secret_key = "secret", .session_token = NULL };
+    char longKey[AWS_CREDENTIALS_SECRET_KEY_SIZE + 1];
+
+    TEST_ASSERT_EQUAL_INT(ESP_OK, aws_credentials_fetch_static(&source, &credentials));
+    TEST_ASSERT_EQUAL_STRING("AKIDEXAMPLE", credentials.access_key);
+    TEST_ASSERT_EQUAL_STRING("secret", credentials.secret_key);
+    TEST_ASSERT_EQUAL_STRING("", credentials.session_token);
+    TEST_ASSERT_EQUAL_INT(0, credentials.expiration);
+
+    memset(longKey, 'k', sizeof(longKey) - 1);
+    longKey[sizeof(longKey) - 1] = '\0';
+    source.secret_key = longKey;
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_SIZE, aws_credentials_fetch_static(&source, &credentials));
+    TEST_ASSERT_EQUAL_STRING("", credentials.access_key);
+}
+
+static void testEndpoint(void)
+{
+    static aws_credentials_endpoint_t endpoint = {
+        .url = "http://169.254.170.2/v2/credentials/example",
+        .authorization = "Bearer device-token",
+    };
+    aws_credentials_t credentials;
+
+    resetStandIn(200, VALID_RESPONSE);
+    TEST_ASSERT_EQUAL_INT(ESP_OK, aws_credentials_fetch_endpoint(&endpoint, &credentials));
+    TEST_ASSERT_EQUAL_STRING("ASIAEXAMPLE", credentials.access_key);
+    TEST_ASSERT_EQUAL_STRING("FwoGZXIvYXdzEXAMPLE", credentials.session_token);
+    TEST_ASSERT_EQUAL_INT(1714564800, credentials.expiration);
+    TEST_ASSERT_EQUAL_STRING(endpoint.url, standIn.url);
+    TEST_ASSERT_EQUAL_STRING("Bearer device-token", standIn.authorization);
+    TEST_ASSERT_EQUAL_INT(0, standIn.clients);
+
+    /* The response buffer doesn't keep the secret */
+    TEST_ASSERT(strstr(endpoint.response, "EXAMPLEKEY") == NULL);
+
+    /* No Authorization header without one configured */
+    endpoint.authorization = "";
+    resetStandIn(200, VALID_RESPONSE);
+    TEST_ASSERT_EQUAL_INT(ESP_OK, aws_credentials_fetch_endpoint(&endpoint, &credentials));
+    TEST_ASSERT(!standIn.hasAuthorization);
+}
+
+static void testEndpointFailures(void)
+{
+    static aws_credentials_endpoint_t endpoint = { .url = "http://169.254.170.2/v2/credentials/example" };
+    static char largeBody[AWS_CREDENTIALS_RESPONSE_SIZE + 16];
+    aws_credentials_t credentials;
+
+    resetStandIn(200, VALID_RESPONSE);
+    standIn.openError = ESP_ERR_HTTP_CONNECT;
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_HTTP_CONNECT, aws_credentials_fetch_endpoint(&endpoint, &credentials));
+    TEST_ASSERT_EQUAL_INT(0, standIn.clients);
+
+    resetStandIn(200, VALID_RESPONSE);
+    standIn.failHeaders = true;
+    TEST_ASSERT_EQUAL_INT(ESP_FAIL, aws_credentials_fetch_endpoint(&endpoint, &credentials));
+
+    resetStandIn(403, "{\"message\": \"Forbidden\"}");
+    TEST_ASSERT_EQUAL_INT(ESP_FAIL, aws_credentials_fetch_endpoint(&endpoint, &credentials));
+
+    resetStandIn(200, "{\"AccessKeyId\": \"ASIAEXAMPLE\"}");
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_RESPONSE, aws_credentials_fetch_endpoint(&endpoint, &credentials));
+
+    memset(largeBody, ' ', sizeof(largeBody) - 1);
+    resetStandIn(200, largeBody);
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_SIZE, aws_credentials_fetch_endpoint(&endpoint, &credentials));
+    TEST_ASSERT_EQUAL_INT(0, standIn.clients);
+}
+
+int main(void)
+{
+    RUN_TEST(testParse);
+    RUN_TEST(testParseRefused);
+    RUN_TEST(testParseTime);
+    RUN_TEST(testStatic);
+    RUN_TEST(testEndpoint);
+    RUN_TEST(testEndpointFailures);
+
+    return HOST_TEST_RESULT();
+}
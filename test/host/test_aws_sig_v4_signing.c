@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "aws_sig_v4_signing.h"
+
+/* The credentials and the request of the get-vanilla case of the AWS SigV4 test suite */
+#define VANILLA_AUTHORIZATION \
+    "AWS4-HMAC-SHA256 Credential=AKIDEXAMPLE/20150830/us-east-1/service/aws4_request, " \
+    "SignedHeaders=host;x-amz-date, Signature=5fa00fa31553b73ebf1942676e86291e8372ff2a2260956d9b8aae1d763fbf31"
+
+/* The post-vanilla case */
+#define POST_VANILLA_AUTHORIZATION \
+    "AWS4-HMAC-SHA256 Credential=AKIDEXAMPLE/20150830/us-east-1/service/aws4_request, " \
+    "SignedHeaders=host;x-amz-date, Signature=5da7c1a2acd57cee7505fc6676e4e544621c30862966e37dddb68e92efbe5d6b"
+
+/* The post-sts-header-after case, of which the session token is signed and sent in X-Amz-Security-Token */
+#define STS_TOKEN \
+    "AQoDYXdzEPT//////////wEXAMPLEtc764bNrC9SAPBSM22wDOk4x4HIZ8j4FZTwdQWLWsKWHGBuFqwAeMicRXmxfpSPfIeoIYRqTflfKD8YUuwth" \
+    "Ax7mSEI/qkPpKPi/kMcGdQrmGdeehM4IC1NtBmUpp2wUE8phUZampKsburEDy0KPkyQDYwT7WZ0wq5VSXDvp75YU9HFvlRd8Tx6q6fE8YQcHNVXAk" \
+    "iY9q6d+xo0rKwT38xVqr7ZD0u0iPPkUL64lIZbqBAz+scqKmlzm8FDrypNC9Yjc8fPOLn9FX9KSYvKTr4rvx3iSIlTJabIQwj2ICCR/oLxBA=="
+#define STS_AUTHORIZATION \
+    "AWS4-HMAC-SHA256 Credential=AKIDEXAMPLE/20150830/us-east-1/service/aws4_request, " \
+    "SignedHeaders=host;x-amz-date;x-amz-security-token, " \
+    "Signature=85d96828115b5dc0cfc3bd16ad9e210dd772bbebba041836c64533a82be05ead"
+
+#define EMPTY_PAYLOAD_HASH "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"
+
+static aws_sig_v4_config_t vanillaConfig(void)
+{
+    aws_sig_v4_config_t config = {
+        .service_name = "service",
+        .region_name = "us-east-1",
+        .secret_key = "wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY",
+        .access_key = "AKIDEXAMPLE",
+        .host = "example.amazonaws.com",
+        .method = "GET",
+        .path = "/",
+        .query = "",
+        .amz_date = "20150830T123600Z",
+        .date_stamp = "20150830",
+        .signed_headers = "",
+        .canonical_headers = "",
+        .payload = "",
+        .payload_len = 0,
+    };
+    return config;
+}
+
+static void testLegacyNeedsNoInit(void)
+{
+    aws_sig_v4_context_t ctx;
+    aws_sig_v4_config_t config = vanillaConfig();
+
+    /* Whatever the memory holds, e.g. a context on the stack */
+    memset(&ctx, 0xA5, sizeof(ctx));
+    TEST_ASSERT_EQUAL_STRING(VANILLA_AUTHORIZATION, aws_sig_v4_signing_header(&ctx, &config));
+
+    memset(&ctx, 0xA5, sizeof(ctx));
+    TEST_ASSERT_EQUAL_STRING(VANILLA_AUTHORIZATION, aws_sig_v4_signing_header_with_payload_hash(
+                             &ctx, &config, EMPTY_PAYLOAD_HASH));
+
+    /* Nothing is left cached, not even after a call on an initialized context */
+    TEST_ASSERT_EQUAL_INT(0, ctx.signing_key_valid);
+    aws_sig_v4_init(&ctx);
+    TEST_ASSERT_EQUAL_STRING(VANILLA_AUTHORIZATION, aws_sig_v4_signing_header(&ctx, &config));
+    TEST_ASSERT_EQUAL_INT(0, ctx.signing_key_valid);
+}
+
+static void testLegacyTooLong(void)
+{
+    aws_sig_v4_context_t ctx;
+    aws_sig_v4_config_t config = vanillaConfig();
+    char host[AWS_SIG_V4_CANONICAL_PREFIX_SIZE + 1];
+
+    memset(host, 'h', sizeof(host) - 1);
+    host[sizeof(host) - 1] = '\0';
+    config.host = host;
+    TEST_ASSERT(aws_sig_v4_signing_header(&ctx, &config) == NULL);
+}
+
+static void testTemplateVectors(void)
+{
+    aws_sig_v4_context_t ctx;
+    aws_sig_v4_template_t tmpl;
+    aws_sig_v4_config_t config = vanillaConfig();
+
+    aws_sig_v4_init(&ctx);
+    TEST_ASSERT_EQUAL_INT(0, aws_sig_v4_template_init(&tmpl, &config));
+    TEST_ASSERT_EQUAL_STRING(VANILLA_AUTHORIZATION,
+                             aws_sig_v4_template_signing_header(&ctx, &tmpl, &config, EMPTY_PAYLOAD_HASH));
+
+    /* The second request signs with the cached signing key */
+    TEST_ASSERT_EQUAL_INT(1, ctx.signing_key_valid);
+    TEST_ASSERT_EQUAL_STRING(VANILLA_AUTHORIZATION,
+                             aws_sig_v4_template_signing_header(&ctx, &tmpl, &config, EMPTY_PAYLOAD_HASH));
+
+    config.method = "POST";
+    TEST_ASSERT_EQUAL_INT(0, aws_sig_v4_template_init(&tmpl, &config));
+    TEST_ASSERT_EQUAL_STRING(POST_VANILLA_AUTHORIZATION,
+                             aws_sig_v4_template_signing_header(&ctx, &tmpl, &config, EMPTY_PAYLOAD_HASH));
+
+    config.session_token = STS_TOKEN;
+    TEST_ASSERT_EQUAL_STRING(STS_AUTHORIZATION,
+                             aws_sig_v4_template_signing_header(&ctx, &tmpl, &config, EMPTY_PAYLOAD_HASH));
+
+    /* Without the token again, as after a rotation to long-term keys */
+    config.session_token = "";
+    TEST_ASSERT_EQUAL_STRING(POST_VANILLA_AUTHORIZATION,
+                             aws_sig_v4_template_signing_header(&ctx, &tmpl, &config, EMPTY_PAYLOAD_HASH));
+    aws_sig_v4_free(&ctx);
+}
+
+static void testTemplateDerivedKey(void)
+{
+    aws_sig_v4_context_t ctx;
+    aws_sig_v4_template_t tmpl;
+    aws_sig_v4_config_t config = vanillaConfig();
+    char signing_key[AWS_SIG_V4_SIGNING_KEY_LENGTH];
+
+    TEST_ASSERT_EQUAL_INT(0, aws_sig_v4_derive_signing_key(&config, signing_key));
+    aws_sig_v4_init(&ctx);
+    TEST_ASSERT_EQUAL_INT(0, aws_sig_v4_template_init(&tmpl, &config));
+
+    /* The secret is not needed once the key is derived */
+    config.secret_key = NULL;
+    config.signing_key = signing_key;
+    TEST_ASSERT_EQUAL_STRING(VANILLA_AUTHORIZATION,
+                             aws_sig_v4_template_signing_header(&ctx, &tmpl, &config, EMPTY_PAYLOAD_HASH));
+    config.session_token = STS_TOKEN;
+    config.method = "POST";
+    TEST_ASSERT_EQUAL_INT(0, aws_sig_v4_template_init(&tmpl, &config));
+    TEST_ASSERT_EQUAL_STRING(STS_AUTHORIZATION,
+                             aws_sig_v4_template_signing_header(&ctx, &tmpl, &config, EMPTY_PAYLOAD_HASH));
+    aws_sig_v4_free(&ctx);
+}
+
+static void testTemplateTooLong(void)
+{
+    aws_sig_v4_template_t tmpl;
+    aws_sig_v4_config_t config = vanillaConfig();
+    char host[AWS_SIG_V4_CANONICAL_PREFIX_SIZE + 1];
+
+    memset(host, 'h', sizeof(host) - 1);
+    host[sizeof(host) - 1] = '\0';
+    config.host = host;
+    TEST_ASSERT_EQUAL_INT(-1, aws_sig_v4_template_init(&tmpl, &config));
+}
+
+int main(void)
+{
+    RUN_TEST(testLegacyNeedsNoInit);
+    RUN_TEST(testLegacyTooLong);
+    RUN_TEST(testTemplateVectors);
+    RUN_TEST(testTemplateDerivedKey);
+    RUN_TEST(testTemplateTooLong);
+
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+#include "host_test.h"
+#include "dht_decode.h"
+
+#define TRACE_MAX_EDGES (DHT_FALLING_EDGES + 4)
+
+/* Gaps between falling edges in microseconds, at both ends of the range of the datasheets */
+typedef struct TraceTiming
+{
+    uint32_t responseUs;
+    uint32_t zeroUs;
+    uint32_t oneUs;
+} TraceTiming_t;
+
+static const TraceTiming_t typicalTiming = { .responseUs = 160, .zeroUs = 77, .oneUs = 120 };
+static const TraceTiming_t slowTiming = { .responseUs = 150, .zeroUs = 82, .oneUs = 130 };
+
+typedef struct Trace
+{
+    uint32_t edgesUs[TRACE_MAX_EDGES];
+    size_t edgesLen;
+} Trace_t;
+
+/**
+ * Lay out the edges of a frame the way the interrupt time-stamps them.
+ *
+ * @param[out] pTrace The trace
+ * @param[in] data The frame
+ * @param[in] pTiming The gaps between the edges
+ * @param[in] strayEdges 2 with the edge of the start signal and the one starting the response, 1 without the edge of
+ * the start signal, 0 if the capture begins at the end of the response
+ */
+static void makeTrace(Trace_t *pTrace, const uint8_t data[DHT_DATA_SIZE], const TraceTiming_t *pTiming,
+                      int strayEdges)
+{
+    /* The timer keeps running from boot, so start somewhere */
+    uint32_t nowUs = 7351234;
+
+    pTrace->edgesLen = 0;
+    if (strayEdges >= 2)
+    {
+        /* The host pulls the line low, then the sensor answers 20 ms later */
+        pTrace->edgesUs[pTrace->edgesLen++] = nowUs;
+        nowUs += 20030;
+    }
+    if (strayEdges >= 1)
+    {
+        pTrace->edgesUs[pTrace->edgesLen++] = nowUs;
+        nowUs += pTiming->responseUs;
+    }
+    pTrace->edgesUs[pTrace->edgesLen++] = nowUs;
+
+    for (int bit = 0; bit < DHT_DATA_SIZE * 8; bit++)
+    {
+        /* A microsecond of jitter here and there, as the interrupt latency varies */
+        uint32_t jitterUs = (bit % 3 == 0) ? 1 : 0;
+
+        nowUs += ((data[bit / 8] >> (7 - bit % 8)) & 1) ? pTiming->oneUs : pTiming->zeroUs;
+        pTrace->edgesUs[pTrace->edgesLen++] = nowUs + jitterUs;
+    }
+}
+
+static void makeFrame(uint8_t data[DHT_DATA_SIZE], uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3)
+{
+    data[0] = b0;
+    data[1] = b1;
+    data[2] = b2;
+    data[3] = b3;
+    data[4] = (uint8_t)(b0 + b1 + b2 + b3);
+}
+
+/**
+ * Feed the edges one by one to the wake-up rule of the interrupt, and return how many were in when it fired.
+ */
+static size_t edgesAtWake(const Trace_t *pTrace)
+{
+    size_t responseEdge = 0;
+
+    for (size_t edge = 0; edge < pTrace->edgesLen; edge++)
+    {
+        if (DHT_IS_RESPONSE_EDGE(pTrace->edgesUs, edge))
+        {
+            responseEdge = edge;
+        }
+        if (edge + 1 == TRACE_MAX_EDGES || edge + 1 - responseEdge == DHT_FALLING_EDGES)
+        {
+            return edge + 1;
+        }
+    }
+    return 0;
+}
+
+static void testDht22(void)
+{
+    Trace_t trace;
+    uint8_t frame[DHT_DATA_SIZE];
+    uint8_t data[DHT_DATA_SIZE];
+    float temperature = 0.0f;
+    float humidity = 0.0f;
+
+    /* 45.6 %, 23.4 C */
+    makeFrame(frame, 0x01, 0xC8, 0x00, 0xEA);
+    for (int strayEdges = 0; strayEdges <= 2; strayEdges++)
+    {
+        makeTrace(&trace, frame, &typicalTiming, strayEdges);
+        TEST_ASSERT_EQUAL_INT(DHT11_ERROR_NONE, DHT_decode(trace.edgesUs, trace.edgesLen, data));
+        DHT_convert(DHT22, data, &temperature, &humidity);
+        TEST_ASSERT(fabsf(temperature - 23.4f) < 0.01f);
+        TEST_ASSERT(fabsf(humidity - 45.6f) < 0.01f);
+    }
+
+    /* -10.1 C */
+    makeFrame(frame, 0x02, 0x8A, 0x80, 0x65);
+    makeTrace(&trace, frame, &slowTiming, 2);
+    TEST_ASSERT_EQUAL_INT(DHT11_ERROR_NONE, DHT_decode(trace.edgesUs, trace.edgesLen, data));
+    DHT_convert(DHT22, data, &temperature, NULL);
+    TEST_ASSERT(fabsf(temperature + 10.1f) < 0.01f);
+}
+
+static void testDht11(void)
+{
+    Trace_t trace;
+    uint8_t frame[DHT_DATA_SIZE];
+    uint8_t data[DHT_DATA_SIZE];
+    float temperature = 0.0f;
+    float humidity = 0.0f;
+
+    /* 40.0 %, 27.3 C, with every bit a 1 or a 0 somewhere */
+    makeFrame(frame, 0x01, 0x90, 0x1B, 0x03);
+    makeTrace(&trace, frame, &slowTiming, 2);
+    TEST_ASSERT_EQUAL_INT(DHT11_ERROR_NONE, DHT_decode(trace.edgesUs, trace.edgesLen, data));
+    DHT_convert(DHT11, data, &temperature, &humidity);
+    TEST_ASSERT(fabsf(temperature - 27.3f) < 0.01f);
+    TEST_ASSERT(fabsf(humidity - 40.0f) < 0.01f);
+
+    makeFrame(frame, 0xFF, 0xFF, 0xFF, 0xFE);
+    makeTrace(&trace, frame, &slowTiming, 1);
+    TEST_ASSERT_EQUAL_INT(DHT11_ERROR_NONE, DHT_decode(trace.edgesUs, trace.edgesLen, data));
+    TEST_ASSERT_EQUAL_INT(0xFB, data[4]);
+}
+
+static void testWakeOnLastBit(void)
+{
+    Trace_t trace;
+    uint8_t frame[DHT_DATA_SIZE];
+    uint8_t data[DHT_DATA_SIZE];
+
+    makeFrame(frame, 0x01, 0xC8, 0x00, 0xEA);
+    for (int strayEdges = 0; strayEdges <= 2; strayEdges++)
+    {
+        makeTrace(&trace, frame, &typicalTiming, strayEdges);
+
+        /* Not one edge early, which would cut the checksum short */
+        TEST_ASSERT_EQUAL_INT(trace.edgesLen, edgesAtWake(&trace));
+
+        /* A capture cut short reads as a timeout, not as a checksum error */
+        TEST_ASSERT_EQUAL_INT(DHT11_ERROR_TIMEOUT, DHT_decode(trace.edgesUs, trace.edgesLen - 1, data));
+    }
+}
+
+static void testBadFrames(void)
+{
+    Trace_t trace;
+    uint8_t frame[DHT_DATA_SIZE];
+    uint8_t data[DHT_DATA_SIZE];
+
+    TEST_ASSERT_EQUAL_INT(DHT11_ERROR_TIMEOUT, DHT_decode(trace.edgesUs, 0, data));
+
+    /* A bit read as the other value */
+    makeFrame(frame, 0x01, 0xC8, 0x00, 0xEA);
+    makeTrace(&trace, frame, &typicalTiming, 2);
+    trace.edgesUs[20] += typicalTiming.oneUs - typicalTiming.zeroUs;
+    TEST_ASSERT_EQUAL_INT(DHT11_ERROR_CRC, DHT_decode(trace.edgesUs, trace.edgesLen, data));
+
+    /* A missed edge leaves a gap that looks like a response, with too few bits after it */
+    makeTrace(&trace, frame, &typicalTiming, 2);
+    for (size_t edge = 20; edge + 1 < trace.edgesLen; edge++)
+    {
+        trace.edgesUs[edge] = trace.edgesUs[edge + 1];
+    }
+    trace.edgesLen--;
+    TEST_ASSERT_EQUAL_INT(0, edgesAtWake(&trace));
+    TEST_ASSERT_EQUAL_INT(DHT11_ERROR_TIMEOUT, DHT_decode(trace.edgesUs, trace.edgesLen, data));
+}
+
+int main(void)
+{
+    RUN_TEST(testDht22);
+    RUN_TEST(testDht11);
+    RUN_TEST(testWakeOnLastBit);
+    RUN_TEST(testBadFrames);
+
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "hex.h"
+
+static void testEveryByte(void)
+{
+    char output[3];
+    char expected[3];
+
+    for (unsigned value = 0; value < 256; value++)
+    {
+        uint8_t byte = (uint8_t)value;
+
+        snprintf(expected, sizeof(expected), "%02x", value);
+        Hex_encode(output, &byte, 1);
+        TEST_ASSERT_EQUAL_STRING(expected, output);
+    }
+}
+
+static void testSignedChars(void)
+{
+    /* Bytes of a hash handed over as char, which is signed on some targets */
+    const char hash[] = { (char)0x80, (char)0xff, 0x00, 0x7f, (char)0xa5 };
+    char output[2 * sizeof(hash) + 1];
+
+    Hex_encode(output, (const uint8_t *)hash, sizeof(hash));
+    TEST_ASSERT_EQUAL_STRING("80ff007fa5", output);
+}
+
+static void testLengths(void)
+{
+    uint8_t input[32];
+    char output[2 * sizeof(input) + 2];
+
+    for (size_t i = 0; i < sizeof(input); i++)
+    {
+        input[i] = (uint8_t)(i * 37);
+    }
+
+    memset(output, 'x', sizeof(output));
+    Hex_encode(output, input, 0);
+    TEST_ASSERT_EQUAL_STRING("", output);
+
+    for (size_t len = 1; len <= sizeof(input); len++)
+    {
+        memset(output, 'x', sizeof(output));
+        Hex_encode(output, input, len);
+        TEST_ASSERT_EQUAL_INT(2 * len, strlen(output));
+        /* Nothing is written past the terminator */
+        TEST_ASSERT(output[2 * len + 1] == 'x');
+        for (size_t i = 0; i < len; i++)
+        {
+            char pair[3];
+            snprintf(pair, sizeof(pair), "%02x", input[i]);
+            TEST_ASSERT(memcmp(&output[2 * i], pair, 2) == 0);
+        }
+    }
+}
+
+int main(void)
+{
+    RUN_TEST(testEveryByte);
+    RUN_TEST(testSignedChars);
+    RUN_TEST(testLengths);
+
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,517 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <float.h>
+
+#include "cJSON.h"
+
+#include "host_test.h"
+#include "sitewise.h"
+
+#define TEST_PAYLOAD_BUFFER_SIZE (16384)
+
+static char payloadBuffer[TEST_PAYLOAD_BUFFER_SIZE];
+static char goldenBuffer[TEST_PAYLOAD_BUFFER_SIZE];
+
+/**
+ * Print the entries with cJSON, the way the firmware did before it had its own serializer. The entry IDs are the ones
+ * the serializer under test has just filled in.
+ */
+static void printEntriesWithCJson(char *pBuffer, size_t bufferSize, Entry_t *entriesArray, size_t entriesLen)
+{
+    cJSON *root = cJSON_CreateObject();
+    cJSON *entries = cJSON_AddArrayToObject(root, "entries");
+
+    for (size_t entriesIndex = 0; entriesIndex < entriesLen; entriesIndex++)
+    {
+        Entry_t *pEntry = &(entriesArray[entriesIndex]);
+        cJSON *entry = cJSON_CreateObject();
+
+        cJSON_AddItemToArray(entries, entry);
+        cJSON_AddStringToObject(entry, "entryId", pEntry->entryId);
+        if (pEntry->propertyAlias != NULL)
+        {
+            cJSON_AddStringToObject(entry, "propertyAlias", pEntry->propertyAlias);
+        }
+        else
+        {
+            cJSON_AddStringToObject(entry, "assetId", pEntry->assetId);
+            cJSON_AddStringToObject(entry, "propertyId", pEntry->propertyId);
+        }
+        cJSON *propertyValues = cJSON_AddArrayToObject(entry, "propertyValues");
+
+        for (size_t propertyValuesIndex = 0; propertyValuesIndex < pEntry->propertyValuesLen; propertyValuesIndex++)
+        {
+            PropertyValue_t *pPropertyValue = &(pEntry->propertyValues[propertyValuesIndex]);
+            cJSON *propertyValue = cJSON_CreateObject();
+
+            cJSON_AddItemToArray(propertyValues, propertyValue);
+            cJSON *value = cJSON_AddObjectToObject(propertyValue, "value");
+            switch (pPropertyValue->type)
+            {
+                case PROPERTY_VALUE_TYPE_BOOLEAN:
+                    cJSON_AddBoolToObject(value, "booleanValue", pPropertyValue->booleanValue);
+                    break;
+                case PROPERTY_VALUE_TYPE_DOUBLE:
+                    cJSON_AddNumberToObject(value, "doubleValue", pPropertyValue->doubleValue);
+                    break;
+                case PROPERTY_VALUE_TYPE_INTEGER:
+                    cJSON_AddNumberToObject(value, "integerValue", pPropertyValue->integerValue);
+                    break;
+                case PROPERTY_VALUE_TYPE_STRING:
+                    cJSON_AddStringToObject(value, "stringValue", pPropertyValue->stringValue);
+                    break;
+                default:
+                    break;
+            }
+            cJSON *timestamp = cJSON_AddObjectToObject(propertyValue, "timestamp");
+            cJSON_AddNumberToObject(timestamp, "timeInSeconds", pPropertyValue->timeInSeconds);
+            cJSON_AddNumberToObject(timestamp, "offsetInNanos", pPropertyValue->offsetInNanos);
+            cJSON_AddStringToObject(propertyValue, "quality", "GOOD");
+        }
+    }
+
+    TEST_ASSERT(cJSON_PrintPreallocated(root, pBuffer, (int)bufferSize, 0));
+    cJSON_Delete(root);
+}
+
+static void addValue(Entry_t *pEntry, PropertyValue_t propertyValue)
+{
+    pEntry->propertyValues[pEntry->propertyValuesLen++] = propertyValue;
+}
+
+static PropertyValue_t doubleValue(double value)
+{
+    PropertyValue_t propertyValue = { .type = PROPERTY_VALUE_TYPE_DOUBLE, .doubleValue = value, .timeInSeconds = 1714564800 };
+    return propertyValue;
+}
+
+static PropertyValue_t integerValue(int value)
+{
+    PropertyValue_t propertyValue = { .type = PROPERTY_VALUE_TYPE_INTEGER, .integerValue = value, .timeInSeconds = 1714564800 };
+    return propertyValue;
+}
+
+static PropertyValue_t stringValue(char *value)
+{
+    PropertyValue_t propertyValue = { .type = PROPERTY_VALUE_TYPE_STRING, .stringValue = value, .timeInSeconds = 1714564800 };
+    return propertyValue;
+}
+
+static PropertyValue_t booleanValue(bool value)
+{
+    PropertyValue_t propertyValue = { .type = PROPERTY_VALUE_TYPE_BOOLEAN, .booleanValue = value, .timeInSeconds = 1714564800 };
+    return propertyValue;
+}
+
+/**
+ * Serialize the entries, compare them with the output of cJSON, and check the lengths the batch relies on.
+ */
+static void checkGolden(Entry_t *entriesArray, size_t entriesLen)
+{
+    size_t payloadLen = 0;
+    size_t expectedLen = SITEWISE_EMPTY_PAYLOAD_LENGTH + ((entriesLen > 0) ? entriesLen - 1 : 0);
+
+    TEST_ASSERT_EQUAL_INT(SITEWISE_ERROR_NONE,
+                          Sitewise_printEntriesAsJsonStreaming(payloadBuffer, sizeof(payloadBuffer), entriesArray, entriesLen,
+                                                               NULL, NULL, &payloadLen));
+    printEntriesWithCJson(goldenBuffer, sizeof(goldenBuffer), entriesArray, entriesLen);
+    TEST_ASSERT_EQUAL_STRING(goldenBuffer, payloadBuffer);
+    TEST_ASSERT_EQUAL_INT(strlen(payloadBuffer), payloadLen);
+
+    for (size_t i = 0; i < entriesLen; i++)
+    {
+        expectedLen += Sitewise_getEntryJsonLength(&entriesArray[i]);
+    }
+    TEST_ASSERT_EQUAL_INT(expectedLen, payloadLen);
+}
+
+static void testEmpty(void)
+{
+    checkGolden(NULL, 0);
+    TEST_ASSERT_EQUAL_STRING("{\"entries\":[]}", payloadBuffer);
+}
+
+static void testNumbers(void)
+{
+    static const double doubles[] = {
+        0.0, -0.0, 1.0, -1.0, 0.1, 21.5, 1.0 / 3.0, 2.0 / 3.0, 1e-7, 123456789.123, 1e15, 1e16, 1e21, 1e300,
+        -1e-300, DBL_MAX, DBL_MIN, 4.9e-324, 2147483647.0, 2147483648.0, -2147483648.0, -2147483649.0,
+        9007199254740993.0, 0.30000000000000004, NAN, INFINITY, -INFINITY,
+    };
+    static const int integers[] = { 0, 1, -1, 42, INT_MAX, INT_MIN, 1000000, -999999 };
+    static Entry_t entries[MAX_SITEWISE_ENTRY_SIZE];
+    size_t entriesLen = 0;
+    size_t count = sizeof(doubles) / sizeof(doubles[0]);
+
+    memset(entries, 0, sizeof(entries));
+    for (size_t i = 0; i < count; i++)
+    {
+        Entry_t *pEntry = &entries[i / MAX_SITEWISE_PROPERTY_VALUE_SIZE];
+
+        pEntry->assetId = "asset";
+        pEntry->propertyId = "double";
+        addValue(pEntry, doubleValue(doubles[i]));
+    }
+    entriesLen = (count + MAX_SITEWISE_PROPERTY_VALUE_SIZE - 1) / MAX_SITEWISE_PROPERTY_VALUE_SIZE;
+
+    entries[entriesLen].assetId = "asset";
+    entries[entriesLen].propertyId = "integer";
+    for (size_t i = 0; i < sizeof(integers) / sizeof(integers[0]); i++)
+    {
+        addValue(&entries[entriesLen], integerValue(integers[i]));
+    }
+    entriesLen++;
+
+    checkGolden(entries, entriesLen);
+}
+
+static void testStringsAndIdentifiers(void)
+{
+    static Entry_t entries[4];
+
+    memset(entries, 0, sizeof(entries));
+    entries[0].assetId = "asset \"quoted\" \\ slash";
+    entries[0].propertyId = "tab\there\nnewline";
+    addValue(&entries[0], stringValue("plain"));
+    addValue(&entries[0], stringValue(""));
+    addValue(&entries[0], stringValue("\x01\x1f\b\f\r control"));
+    addValue(&entries[0], stringValue("utf-8 \xc3\xa4\xe2\x82\xac / solidus"));
+    addValue(&entries[0], stringValue(NULL));
+
+    entries[1].propertyAlias = "/factory/line1/temperature";
+    entries[1].assetId = "ignored";
+    entries[1].propertyId = "ignored";
+    addValue(&entries[1], booleanValue(true));
+    addValue(&entries[1], booleanValue(false));
+
+    /* cJSON leaves out the members whose string is NULL */
+    entries[2].assetId = "asset";
+    entries[2].propertyId = NULL;
+    PropertyValue_t withOffset = doubleValue(20.25);
+    withOffset.offsetInNanos = 999999999;
+    addValue(&entries[2], withOffset);
+
+    entries[3].assetId = "asset";
+    entries[3].propertyId = "empty";
+
+    checkGolden(entries, 4);
+}
+
+static void testEntryIds(void)
+{
+    static Entry_t entries[MAX_SITEWISE_ENTRY_SIZE];
+
+    memset(entries, 0, sizeof(entries));
+    for (size_t i = 0; i < MAX_SITEWISE_ENTRY_SIZE; i++)
+    {
+        entries[i].assetId = "asset";
+        entries[i].propertyId = "property";
+        addValue(&entries[i], integerValue((int)i));
+    }
+    checkGolden(entries, MAX_SITEWISE_ENTRY_SIZE);
+
+    for (size_t i = 0; i < MAX_SITEWISE_ENTRY_SIZE; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(SITEWISE_ENTRY_ID_LENGTH, strlen(entries[i].entryId));
+        TEST_ASSERT_EQUAL_INT(SITEWISE_ENTRY_ID_LENGTH, strspn(entries[i].entryId, "0123456789abcdef"));
+        for (size_t j = 0; j < i; j++)
+        {
+            TEST_ASSERT(strcmp(entries[i].entryId, entries[j].entryId) != 0);
+        }
+    }
+}
+
+typedef struct ChunkCollector
+{
+    char buffer[TEST_PAYLOAD_BUFFER_SIZE];
+    size_t len;
+    size_t chunks;
+} ChunkCollector_t;
+
+static void collectChunk(const char *pChunk, size_t chunkLen, void *pUserData)
+{
+    ChunkCollector_t *pCollector = (ChunkCollector_t *)pUserData;
+
+    memcpy(pCollector->buffer + pCollector->len, pChunk, chunkLen);
+    pCollector->len += chunkLen;
+    pCollector->chunks++;
+}
+
+static void testStreamingChunks(void)
+{
+    static Entry_t entries[3];
+    static ChunkCollector_t collector;
+    size_t payloadLen = 0;
+
+    memset(entries, 0, sizeof(entries));
+    memset(&collector, 0, sizeof(collector));
+    for (size_t i = 0; i < 3; i++)
+    {
+        entries[i].assetId = "asset";
+        entries[i].propertyId = "property";
+        addValue(&entries[i], doubleValue(i + 0.5));
+    }
+
+    TEST_ASSERT_EQUAL_INT(SITEWISE_ERROR_NONE,
+                          Sitewise_printEntriesAsJsonStreaming(payloadBuffer, sizeof(payloadBuffer), entries, 3,
+                                                               collectChunk, &collector, &payloadLen));
+    TEST_ASSERT_EQUAL_INT(payloadLen, collector.len);
+    TEST_ASSERT(memcmp(payloadBuffer, collector.buffer, payloadLen) == 0);
+    /* One chunk per entry, and one for the closing brackets */
+    TEST_ASSERT_EQUAL_INT(4, collector.chunks);
+}
+
+static void testBufferTooSmall(void)
+{
+    static Entry_t entry;
+    size_t payloadLen = 0;
+
+    memset(&entry, 0, sizeof(entry));
+    entry.assetId = "asset";
+    entry.propertyId = "property";
+    addValue(&entry, doubleValue(1.5));
+
+    TEST_ASSERT_EQUAL_INT(SITEWISE_ERROR_NONE,
+                          Sitewise_printEntriesAsJsonStreaming(payloadBuffer, sizeof(payloadBuffer), &entry, 1, NULL, NULL, &payloadLen));
+
+    /* The document and its terminator fit exactly, one byte less doesn't */
+    TEST_ASSERT_EQUAL_INT(SITEWISE_ERROR_NONE, Sitewise_printEntriesAsJson(payloadBuffer, payloadLen + 1, &entry, 1));
+    TEST_ASSERT_EQUAL_INT(payloadLen, strlen(payloadBuffer));
+    TEST_ASSERT_EQUAL_INT(SITEWISE_ERROR_BUFFER_TOO_SMALL, Sitewise_printEntriesAsJson(payloadBuffer, payloadLen, &entry, 1));
+    TEST_ASSERT_EQUAL_STRING("", payloadBuffer);
+}
+
+static void testTooManyEntries(void)
+{
+    static Entry_t entries[MAX_SITEWISE_ENTRY_SIZE + 1];
+
+    memset(entries, 0, sizeof(entries));
+    for (size_t i = 0; i < MAX_SITEWISE_ENTRY_SIZE + 1; i++)
+    {
+        entries[i].assetId = "asset";
+        entries[i].propertyId = "property";
+        addValue(&entries[i], integerValue((int)i));
+    }
+
+    /* More entries than a request takes are refused before any entry ID is written */
+    TEST_ASSERT_EQUAL_INT(SITEWISE_ERROR_INVALID_PARAMETER,
+                          Sitewise_printEntriesAsJson(payloadBuffer, sizeof(payloadBuffer), entries, MAX_SITEWISE_ENTRY_SIZE + 1));
+    TEST_ASSERT_EQUAL_STRING("", payloadBuffer);
+    for (size_t i = 0; i < MAX_SITEWISE_ENTRY_SIZE + 1; i++)
+    {
+        TEST_ASSERT_EQUAL_STRING("", entries[i].entryId);
+    }
+
+    checkGolden(entries, MAX_SITEWISE_ENTRY_SIZE);
+}
+
+typedef struct FailedValue
+{
+    size_t entryIndex;
+    size_t propertyValueIndex;
+    char errorCode[48];
+} FailedValue_t;
+
+typedef struct FailedValues
+{
+    FailedValue_t values[32];
+    size_t len;
+} FailedValues_t;
+
+static void collectFailedValue(size_t entryIndex, size_t propertyValueIndex, const char *errorCode, void *pUserData)
+{
+    FailedValues_t *pFailed = (FailedValues_t *)pUserData;
+
+    if (pFailed->len < sizeof(pFailed->values) / sizeof(pFailed->values[0]))
+    {
+        pFailed->values[pFailed->len].entryIndex = entryIndex;
+        pFailed->values[pFailed->len].propertyValueIndex = propertyValueIndex;
+        snprintf(pFailed->values[pFailed->len].errorCode, sizeof(pFailed->values[0].errorCode), "%s", errorCode);
+    }
+    pFailed->len++;
+}
+
+static void checkFailedValue(FailedValues_t *pFailed, size_t index, size_t entryIndex, size_t propertyValueIndex,
+                             const char *errorCode)
+{
+    TEST_ASSERT(index < pFailed->len);
+    TEST_ASSERT_EQUAL_INT(entryIndex, pFailed->values[index].entryIndex);
+    TEST_ASSERT_EQUAL_INT(propertyValueIndex, pFailed->values[index].propertyValueIndex);
+    TEST_ASSERT_EQUAL_STRING(errorCode, pFailed->values[index].errorCode);
+}
+
+/**
+ * Two entries of three values each, one second apart, serialized so that they have their entry IDs.
+ */
+static void makeSentEntries(Entry_t entries[2])
+{
+    memset(entries, 0, 2 * sizeof(Entry_t));
+    for (size_t i = 0; i < 2; i++)
+    {
+        entries[i].assetId = "asset";
+        entries[i].propertyId = (i == 0) ? "temperature" : "humidity";
+        for (int j = 0; j < 3; j++)
+        {
+            PropertyValue_t propertyValue = doubleValue(20.0 + j);
+            propertyValue.timeInSeconds += j;
+            propertyValue.offsetInNanos = 500000000;
+            addValue(&entries[i], propertyValue);
+        }
+    }
+    TEST_ASSERT_EQUAL_INT(SITEWISE_ERROR_NONE, Sitewise_printEntriesAsJson(payloadBuffer, sizeof(payloadBuffer), entries, 2));
+}
+
+static void testParseErrorEntries(void)
+{
+    static Entry_t entries[2];
+    static FailedValues_t failed;
+    char response[1024];
+
+    makeSentEntries(entries);
+    memset(&failed, 0, sizeof(failed));
+
+    /* Throttled values by their exact timestamp in the second entry, an invalid value in the first one, and an entry
+     * that wasn't sent */
+    snprintf(response, sizeof(response),
+             "{\"errorEntries\":["
+             "{\"entryId\":\"%s\",\"errors\":[{\"errorCode\":\"ThrottlingException\",\"errorMessage\":\"Rate exceeded\","
+             "\"timestamps\":[{\"timeInSeconds\":1714564800,\"offsetInNanos\":500000000},"
+             "{\"timeInSeconds\":1714564802,\"offsetInNanos\":500000000}]}]},"
+             "{\"entryId\":\"00000000000000000000000000000000\",\"errors\":[{\"errorCode\":\"ThrottlingException\","
+             "\"timestamps\":[{\"timeInSeconds\":1714564800,\"offsetInNanos\":500000000}]}]},"
+             "{\"entryId\":\"%s\",\"errors\":[{\"errorCode\":\"InvalidRequestException\","
+             "\"timestamps\":[{\"timeInSeconds\":1714564801,\"offsetInNanos\":500000000}]}]}]}",
+             entries[1].entryId, entries[0].entryId);
+
+    TEST_ASSERT_EQUAL_INT(SITEWISE_ERROR_NONE,
+                          Sitewise_parseErrorEntries(response, strlen(response), entries, 2, collectFailedValue, &failed));
+    TEST_ASSERT_EQUAL_INT(3, failed.len);
+    checkFailedValue(&failed, 0, 1, 0, "ThrottlingException");
+    checkFailedValue(&failed, 1, 1, 2, "ThrottlingException");
+    checkFailedValue(&failed, 2, 0, 1, "InvalidRequestException");
+    TEST_ASSERT(Sitewise_isRetryableError(failed.values[0].errorCode));
+    TEST_ASSERT(!Sitewise_isRetryableError(failed.values[2].errorCode));
+}
+
+static void testParseErrorEntriesTimestamps(void)
+{
+    static Entry_t entries[2];
+    static FailedValues_t failed;
+    char response[1024];
+
+    makeSentEntries(entries);
+    memset(&failed, 0, sizeof(failed));
+
+    /* A timestamp without offsetInNanos matches any offset, one with another offset matches nothing, an error without
+     * timestamps is about all values of the entry, and an error without a code still counts */
+    snprintf(response, sizeof(response),
+             "{\"errorEntries\":["
+             "{\"entryId\":\"%s\",\"errors\":["
+             "{\"errorCode\":\"TimestampOutOfRangeException\",\"timestamps\":[{\"timeInSeconds\":1714564801}]},"
+             "{\"errorCode\":\"ThrottlingException\",\"timestamps\":[{\"timeInSeconds\":1714564802,\"offsetInNanos\":0}]}]},"
+             "{\"entryId\":\"%s\",\"errors\":[{\"errorCode\":\"InternalFailureException\"},{\"timestamps\":[]}]}]}",
+             entries[0].entryId, entries[1].entryId);
+
+    TEST_ASSERT_EQUAL_INT(SITEWISE_ERROR_NONE,
+                          Sitewise_parseErrorEntries(response, strlen(response), entries, 2, collectFailedValue, &failed));
+    TEST_ASSERT_EQUAL_INT(7, failed.len);
+    checkFailedValue(&failed, 0, 0, 1, "TimestampOutOfRangeException");
+    for (size_t i = 0; i < 3; i++)
+    {
+        checkFailedValue(&failed, 1 + i, 1, i, "InternalFailureException");
+        checkFailedValue(&failed, 4 + i, 1, i, "");
+    }
+}
+
+static void testParseErrorEntriesMalformed(void)
+{
+    static Entry_t entries[2];
+    static FailedValues_t failed;
+    char response[1024];
+    static const char *malformed[] = {
+        "",
+        "not json",
+        "{\"errorEntries\":{}}",
+        "{\"entries\":[]}",
+        "[]",
+    };
+
+    makeSentEntries(entries);
+    memset(&failed, 0, sizeof(failed));
+
+    for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++)
+    {
+        TEST_ASSERT_EQUAL_INT(SITEWISE_ERROR_CJSON,
+                              Sitewise_parseErrorEntries(malformed[i], strlen(malformed[i]), entries, 2, collectFailedValue, &failed));
+    }
+
+    /* Cut short anywhere, e.g. by the receiving buffer, the response is rejected before a single value is reported */
+    snprintf(response, sizeof(response),
+             "{\"errorEntries\":[{\"entryId\":\"%s\",\"errors\":[{\"errorCode\":\"ThrottlingException\","
+             "\"timestamps\":[{\"timeInSeconds\":1714564800,\"offsetInNanos\":500000000}]}]}]}",
+             entries[0].entryId);
+    for (size_t len = 0; len < strlen(response); len++)
+    {
+        TEST_ASSERT_EQUAL_INT(SITEWISE_ERROR_CJSON,
+                              Sitewise_parseErrorEntries(response, len, entries, 2, collectFailedValue, &failed));
+    }
+    TEST_ASSERT_EQUAL_INT(0, failed.len);
+
+    /* Entries of the wrong shape are skipped */
+    snprintf(response, sizeof(response),
+             "{\"errorEntries\":[1,{\"entryId\":7},{\"entryId\":\"%s\",\"errors\":\"none\"},"
+             "{\"entryId\":\"%s\",\"errors\":[{\"errorCode\":\"ThrottlingException\",\"timestamps\":[{\"timeInSeconds\":\"1714564800\"}]}]}]}",
+             entries[0].entryId, entries[1].entryId);
+    TEST_ASSERT_EQUAL_INT(SITEWISE_ERROR_NONE,
+                          Sitewise_parseErrorEntries(response, strlen(response), entries, 2, collectFailedValue, &failed));
+    TEST_ASSERT_EQUAL_INT(0, failed.len);
+
+    /* A response without errors */
+    snprintf(response, sizeof(response), "{\"errorEntries\":[]}");
+    TEST_ASSERT_EQUAL_INT(SITEWISE_ERROR_NONE,
+                          Sitewise_parseErrorEntries(response, strlen(response), entries, 2, collectFailedValue, &failed));
+    TEST_ASSERT_EQUAL_INT(0, failed.len);
+}
+
+static void testRetryableErrors(void)
+{
+    static const char *retryable[] = {
+        "ThrottlingException", "LimitExceededException", "InternalFailureException", "ServiceUnavailableException",
+        "ConflictingOperationException",
+    };
+    static const char *permanent[] = {
+        "TimestampOutOfRangeException", "InvalidRequestException", "ResourceNotFoundException", "AccessDeniedException",
+        "", "throttlingexception", "ThrottlingExceptionX",
+    };
+
+    for (size_t i = 0; i < sizeof(retryable) / sizeof(retryable[0]); i++)
+    {
+        TEST_ASSERT(Sitewise_isRetryableError(retryable[i]));
+    }
+    for (size_t i = 0; i < sizeof(permanent) / sizeof(permanent[0]); i++)
+    {
+        TEST_ASSERT(!Sitewise_isRetryableError(permanent[i]));
+    }
+}
+
+int main(void)
+{
+    RUN_TEST(testEmpty);
+    RUN_TEST(testNumbers);
+    RUN_TEST(testStringsAndIdentifiers);
+    RUN_TEST(testEntryIds);
+    RUN_TEST(testStreamingChunks);
+    RUN_TEST(testBufferTooSmall);
+    RUN_TEST(testTooManyEntries);
+    RUN_TEST(testParseErrorEntries);
+    RUN_TEST(testParseErrorEntriesTimestamps);
+    RUN_TEST(testParseErrorEntriesMalformed);
+    RUN_TEST(testRetryableErrors);
+
+    return HOST_TEST_RESULT();
+}
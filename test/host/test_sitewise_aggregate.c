@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "sitewise_aggregate.h"
+
+#define TEST_WINDOW_MS (1000)
+#define TEST_OUTPUTS_MAX (16)
+
+/* Far past every window of the tests, to close whatever a test has left open */
+#define TEST_END_MS (1000000000000LL)
+
+typedef struct Outputs
+{
+    size_t count;
+    size_t sourceIndex[TEST_OUTPUTS_MAX];
+    PropertyValue_t values[TEST_OUTPUTS_MAX];
+} Outputs_t;
+
+static char *allPropertyIds[SITEWISE_AGGREGATE_KIND_SIZE] = { "min", "max", "mean", "count" };
+
+static void collect(size_t sourceIndex, PropertyValue_t *pPropertyValue, void *pUserData)
+{
+    Outputs_t *pOutputs = (Outputs_t *)pUserData;
+
+    if (pOutputs->count < TEST_OUTPUTS_MAX)
+    {
+        pOutputs->sourceIndex[pOutputs->count] = sourceIndex;
+        pOutputs->values[pOutputs->count] = *pPropertyValue;
+        pOutputs->count++;
+    }
+}
+
+static PropertyValue_t *findOutput(Outputs_t *pOutputs, size_t sourceIndex)
+{
+    for (size_t i = 0; i < pOutputs->count; i++)
+    {
+        if (pOutputs->sourceIndex[i] == sourceIndex)
+        {
+            return &(pOutputs->values[i]);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Register a pushed source with an aggregate of every statistic.
+ *
+ * @param[out] pFirstOutput Source index of the min output, the others follow in the order of their kind
+ * @return The index of the source
+ */
+static size_t registerAggregate(bool keepRaw, size_t *pFirstOutput)
+{
+    int sourceIndex = SitewiseSource_register("asset", "raw", 0, NULL, NULL);
+
+    TEST_ASSERT(sourceIndex >= 0);
+    *pFirstOutput = SitewiseSource_getCount();
+    TEST_ASSERT_EQUAL_INT(SITEWISE_AGGREGATE_ERROR_NONE,
+                          SitewiseAggregate_register((size_t)sourceIndex, TEST_WINDOW_MS, keepRaw, "asset", allPropertyIds));
+    return (size_t)sourceIndex;
+}
+
+static bool process(size_t sourceIndex, double value, int64_t nowMs, Outputs_t *pOutputs)
+{
+    PropertyValue_t propertyValue = { .type = PROPERTY_VALUE_TYPE_DOUBLE, .doubleValue = value };
+
+    propertyValue.timeInSeconds = (long)(nowMs / 1000);
+    propertyValue.offsetInNanos = (long)(nowMs % 1000) * 1000000;
+    return SitewiseAggregate_process(sourceIndex, &propertyValue, nowMs, collect, pOutputs);
+}
+
+static void closeAll(void)
+{
+    Outputs_t outputs = { 0 };
+
+    SitewiseAggregate_poll(TEST_END_MS, collect, &outputs);
+    TEST_ASSERT_EQUAL_INT(UINT32_MAX, SitewiseAggregate_poll(TEST_END_MS, collect, &outputs));
+}
+
+static void testStatistics(void)
+{
+    Outputs_t outputs = { 0 };
+    size_t firstOutput = 0;
+    size_t sourceIndex = registerAggregate(false, &firstOutput);
+    PropertyValue_t integerValue = { .type = PROPERTY_VALUE_TYPE_INTEGER, .integerValue = -4 };
+    PropertyValue_t *pOutput = NULL;
+
+    process(sourceIndex, 3.0, 10000, &outputs);
+    process(sourceIndex, 7.5, 10100, &outputs);
+    SitewiseAggregate_process(sourceIndex, &integerValue, 10200, collect, &outputs);
+    process(sourceIndex, 2.5, 10300, &outputs);
+    TEST_ASSERT_EQUAL_INT(0, outputs.count);
+
+    process(sourceIndex, 100.0, 11000, &outputs);
+    TEST_ASSERT_EQUAL_INT(SITEWISE_AGGREGATE_KIND_SIZE, outputs.count);
+
+    pOutput = findOutput(&outputs, firstOutput + SITEWISE_AGGREGATE_MIN);
+    TEST_ASSERT(pOutput != NULL && pOutput->type == PROPERTY_VALUE_TYPE_DOUBLE && pOutput->doubleValue == -4.0);
+    pOutput = findOutput(&outputs, firstOutput + SITEWISE_AGGREGATE_MAX);
+    TEST_ASSERT(pOutput != NULL && pOutput->doubleValue == 7.5);
+    pOutput = findOutput(&outputs, firstOutput + SITEWISE_AGGREGATE_MEAN);
+    TEST_ASSERT(pOutput != NULL && pOutput->doubleValue == 2.25);
+    pOutput = findOutput(&outputs, firstOutput + SITEWISE_AGGREGATE_COUNT);
+    TEST_ASSERT(pOutput != NULL && pOutput->type == PROPERTY_VALUE_TYPE_INTEGER);
+    TEST_ASSERT_EQUAL_INT(4, (pOutput != NULL) ? pOutput->integerValue : 0);
+
+    /* The statistics carry the timestamp of the first value of their window */
+    for (size_t i = 0; i < outputs.count; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(10, outputs.values[i].timeInSeconds);
+        TEST_ASSERT_EQUAL_INT(0, outputs.values[i].offsetInNanos);
+    }
+
+    /* The value that closed the window opens the next one */
+    outputs.count = 0;
+    SitewiseAggregate_poll(12000, collect, &outputs);
+    pOutput = findOutput(&outputs, firstOutput + SITEWISE_AGGREGATE_MEAN);
+    TEST_ASSERT(pOutput != NULL && pOutput->doubleValue == 100.0);
+    pOutput = findOutput(&outputs, firstOutput + SITEWISE_AGGREGATE_COUNT);
+    TEST_ASSERT_EQUAL_INT(1, (pOutput != NULL) ? pOutput->integerValue : 0);
+
+    closeAll();
+}
+
+static void testWindowAlignment(void)
+{
+    Outputs_t outputs = { 0 };
+    size_t firstOutput = 0;
+    size_t sourceIndex = registerAggregate(false, &firstOutput);
+    PropertyValue_t *pOutput = NULL;
+
+    /* A window opened in its middle still ends at the next multiple of its length */
+    process(sourceIndex, 1.0, 20750, &outputs);
+    TEST_ASSERT_EQUAL_INT(250, SitewiseAggregate_poll(20750, collect, &outputs));
+    process(sourceIndex, 2.0, 20999, &outputs);
+    TEST_ASSERT_EQUAL_INT(0, outputs.count);
+    process(sourceIndex, 3.0, 21000, &outputs);
+    pOutput = findOutput(&outputs, firstOutput + SITEWISE_AGGREGATE_COUNT);
+    TEST_ASSERT_EQUAL_INT(2, (pOutput != NULL) ? pOutput->integerValue : 0);
+    TEST_ASSERT_EQUAL_INT(1000, SitewiseAggregate_poll(21000, collect, &outputs));
+
+    /* A gap without values leaves no empty windows behind */
+    outputs.count = 0;
+    process(sourceIndex, 4.0, 25500, &outputs);
+    pOutput = findOutput(&outputs, firstOutput + SITEWISE_AGGREGATE_COUNT);
+    TEST_ASSERT_EQUAL_INT(SITEWISE_AGGREGATE_KIND_SIZE, outputs.count);
+    TEST_ASSERT_EQUAL_INT(1, (pOutput != NULL) ? pOutput->integerValue : 0);
+    TEST_ASSERT_EQUAL_INT(500, SitewiseAggregate_poll(25500, collect, &outputs));
+
+    closeAll();
+}
+
+static void testPollFlush(void)
+{
+    Outputs_t outputs = { 0 };
+    size_t firstOutput = 0;
+    size_t sourceIndex = registerAggregate(true, &firstOutput);
+    PropertyValue_t *pOutput = NULL;
+
+    TEST_ASSERT_EQUAL_INT(UINT32_MAX, SitewiseAggregate_poll(30000, collect, &outputs));
+
+    process(sourceIndex, 8.0, 30100, &outputs);
+    process(sourceIndex, 6.0, 30200, &outputs);
+    TEST_ASSERT_EQUAL_INT(700, SitewiseAggregate_poll(30300, collect, &outputs));
+    TEST_ASSERT_EQUAL_INT(1, SitewiseAggregate_poll(30999, collect, &outputs));
+    TEST_ASSERT_EQUAL_INT(0, outputs.count);
+
+    /* A source that stops being sampled still gets its last window closed */
+    TEST_ASSERT_EQUAL_INT(UINT32_MAX, SitewiseAggregate_poll(31000, collect, &outputs));
+    TEST_ASSERT_EQUAL_INT(SITEWISE_AGGREGATE_KIND_SIZE, outputs.count);
+    pOutput = findOutput(&outputs, firstOutput + SITEWISE_AGGREGATE_MEAN);
+    TEST_ASSERT(pOutput != NULL && pOutput->doubleValue == 7.0);
+
+    /* Closed only once */
+    TEST_ASSERT_EQUAL_INT(UINT32_MAX, SitewiseAggregate_poll(32000, collect, &outputs));
+    TEST_ASSERT_EQUAL_INT(SITEWISE_AGGREGATE_KIND_SIZE, outputs.count);
+}
+
+static void testKeepRaw(void)
+{
+    Outputs_t outputs = { 0 };
+    size_t firstOutput = 0;
+    size_t rawIndex = registerAggregate(true, &firstOutput);
+    size_t aggregatedIndex = registerAggregate(false, &firstOutput);
+    int plainIndex = SitewiseSource_register("asset", "plain", 0, NULL, NULL);
+    PropertyValue_t stringValue = { .type = PROPERTY_VALUE_TYPE_STRING, .stringValue = "on" };
+
+    TEST_ASSERT(process(rawIndex, 1.0, 40000, &outputs));
+    TEST_ASSERT(!process(aggregatedIndex, 1.0, 40000, &outputs));
+    TEST_ASSERT(process((size_t)plainIndex, 1.0, 40000, &outputs));
+
+    /* Values without statistics are always uploaded as they are */
+    TEST_ASSERT(SitewiseAggregate_process(aggregatedIndex, &stringValue, 40100, collect, &outputs));
+
+    /* The raw values are dropped if any aggregate of the source drops them */
+    TEST_ASSERT_EQUAL_INT(SITEWISE_AGGREGATE_ERROR_NONE,
+                          SitewiseAggregate_register(rawIndex, TEST_WINDOW_MS, false, "asset", allPropertyIds));
+    TEST_ASSERT(!process(rawIndex, 2.0, 40200, &outputs));
+    TEST_ASSERT_EQUAL_INT(0, outputs.count);
+
+    closeAll();
+}
+
+static void testOutputs(void)
+{
+    Outputs_t outputs = { 0 };
+    int sourceIndex = SitewiseSource_register("asset", "raw", 0, NULL, NULL);
+    size_t firstOutput = SitewiseSource_getCount();
+    char *propertyIds[SITEWISE_AGGREGATE_KIND_SIZE] = { NULL, "max", "", "count" };
+
+    TEST_ASSERT_EQUAL_INT(SITEWISE_AGGREGATE_ERROR_NOT_FOUND,
+                          SitewiseAggregate_register(MAX_SITEWISE_SOURCE_SIZE, TEST_WINDOW_MS, false, "asset", propertyIds));
+
+    /* The statistics left out don't get a source */
+    TEST_ASSERT_EQUAL_INT(SITEWISE_AGGREGATE_ERROR_NONE,
+                          SitewiseAggregate_register((size_t)sourceIndex, TEST_WINDOW_MS, false, "asset", propertyIds));
+    TEST_ASSERT_EQUAL_INT(firstOutput + 2, SitewiseSource_getCount());
+    TEST_ASSERT_EQUAL_STRING("max", SitewiseSource_get(firstOutput)->propertyId);
+    TEST_ASSERT_EQUAL_STRING("count", SitewiseSource_get(firstOutput + 1)->propertyId);
+
+    process((size_t)sourceIndex, 5.0, 50000, &outputs);
+    SitewiseAggregate_poll(51000, collect, &outputs);
+    TEST_ASSERT_EQUAL_INT(2, outputs.count);
+    TEST_ASSERT(findOutput(&outputs, firstOutput) != NULL && findOutput(&outputs, firstOutput)->doubleValue == 5.0);
+    TEST_ASSERT(findOutput(&outputs, firstOutput + 1) != NULL && findOutput(&outputs, firstOutput + 1)->integerValue == 1);
+}
+
+static void testFull(void)
+{
+    char *propertyIds[SITEWISE_AGGREGATE_KIND_SIZE] = { NULL, NULL, NULL, NULL };
+    int result = SITEWISE_AGGREGATE_ERROR_NONE;
+    int registered = 0;
+
+    while (result == SITEWISE_AGGREGATE_ERROR_NONE && registered <= MAX_SITEWISE_AGGREGATE_SIZE)
+    {
+        result = SitewiseAggregate_register(0, TEST_WINDOW_MS, true, "asset", propertyIds);
+        registered++;
+    }
+    TEST_ASSERT_EQUAL_INT(SITEWISE_AGGREGATE_ERROR_FULL, result);
+}
+
+int main(void)
+{
+    RUN_TEST(testStatistics);
+    RUN_TEST(testWindowAlignment);
+    RUN_TEST(testPollFlush);
+    RUN_TEST(testKeepRaw);
+    RUN_TEST(testOutputs);
+    RUN_TEST(testFull);
+
+    return HOST_TEST_RESULT();
+}
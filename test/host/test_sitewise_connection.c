@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "esp_http_client.h"
+
+#include "host_test.h"
+#include "sitewise_connection.h"
+
+#define TEST_BODY "{\"entries\":[]}"
+#define TEST_RESPONSE "{\"errorEntries\":[]}"
+
+/**
+ * A stand-in of the endpoint behind the HTTP client, with the state of its connection. Like the client of ESP-IDF, it
+ * opens a connection only if there is none, and reports a new one through the event of the connection.
+ */
+typedef struct StandIn
+{
+    SitewiseConnection_t *pConnection;
+
+    /* The behaviour */
+    bool refuseConnect;     /* No new connection can be opened */
+    bool stale;             /* The server has closed the open connection, which fails when it is used */
+    int failWrites;         /* Number of writes to fail */
+    bool incomplete;        /* The response is larger than what is read of it */
+    int statusCode;
+    const char *pResponse;
+
+    /* The state */
+    bool connected;
+    int opens;
+    int connects;
+    int closes;
+    int writtenLen;
+} StandIn_t;
+
+static StandIn_t standIn;
+
+static void resetStandIn(SitewiseConnection_t *pConnection, char *pRecvBuffer, size_t recvBufferSize)
+{
+    memset(&standIn, 0, sizeof(standIn));
+    standIn.pConnection = pConnection;
+    standIn.statusCode = 200;
+    standIn.pResponse = TEST_RESPONSE;
+
+    memset(pConnection, 0, sizeof(*pConnection));
+    SitewiseConnection_init(pConnection, (esp_http_client_handle_t)&standIn, pRecvBuffer, recvBufferSize);
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len)
+{
+    standIn.opens++;
+    if (!standIn.connected)
+    {
+        if (standIn.refuseConnect)
+        {
+            return ESP_ERR_HTTP_CONNECT;
+        }
+        standIn.connected = true;
+        standIn.stale = false;
+        standIn.connects++;
+        SitewiseConnection_onConnected(standIn.pConnection);
+    }
+    return ESP_OK;
+}
+
+int esp_http_client_write(esp_http_client_handle_t client, const char *buffer, int len)
+{
+    if (standIn.failWrites > 0)
+    {
+        standIn.failWrites--;
+        return -1;
+    }
+    standIn.writtenLen = len;
+    return len;
+}
+
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t client)
+{
+    /* A connection closed by the server is only noticed when the response doesn't come. */
+    return standIn.stale ? -1 : (int64_t)strlen(standIn.pResponse);
+}
+
+int esp_http_client_read_response(esp_http_client_handle_t client, char *buffer, int len)
+{
+    int n = (int)strlen(standIn.pResponse);
+
+    n = (n < len) ? n : len;
+    memcpy(buffer, standIn.pResponse, (size_t)n);
+    return n;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client)
+{
+    return standIn.statusCode;
+}
+
+int64_t esp_http_client_get_content_length(esp_http_client_handle_t client)
+{
+    return (int64_t)strlen(standIn.pResponse);
+}
+
+bool esp_http_client_is_complete_data_received(esp_http_client_handle_t client)
+{
+    return !standIn.incomplete;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client)
+{
+    standIn.connected = false;
+    standIn.closes++;
+    return ESP_OK;
+}
+
+static esp_err_t sendBody(SitewiseConnection_t *pConnection, int *pStatusCode)
+{
+    *pStatusCode = 0;
+    return SitewiseConnection_send(pConnection, TEST_BODY, strlen(TEST_BODY), pStatusCode);
+}
+
+static void testReused(void)
+{
+    SitewiseConnection_t connection;
+    char recvBuffer[64];
+    int statusCode = 0;
+
+    resetStandIn(&connection, recvBuffer, sizeof(recvBuffer));
+    TEST_ASSERT_EQUAL_STRING("", recvBuffer);
+    for (int i = 0; i < 3; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(ESP_OK, sendBody(&connection, &statusCode));
+        TEST_ASSERT_EQUAL_INT(200, statusCode);
+        TEST_ASSERT_EQUAL_STRING(TEST_RESPONSE, recvBuffer);
+    }
+
+    TEST_ASSERT_EQUAL_INT(strlen(TEST_BODY), standIn.writtenLen);
+    TEST_ASSERT_EQUAL_INT(1, standIn.connects);
+    TEST_ASSERT_EQUAL_INT(0, standIn.closes);
+    TEST_ASSERT_EQUAL_INT(3, connection.stats.requests);
+    TEST_ASSERT_EQUAL_INT(1, connection.stats.handshakes);
+    TEST_ASSERT_EQUAL_INT(2, connection.stats.reused_requests);
+    TEST_ASSERT_EQUAL_INT(0, connection.stats.reconnects);
+}
+
+static void testServerClosedIdle(void)
+{
+    SitewiseConnection_t connection;
+    char recvBuffer[64];
+    int statusCode = 0;
+
+    resetStandIn(&connection, recvBuffer, sizeof(recvBuffer));
+    TEST_ASSERT_EQUAL_INT(ESP_OK, sendBody(&connection, &statusCode));
+
+    /* The request on the closed connection is sent again on a new one */
+    standIn.stale = true;
+    standIn.statusCode = 429;
+    TEST_ASSERT_EQUAL_INT(ESP_OK, sendBody(&connection, &statusCode));
+    TEST_ASSERT_EQUAL_INT(429, statusCode);
+    TEST_ASSERT_EQUAL_INT(1, standIn.closes);
+    TEST_ASSERT_EQUAL_INT(2, standIn.connects);
+    TEST_ASSERT_EQUAL_INT(2, connection.stats.requests);
+    TEST_ASSERT_EQUAL_INT(2, connection.stats.handshakes);
+    TEST_ASSERT_EQUAL_INT(0, connection.stats.reused_requests);
+    TEST_ASSERT_EQUAL_INT(1, connection.stats.reconnects);
+
+    /* The new connection is kept */
+    TEST_ASSERT_EQUAL_INT(ESP_OK, sendBody(&connection, &statusCode));
+    TEST_ASSERT_EQUAL_INT(2, connection.stats.handshakes);
+    TEST_ASSERT_EQUAL_INT(1, connection.stats.reused_requests);
+}
+
+static void testRetryFails(void)
+{
+    SitewiseConnection_t connection;
+    char recvBuffer[64];
+    int statusCode = 0;
+
+    resetStandIn(&connection, recvBuffer, sizeof(recvBuffer));
+    TEST_ASSERT_EQUAL_INT(ESP_OK, sendBody(&connection, &statusCode));
+
+    /* Retried once only, and the connection is closed after the failure */
+    standIn.failWrites = 2;
+    TEST_ASSERT_EQUAL_INT(ESP_FAIL, sendBody(&connection, &statusCode));
+    TEST_ASSERT_EQUAL_INT(3, standIn.opens);
+    TEST_ASSERT(!standIn.connected);
+    TEST_ASSERT_EQUAL_INT(2, connection.stats.requests);
+    TEST_ASSERT_EQUAL_INT(2, connection.stats.handshakes);
+    TEST_ASSERT_EQUAL_INT(1, connection.stats.reconnects);
+    TEST_ASSERT_EQUAL_INT(0, connection.stats.reused_requests);
+
+    TEST_ASSERT_EQUAL_INT(ESP_OK, sendBody(&connection, &statusCode));
+    TEST_ASSERT_EQUAL_INT(3, connection.stats.handshakes);
+    TEST_ASSERT_EQUAL_INT(0, connection.stats.reused_requests);
+}
+
+static void testNewConnectionFails(void)
+{
+    SitewiseConnection_t connection;
+    char recvBuffer[64];
+    int statusCode = 0;
+
+    /* A request that fails on a new connection isn't retried, whether the connection isn't made or breaks */
+    resetStandIn(&connection, recvBuffer, sizeof(recvBuffer));
+    standIn.refuseConnect = true;
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_HTTP_CONNECT, sendBody(&connection, &statusCode));
+    TEST_ASSERT_EQUAL_INT(1, standIn.opens);
+
+    standIn.refuseConnect = false;
+    standIn.failWrites = 1;
+    TEST_ASSERT_EQUAL_INT(ESP_FAIL, sendBody(&connection, &statusCode));
+    TEST_ASSERT_EQUAL_INT(2, standIn.opens);
+    TEST_ASSERT(!standIn.connected);
+
+    TEST_ASSERT_EQUAL_INT(2, connection.stats.requests);
+    TEST_ASSERT_EQUAL_INT(1, connection.stats.handshakes);
+    TEST_ASSERT_EQUAL_INT(0, connection.stats.reconnects);
+    TEST_ASSERT_EQUAL_INT(0, connection.stats.reused_requests);
+}
+
+static void testIncompleteResponse(void)
+{
+    SitewiseConnection_t connection;
+    char recvBuffer[8];
+    int statusCode = 0;
+
+    /* The rest of a response that doesn't fit would be read as the next response, so the connection is closed */
+    resetStandIn(&connection, recvBuffer, sizeof(recvBuffer));
+    standIn.incomplete = true;
+    TEST_ASSERT_EQUAL_INT(ESP_OK, sendBody(&connection, &statusCode));
+    TEST_ASSERT_EQUAL_STRING("{\"error", recvBuffer);
+    TEST_ASSERT(!standIn.connected);
+
+    standIn.incomplete = false;
+    TEST_ASSERT_EQUAL_INT(ESP_OK, sendBody(&connection, &statusCode));
+    TEST_ASSERT_EQUAL_INT(2, connection.stats.handshakes);
+    TEST_ASSERT_EQUAL_INT(0, connection.stats.reused_requests);
+    TEST_ASSERT_EQUAL_INT(0, connection.stats.reconnects);
+}
+
+int main(void)
+{
+    RUN_TEST(testReused);
+    RUN_TEST(testServerClosedIdle);
+    RUN_TEST(testRetryFails);
+    RUN_TEST(testNewConnectionFails);
+    RUN_TEST(testIncompleteResponse);
+
+    return HOST_TEST_RESULT();
+}
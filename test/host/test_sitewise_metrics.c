@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "host_test.h"
+#include "sitewise_metrics.h"
+#include "sitewise_source.h"
+
+#define TEST_THREADS (4)
+#define TEST_RECORDS_PER_THREAD (100000)
+
+static SitewiseHistogramSnapshot_t snapshotOf(const uint32_t *pValues, size_t valuesLen)
+{
+    SitewiseMetricsSnapshot_t snapshot;
+
+    SitewiseMetrics_getSnapshot(&snapshot);
+    for (size_t i = 0; i < valuesLen; i++)
+    {
+        SitewiseMetrics_record(SITEWISE_HISTOGRAM_SIGN, pValues[i]);
+    }
+    SitewiseMetrics_getSnapshot(&snapshot);
+    return snapshot.histograms[SITEWISE_HISTOGRAM_SIGN];
+}
+
+static int compareValues(const void *pA, const void *pB)
+{
+    uint32_t a = *(const uint32_t *)pA;
+    uint32_t b = *(const uint32_t *)pB;
+
+    return (a > b) - (a < b);
+}
+
+/**
+ * The exact percentile with the same rank as the histogram: the smallest value that at least percent of the values
+ * are equal to or below.
+ */
+static uint32_t exactPercentile(uint32_t *pValues, size_t valuesLen, uint32_t percent)
+{
+    size_t rank = (valuesLen * percent + 99) / 100;
+
+    qsort(pValues, valuesLen, sizeof(pValues[0]), compareValues);
+    return pValues[(rank > 0) ? rank - 1 : 0];
+}
+
+static void testBuckets(void)
+{
+    const uint32_t values[] = { 0, 1, 2, 3, 4, 7, 8, 1u << 29, 1u << 30, UINT32_MAX };
+    SitewiseHistogramSnapshot_t histogram = snapshotOf(values, sizeof(values) / sizeof(values[0]));
+
+    TEST_ASSERT_EQUAL_INT(10, histogram.count);
+    TEST_ASSERT_EQUAL_INT(25 + (1ULL << 29) + (1ULL << 30) + UINT32_MAX, histogram.sum);
+    TEST_ASSERT_EQUAL_INT(UINT32_MAX, histogram.max);
+    TEST_ASSERT_EQUAL_INT(1, histogram.buckets[0]);
+    TEST_ASSERT_EQUAL_INT(1, histogram.buckets[1]);
+    TEST_ASSERT_EQUAL_INT(2, histogram.buckets[2]);
+    TEST_ASSERT_EQUAL_INT(2, histogram.buckets[3]);
+    TEST_ASSERT_EQUAL_INT(1, histogram.buckets[4]);
+    TEST_ASSERT_EQUAL_INT(1, histogram.buckets[30]);
+
+    /* The last bucket takes the rest */
+    TEST_ASSERT_EQUAL_INT(2, histogram.buckets[SITEWISE_HISTOGRAM_BUCKET_SIZE - 1]);
+    TEST_ASSERT_EQUAL_INT(UINT32_MAX, SitewiseMetrics_getPercentile(&histogram, 100));
+}
+
+static void testSnapshotStartsOver(void)
+{
+    SitewiseMetricsSnapshot_t snapshot;
+
+    SitewiseMetrics_getSnapshot(&snapshot);
+    SitewiseMetrics_record(SITEWISE_HISTOGRAM_CONNECT, 1000);
+    SitewiseMetrics_record(SITEWISE_HISTOGRAM_CONNECT, 3000);
+    SitewiseMetrics_add(SITEWISE_COUNTER_THROTTLED, 2);
+
+    SitewiseMetrics_getSnapshot(&snapshot);
+    TEST_ASSERT_EQUAL_INT(2, snapshot.histograms[SITEWISE_HISTOGRAM_CONNECT].count);
+    TEST_ASSERT_EQUAL_INT(4000, snapshot.histograms[SITEWISE_HISTOGRAM_CONNECT].sum);
+    TEST_ASSERT_EQUAL_INT(3000, snapshot.histograms[SITEWISE_HISTOGRAM_CONNECT].max);
+    uint32_t throttled = snapshot.counters[SITEWISE_COUNTER_THROTTLED];
+
+    /* The histograms start over, the counters go on */
+    SitewiseMetrics_add(SITEWISE_COUNTER_THROTTLED, 1);
+    SitewiseMetrics_getSnapshot(&snapshot);
+    TEST_ASSERT_EQUAL_INT(0, snapshot.histograms[SITEWISE_HISTOGRAM_CONNECT].count);
+    TEST_ASSERT_EQUAL_INT(0, snapshot.histograms[SITEWISE_HISTOGRAM_CONNECT].max);
+    TEST_ASSERT_EQUAL_INT(0, SitewiseMetrics_getPercentile(&snapshot.histograms[SITEWISE_HISTOGRAM_CONNECT], 50));
+    TEST_ASSERT_EQUAL_INT(throttled + 1, snapshot.counters[SITEWISE_COUNTER_THROTTLED]);
+}
+
+static void testPercentiles(void)
+{
+    static uint32_t values[1000];
+    SitewiseHistogramSnapshot_t histogram;
+
+    for (uint32_t i = 0; i < 1000; i++)
+    {
+        values[i] = i + 1;
+    }
+    histogram = snapshotOf(values, 1000);
+
+    /* The upper bound of the bucket, but no more than the maximum */
+    TEST_ASSERT_EQUAL_INT(1, SitewiseMetrics_getPercentile(&histogram, 0));
+    TEST_ASSERT_EQUAL_INT(511, SitewiseMetrics_getPercentile(&histogram, 50));
+    TEST_ASSERT_EQUAL_INT(1000, SitewiseMetrics_getPercentile(&histogram, 99));
+    TEST_ASSERT_EQUAL_INT(1000, SitewiseMetrics_getPercentile(&histogram, 100));
+
+    /* A single value is its own percentile */
+    values[0] = 0;
+    histogram = snapshotOf(values, 1);
+    TEST_ASSERT_EQUAL_INT(0, SitewiseMetrics_getPercentile(&histogram, 50));
+    values[0] = 180;
+    histogram = snapshotOf(values, 1);
+    TEST_ASSERT_EQUAL_INT(180, SitewiseMetrics_getPercentile(&histogram, 99));
+}
+
+static void testPercentilesWithinBucket(void)
+{
+    static uint32_t values[5000];
+    const uint32_t percents[] = { 1, 10, 50, 90, 99, 100 };
+
+    srand(7);
+    for (int distribution = 0; distribution < 3; distribution++)
+    {
+        for (size_t i = 0; i < 5000; i++)
+        {
+            uint32_t r = (uint32_t)rand();
+
+            switch (distribution)
+            {
+            case 0:     /* Request times around 200 ms */
+                values[i] = 150000 + r % 100000;
+                break;
+            case 1:     /* Mostly fast, with a long tail */
+                values[i] = (r % 100 < 95) ? 50 + r % 50 : 10000 + r % 2000000;
+                break;
+            default:    /* Spread over every bucket */
+                values[i] = r >> (r % 31);
+                break;
+            }
+        }
+        SitewiseHistogramSnapshot_t histogram = snapshotOf(values, 5000);
+
+        /* Never below the exact percentile, and less than twice above it */
+        for (size_t p = 0; p < sizeof(percents) / sizeof(percents[0]); p++)
+        {
+            uint32_t exact = exactPercentile(values, 5000, percents[p]);
+            uint32_t reported = SitewiseMetrics_getPercentile(&histogram, percents[p]);
+
+            TEST_ASSERT(reported >= exact);
+            TEST_ASSERT((uint64_t)reported <= 2 * (uint64_t)exact);
+        }
+    }
+}
+
+static void *recordMany(void *pArg)
+{
+    uint32_t seed = (uint32_t)(uintptr_t)pArg;
+
+    for (uint32_t i = 0; i < TEST_RECORDS_PER_THREAD; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        SitewiseMetrics_record(SITEWISE_HISTOGRAM_REQUEST_RTT, seed >> 12);
+        SitewiseMetrics_add(SITEWISE_COUNTER_REQUESTS, 1);
+    }
+    return NULL;
+}
+
+static void testConcurrentRecords(void)
+{
+    pthread_t threads[TEST_THREADS];
+    SitewiseMetricsSnapshot_t snapshot;
+    uint64_t bucketsTotal = 0;
+    uint64_t sum = 0;
+
+    SitewiseMetrics_getSnapshot(&snapshot);
+    uint32_t requests = snapshot.counters[SITEWISE_COUNTER_REQUESTS];
+
+    for (uintptr_t i = 0; i < TEST_THREADS; i++)
+    {
+        pthread_create(&threads[i], NULL, recordMany, (void *)(i + 1));
+
+        /* The same values as the thread, whose sum is well beyond 32 bits */
+        uint32_t seed = (uint32_t)(i + 1);
+        for (uint32_t j = 0; j < TEST_RECORDS_PER_THREAD; j++)
+        {
+            seed = seed * 1103515245 + 12345;
+            sum += seed >> 12;
+        }
+    }
+    for (size_t i = 0; i < TEST_THREADS; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    /* No value is lost without a lock */
+    SitewiseMetrics_getSnapshot(&snapshot);
+    for (size_t bucket = 0; bucket < SITEWISE_HISTOGRAM_BUCKET_SIZE; bucket++)
+    {
+        bucketsTotal += snapshot.histograms[SITEWISE_HISTOGRAM_REQUEST_RTT].buckets[bucket];
+    }
+    TEST_ASSERT_EQUAL_INT(TEST_THREADS * TEST_RECORDS_PER_THREAD, snapshot.histograms[SITEWISE_HISTOGRAM_REQUEST_RTT].count);
+    TEST_ASSERT_EQUAL_INT(TEST_THREADS * TEST_RECORDS_PER_THREAD, bucketsTotal);
+    TEST_ASSERT(sum > UINT32_MAX);
+    TEST_ASSERT_EQUAL_INT(sum, snapshot.histograms[SITEWISE_HISTOGRAM_REQUEST_RTT].sum);
+    TEST_ASSERT_EQUAL_INT(requests + TEST_THREADS * TEST_RECORDS_PER_THREAD, snapshot.counters[SITEWISE_COUNTER_REQUESTS]);
+    TEST_ASSERT(snapshot.histograms[SITEWISE_HISTOGRAM_REQUEST_RTT].max >= (1u << 19));
+}
+
+static void testFormat(void)
+{
+    SitewiseMetricsSnapshot_t snapshot;
+    char line[SITEWISE_METRICS_FORMAT_SIZE];
+    size_t len = 0;
+
+    memset(&snapshot, 0, sizeof(snapshot));
+    snapshot.histograms[SITEWISE_HISTOGRAM_REQUEST_RTT].count = 12;
+    snapshot.histograms[SITEWISE_HISTOGRAM_REQUEST_RTT].max = 455;
+    snapshot.histograms[SITEWISE_HISTOGRAM_REQUEST_RTT].buckets[8] = 6;
+    snapshot.histograms[SITEWISE_HISTOGRAM_REQUEST_RTT].buckets[9] = 6;
+    snapshot.counters[SITEWISE_COUNTER_REQUESTS] = 12;
+
+    len = SitewiseMetrics_format(line, sizeof(line), &snapshot);
+    TEST_ASSERT_EQUAL_INT(strlen(line), len);
+    TEST_ASSERT(strncmp(line, "sample_to_enqueue_us=0/0/0/0 ", 29) == 0);
+    TEST_ASSERT(strstr(line, " request_rtt_us=12/255/455/455 ") != NULL);
+    TEST_ASSERT(strstr(line, " requests=12 ") != NULL);
+
+    /* Cut short, but terminated */
+    TEST_ASSERT(SitewiseMetrics_format(line, 20, &snapshot) >= 20);
+    TEST_ASSERT_EQUAL_INT(19, strlen(line));
+
+    /* The largest values fit the documented size */
+    for (size_t i = 0; i < SITEWISE_HISTOGRAM_SIZE; i++)
+    {
+        snapshot.histograms[i].count = UINT32_MAX;
+        snapshot.histograms[i].max = UINT32_MAX;
+        snapshot.histograms[i].buckets[SITEWISE_HISTOGRAM_BUCKET_SIZE - 1] = 1;
+    }
+    for (size_t i = 0; i < SITEWISE_COUNTER_SIZE; i++)
+    {
+        snapshot.counters[i] = UINT32_MAX;
+    }
+    TEST_ASSERT(SitewiseMetrics_format(line, sizeof(line), &snapshot) < sizeof(line));
+}
+
+typedef struct Published
+{
+    size_t len;
+    size_t sourceIndexes[64];
+    PropertyValue_t values[64];
+} Published_t;
+
+static void collect(size_t sourceIndex, PropertyValue_t *pPropertyValue, void *pUserData)
+{
+    Published_t *pPublished = (Published_t *)pUserData;
+
+    pPublished->sourceIndexes[pPublished->len] = sourceIndex;
+    pPublished->values[pPublished->len] = *pPropertyValue;
+    pPublished->len++;
+}
+
+static void testPublish(void)
+{
+    static Published_t published;
+    SitewiseMetricsSnapshot_t snapshot;
+    const char *alias = NULL;
+
+    TEST_ASSERT_EQUAL_INT(SITEWISE_METRICS_ERROR_NONE, SitewiseMetrics_registerProperties("/plant/node7/metrics"));
+
+    memset(&snapshot, 0, sizeof(snapshot));
+    snapshot.histograms[SITEWISE_HISTOGRAM_SIGN].count = 1;
+    snapshot.histograms[SITEWISE_HISTOGRAM_SIGN].max = 180;
+    snapshot.histograms[SITEWISE_HISTOGRAM_SIGN].buckets[8] = 1;
+    snapshot.counters[SITEWISE_COUNTER_RING_FULL] = 3;
+    SitewiseMetrics_publish(&snapshot, collect, &published);
+
+    /* The p50 and p99 of the one histogram with values, and every counter */
+    TEST_ASSERT_EQUAL_INT(2 + SITEWISE_COUNTER_SIZE, published.len);
+    alias = SitewiseSource_get(published.sourceIndexes[0])->propertyAlias;
+    TEST_ASSERT_EQUAL_STRING("/plant/node7/metrics/sign_us/p50", alias);
+    TEST_ASSERT_EQUAL_INT(PROPERTY_VALUE_TYPE_INTEGER, published.values[0].type);
+    TEST_ASSERT_EQUAL_INT(180, published.values[1].integerValue);
+
+    alias = SitewiseSource_get(published.sourceIndexes[2 + SITEWISE_COUNTER_RING_FULL])->propertyAlias;
+    TEST_ASSERT_EQUAL_STRING("/plant/node7/metrics/ring_full", alias);
+    TEST_ASSERT_EQUAL_INT(PROPERTY_VALUE_TYPE_DOUBLE, published.values[2 + SITEWISE_COUNTER_RING_FULL].type);
+    TEST_ASSERT(published.values[2 + SITEWISE_COUNTER_RING_FULL].doubleValue == 3.0);
+}
+
+int main(void)
+{
+    RUN_TEST(testBuckets);
+    RUN_TEST(testSnapshotStartsOver);
+    RUN_TEST(testPercentiles);
+    RUN_TEST(testPercentilesWithinBucket);
+    RUN_TEST(testConcurrentRecords);
+    RUN_TEST(testFormat);
+    RUN_TEST(testPublish);
+
+    return HOST_TEST_RESULT();
+}
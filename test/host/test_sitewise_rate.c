@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+#include "host_test.h"
+#include "sitewise_rate.h"
+
+static bool isClose(double expected, double actual)
+{
+    return fabs(expected - actual) < 1e-9;
+}
+
+static void testNoLimit(void)
+{
+    SitewiseRateLimiter_t limiter;
+
+    SitewiseRateLimiter_init(&limiter, 0, 0, 0);
+    for (int i = 0; i < 100; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(0, SitewiseRateLimiter_getDelay(&limiter, 10, 0));
+        SitewiseRateLimiter_consume(&limiter, 10, 0);
+    }
+    SitewiseRateLimiter_update(&limiter, true);
+    TEST_ASSERT_EQUAL_INT(0, SitewiseRateLimiter_getDelay(&limiter, 10, 0));
+    TEST_ASSERT_EQUAL_INT(1, limiter.throttled);
+}
+
+static void testStartDelay(void)
+{
+    SitewiseRateLimiter_t limiter;
+
+    SitewiseRateLimiter_init(&limiter, 0, 0, 1500);
+    TEST_ASSERT_EQUAL_INT(1500, SitewiseRateLimiter_getDelay(&limiter, 1, 0));
+    TEST_ASSERT_EQUAL_INT(1, SitewiseRateLimiter_getDelay(&limiter, 1, 1499));
+    TEST_ASSERT_EQUAL_INT(0, SitewiseRateLimiter_getDelay(&limiter, 1, 1500));
+}
+
+static void testRequests(void)
+{
+    SitewiseRateLimiter_t limiter;
+
+    /* Starts with a full bucket, one second worth of requests */
+    SitewiseRateLimiter_init(&limiter, 2, 0, 0);
+    TEST_ASSERT_EQUAL_INT(0, SitewiseRateLimiter_getDelay(&limiter, 1, 0));
+    SitewiseRateLimiter_consume(&limiter, 1, 0);
+    TEST_ASSERT_EQUAL_INT(0, SitewiseRateLimiter_getDelay(&limiter, 1, 0));
+    SitewiseRateLimiter_consume(&limiter, 1, 0);
+
+    /* Then refills at the rate */
+    TEST_ASSERT_EQUAL_INT(501, SitewiseRateLimiter_getDelay(&limiter, 1, 0));
+    TEST_ASSERT_EQUAL_INT(251, SitewiseRateLimiter_getDelay(&limiter, 1, 250));
+    TEST_ASSERT_EQUAL_INT(0, SitewiseRateLimiter_getDelay(&limiter, 1, 500));
+    SitewiseRateLimiter_consume(&limiter, 1, 500);
+    TEST_ASSERT_EQUAL_INT(501, SitewiseRateLimiter_getDelay(&limiter, 1, 500));
+
+    /* A clock that goes back doesn't take tokens away */
+    TEST_ASSERT_EQUAL_INT(501, SitewiseRateLimiter_getDelay(&limiter, 1, 400));
+}
+
+static void testBurstCap(void)
+{
+    SitewiseRateLimiter_t limiter;
+
+    SitewiseRateLimiter_init(&limiter, 2, 0, 0);
+
+    /* A long idle time fills the bucket no further than one second worth */
+    TEST_ASSERT_EQUAL_INT(0, SitewiseRateLimiter_getDelay(&limiter, 1, 100000));
+    TEST_ASSERT(isClose(2, limiter.requests.tokens));
+    SitewiseRateLimiter_consume(&limiter, 1, 100000);
+    SitewiseRateLimiter_consume(&limiter, 1, 100000);
+    TEST_ASSERT_EQUAL_INT(501, SitewiseRateLimiter_getDelay(&limiter, 1, 100000));
+}
+
+static void testEntries(void)
+{
+    SitewiseRateLimiter_t limiter;
+
+    SitewiseRateLimiter_init(&limiter, 0, 10, 0);
+    TEST_ASSERT_EQUAL_INT(0, SitewiseRateLimiter_getDelay(&limiter, 6, 0));
+    SitewiseRateLimiter_consume(&limiter, 6, 0);
+    TEST_ASSERT_EQUAL_INT(0, SitewiseRateLimiter_getDelay(&limiter, 4, 0));
+    TEST_ASSERT_EQUAL_INT(201, SitewiseRateLimiter_getDelay(&limiter, 6, 0));
+
+    /* A request larger than the bucket waits for a full bucket, and its debt delays the next one */
+    TEST_ASSERT_EQUAL_INT(601, SitewiseRateLimiter_getDelay(&limiter, 25, 0));
+    TEST_ASSERT_EQUAL_INT(0, SitewiseRateLimiter_getDelay(&limiter, 25, 600));
+    SitewiseRateLimiter_consume(&limiter, 25, 600);
+    TEST_ASSERT_EQUAL_INT(1601, SitewiseRateLimiter_getDelay(&limiter, 1, 600));
+}
+
+static void testLongestDelay(void)
+{
+    SitewiseRateLimiter_t limiter;
+
+    /* The request waits for the bucket that takes longest, and for the start */
+    SitewiseRateLimiter_init(&limiter, 1, 10, 0);
+    SitewiseRateLimiter_consume(&limiter, 10, 0);
+    TEST_ASSERT_EQUAL_INT(1001, SitewiseRateLimiter_getDelay(&limiter, 1, 0));
+    TEST_ASSERT_EQUAL_INT(1001, SitewiseRateLimiter_getDelay(&limiter, 10, 0));
+    limiter.notBeforeMs = 2000;
+    TEST_ASSERT_EQUAL_INT(2000, SitewiseRateLimiter_getDelay(&limiter, 1, 0));
+}
+
+static void testThrottled(void)
+{
+    SitewiseRateLimiter_t limiter;
+
+    SitewiseRateLimiter_init(&limiter, 8, 160, 0);
+
+    /* A throttled request halves the rates and gives up the burst */
+    SitewiseRateLimiter_update(&limiter, true);
+    TEST_ASSERT(isClose(4, limiter.requests.rate));
+    TEST_ASSERT(isClose(80, limiter.entries.rate));
+    TEST_ASSERT_EQUAL_INT(251, SitewiseRateLimiter_getDelay(&limiter, 1, 0));
+    TEST_ASSERT_EQUAL_INT(501, SitewiseRateLimiter_getDelay(&limiter, 40, 0));
+
+    /* Down to a sixteenth of the configured rate */
+    for (int i = 0; i < 10; i++)
+    {
+        SitewiseRateLimiter_update(&limiter, true);
+    }
+    TEST_ASSERT(isClose(0.5, limiter.requests.rate));
+    TEST_ASSERT(isClose(10, limiter.entries.rate));
+    TEST_ASSERT_EQUAL_INT(11, limiter.throttled);
+    TEST_ASSERT_EQUAL_INT(2001, SitewiseRateLimiter_getDelay(&limiter, 1, 0));
+
+    /* Every accepted request gives back a twentieth of the configured rate */
+    SitewiseRateLimiter_update(&limiter, false);
+    TEST_ASSERT(isClose(0.9, limiter.requests.rate));
+    TEST_ASSERT(isClose(18, limiter.entries.rate));
+    for (int i = 0; i < 17; i++)
+    {
+        SitewiseRateLimiter_update(&limiter, false);
+    }
+    TEST_ASSERT(isClose(7.7, limiter.requests.rate));
+    SitewiseRateLimiter_update(&limiter, false);
+    TEST_ASSERT(isClose(8, limiter.requests.rate));
+    TEST_ASSERT(isClose(160, limiter.entries.rate));
+    TEST_ASSERT_EQUAL_INT(11, limiter.throttled);
+
+    /* The burst comes back with the time, up to the configured rate */
+    TEST_ASSERT_EQUAL_INT(0, SitewiseRateLimiter_getDelay(&limiter, 160, 10000));
+    TEST_ASSERT(isClose(8, limiter.requests.tokens));
+    TEST_ASSERT(isClose(160, limiter.entries.tokens));
+}
+
+static void testThrottledInDebt(void)
+{
+    SitewiseRateLimiter_t limiter;
+
+    /* Throttling doesn't forgive tokens that were overdrawn */
+    SitewiseRateLimiter_init(&limiter, 0, 10, 0);
+    SitewiseRateLimiter_consume(&limiter, 15, 0);
+    SitewiseRateLimiter_update(&limiter, true);
+    TEST_ASSERT(isClose(-5, limiter.entries.tokens));
+    TEST_ASSERT_EQUAL_INT(1201, SitewiseRateLimiter_getDelay(&limiter, 1, 0));
+}
+
+int main(void)
+{
+    RUN_TEST(testNoLimit);
+    RUN_TEST(testStartDelay);
+    RUN_TEST(testRequests);
+    RUN_TEST(testBurstCap);
+    RUN_TEST(testEntries);
+    RUN_TEST(testLongestDelay);
+    RUN_TEST(testThrottled);
+    RUN_TEST(testThrottledInDebt);
+
+    return HOST_TEST_RESULT();
+}
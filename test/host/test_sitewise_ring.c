@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "sitewise_ring.h"
+
+#define TEST_RING_CAPACITY (8)
+
+static SitewiseSample_t slots[TEST_RING_CAPACITY];
+
+static bool put(SitewiseRing_t *pRing, uint32_t sequence)
+{
+    SitewiseSample_t *pSample = SitewiseRing_reserve(pRing);
+
+    if (pSample == NULL)
+    {
+        return false;
+    }
+    memset(pSample, 0, sizeof(*pSample));
+    pSample->timeInSeconds = sequence;
+    SitewiseRing_commit(pRing);
+    return true;
+}
+
+static bool take(SitewiseRing_t *pRing, uint32_t *pSequence)
+{
+    SitewiseSample_t *pSample = SitewiseRing_peek(pRing);
+
+    if (pSample == NULL)
+    {
+        return false;
+    }
+    *pSequence = pSample->timeInSeconds;
+    SitewiseRing_release(pRing);
+    return true;
+}
+
+static void testCapacity(void)
+{
+    SitewiseRing_t ring;
+
+    TEST_ASSERT_EQUAL_INT(SITEWISE_RING_ERROR_CAPACITY, SitewiseRing_init(&ring, slots, 0));
+    TEST_ASSERT_EQUAL_INT(SITEWISE_RING_ERROR_CAPACITY, SitewiseRing_init(&ring, slots, 6));
+    TEST_ASSERT_EQUAL_INT(SITEWISE_RING_ERROR_NONE, SitewiseRing_init(&ring, slots, 1));
+    TEST_ASSERT_EQUAL_INT(SITEWISE_RING_ERROR_NONE, SitewiseRing_init(&ring, slots, TEST_RING_CAPACITY));
+}
+
+static void testFullAndEmpty(void)
+{
+    SitewiseRing_t ring;
+    uint32_t sequence = 0;
+
+    SitewiseRing_init(&ring, slots, TEST_RING_CAPACITY);
+    TEST_ASSERT(!take(&ring, &sequence));
+
+    for (uint32_t i = 0; i < TEST_RING_CAPACITY; i++)
+    {
+        TEST_ASSERT(put(&ring, i));
+    }
+    TEST_ASSERT_EQUAL_INT(TEST_RING_CAPACITY, SitewiseRing_getCount(&ring));
+    TEST_ASSERT(!put(&ring, 99));
+    TEST_ASSERT_EQUAL_INT(1, atomic_load(&ring.dropped));
+
+    for (uint32_t i = 0; i < TEST_RING_CAPACITY; i++)
+    {
+        TEST_ASSERT(take(&ring, &sequence));
+        TEST_ASSERT_EQUAL_INT(i, sequence);
+    }
+    TEST_ASSERT(!take(&ring, &sequence));
+    TEST_ASSERT_EQUAL_INT(0, SitewiseRing_getCount(&ring));
+}
+
+static void testCounterWrap(void)
+{
+    SitewiseRing_t ring;
+    uint32_t sequence = 0;
+    uint32_t expected = 0;
+    uint32_t next = 0;
+
+    /* Start just before the counters wrap around, and run the ring through it a few times over */
+    SitewiseRing_init(&ring, slots, TEST_RING_CAPACITY);
+    atomic_store(&ring.head, UINT32_MAX - 3 * TEST_RING_CAPACITY);
+    atomic_store(&ring.tail, UINT32_MAX - 3 * TEST_RING_CAPACITY);
+
+    for (uint32_t round = 0; round < 8 * TEST_RING_CAPACITY; round++)
+    {
+        /* Alternate between filling the ring up and draining it, so the wrap happens at any fill level */
+        uint32_t puts = (round % 2) ? TEST_RING_CAPACITY : 3;
+
+        for (uint32_t i = 0; i < puts; i++)
+        {
+            if (put(&ring, next))
+            {
+                next++;
+            }
+        }
+        TEST_ASSERT(SitewiseRing_getCount(&ring) <= TEST_RING_CAPACITY);
+        for (uint32_t i = 0; i < 5 && take(&ring, &sequence); i++)
+        {
+            TEST_ASSERT_EQUAL_INT(expected, sequence);
+            expected++;
+        }
+    }
+    while (take(&ring, &sequence))
+    {
+        TEST_ASSERT_EQUAL_INT(expected, sequence);
+        expected++;
+    }
+    TEST_ASSERT_EQUAL_INT(next, expected);
+    TEST_ASSERT(atomic_load(&ring.head) < UINT32_MAX - 3 * TEST_RING_CAPACITY);
+}
+
+int main(void)
+{
+    RUN_TEST(testCapacity);
+    RUN_TEST(testFullAndEmpty);
+    RUN_TEST(testCounterWrap);
+
+    return HOST_TEST_RESULT();
+}
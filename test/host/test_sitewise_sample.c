@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "sitewise_sample.h"
+
+/* The slot of the ring and the spool before the fixed-width records */
+typedef struct
+{
+    size_t sourceIndex;
+    PropertyValue_t propertyValue;
+} LegacySample_t;
+
+static PropertyValue_t roundTrip(const PropertyValue_t *pPropertyValue, size_t sourceIndex)
+{
+    SitewiseSample_t sample;
+    PropertyValue_t decoded;
+
+    /* Whatever the memory holds before, nothing of it leaks into the record */
+    memset(&sample, 0xA5, sizeof(sample));
+    SitewiseSample_encode(&sample, sourceIndex, pPropertyValue);
+    TEST_ASSERT_EQUAL_INT(sourceIndex, sample.sourceIndex);
+    TEST_ASSERT_EQUAL_INT(0, sample.reserved);
+    SitewiseSample_decode(&sample, &decoded);
+    TEST_ASSERT_EQUAL_INT(pPropertyValue->type, decoded.type);
+    TEST_ASSERT_EQUAL_INT(pPropertyValue->timeInSeconds, decoded.timeInSeconds);
+    TEST_ASSERT_EQUAL_INT(pPropertyValue->offsetInNanos, decoded.offsetInNanos);
+    return decoded;
+}
+
+static void testLayout(void)
+{
+    TEST_ASSERT_EQUAL_INT(SITEWISE_SAMPLE_SIZE, sizeof(SitewiseSample_t));
+    TEST_ASSERT_EQUAL_INT(0, offsetof(SitewiseSample_t, sourceIndex));
+    TEST_ASSERT_EQUAL_INT(2, offsetof(SitewiseSample_t, type));
+    TEST_ASSERT_EQUAL_INT(4, offsetof(SitewiseSample_t, timeInSeconds));
+    TEST_ASSERT_EQUAL_INT(8, offsetof(SitewiseSample_t, offsetInNanos));
+    TEST_ASSERT_EQUAL_INT(12, offsetof(SitewiseSample_t, value));
+
+    /* 32 bytes on the ESP32, 40 on a 64-bit host */
+    TEST_ASSERT(sizeof(SitewiseSample_t) < sizeof(LegacySample_t));
+}
+
+static void testIntegers(void)
+{
+    const int values[] = { 0, 1, -1, 42, INT_MAX, INT_MIN };
+
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+    {
+        PropertyValue_t propertyValue = {
+            .type = PROPERTY_VALUE_TYPE_INTEGER, .integerValue = values[i], .timeInSeconds = 1714564800,
+        };
+        TEST_ASSERT_EQUAL_INT(values[i], roundTrip(&propertyValue, i).integerValue);
+    }
+}
+
+static void testDoubles(void)
+{
+    const double values[] = { 0.0, -0.0, 27.3, -40.1, 1e-300, 1.7976931348623157e308, INFINITY };
+
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+    {
+        PropertyValue_t propertyValue = {
+            .type = PROPERTY_VALUE_TYPE_DOUBLE, .doubleValue = values[i], .timeInSeconds = 1714564800,
+            .offsetInNanos = 999999999,
+        };
+        double decoded = roundTrip(&propertyValue, 7).doubleValue;
+
+        /* Bit for bit, which tells -0.0 from 0.0 */
+        TEST_ASSERT(memcmp(&decoded, &values[i], sizeof(double)) == 0);
+    }
+
+    PropertyValue_t propertyValue = { .type = PROPERTY_VALUE_TYPE_DOUBLE, .doubleValue = NAN };
+    TEST_ASSERT(isnan(roundTrip(&propertyValue, 0).doubleValue));
+}
+
+static void testBooleans(void)
+{
+    PropertyValue_t propertyValue = { .type = PROPERTY_VALUE_TYPE_BOOLEAN, .booleanValue = true };
+
+    TEST_ASSERT(roundTrip(&propertyValue, 0).booleanValue);
+    propertyValue.booleanValue = false;
+    TEST_ASSERT(!roundTrip(&propertyValue, 0).booleanValue);
+}
+
+static void testStrings(void)
+{
+    static char state[] = "RUNNING";
+    PropertyValue_t propertyValue = { .type = PROPERTY_VALUE_TYPE_STRING, .stringValue = state };
+
+    /* Kept by its pointer */
+    TEST_ASSERT(roundTrip(&propertyValue, 3).stringValue == state);
+}
+
+static void testTimestamps(void)
+{
+    /* Up to 2106 in the unsigned seconds of the record */
+    const long seconds[] = { 0, 946684800, 1714564800, 2147483647, 4102444800 };
+
+    for (size_t i = 0; i < sizeof(seconds) / sizeof(seconds[0]); i++)
+    {
+        PropertyValue_t propertyValue = {
+            .type = PROPERTY_VALUE_TYPE_INTEGER, .timeInSeconds = seconds[i], .offsetInNanos = (long)(i * 123456789),
+        };
+        roundTrip(&propertyValue, MAX_SITEWISE_ENTRY_SIZE);
+    }
+}
+
+int main(void)
+{
+    RUN_TEST(testLayout);
+    RUN_TEST(testIntegers);
+    RUN_TEST(testDoubles);
+    RUN_TEST(testBooleans);
+    RUN_TEST(testStrings);
+    RUN_TEST(testTimestamps);
+
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,340 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "sitewise_source.h"
+
+#define TEST_PERIOD_MS (100)
+
+/*
+ * The registry can't be cleared, so every test registers its own sources, which are polled by the later tests as well,
+ * and the clock keeps going across tests.
+ */
+static int64_t nowMs = 0;
+
+typedef struct TestSource
+{
+    PropertyValue_t value;
+    int result;
+    int reads;
+} TestSource_t;
+
+typedef struct Emitted
+{
+    size_t sourceIndex;
+    int count;
+} Emitted_t;
+
+static int readTestSource(void *pContext, PropertyValue_t *pPropertyValue)
+{
+    TestSource_t *pTestSource = (TestSource_t *)pContext;
+
+    pTestSource->reads++;
+    *pPropertyValue = pTestSource->value;
+    return pTestSource->result;
+}
+
+static void collect(size_t sourceIndex, PropertyValue_t *pPropertyValue, void *pUserData)
+{
+    Emitted_t *pEmitted = (Emitted_t *)pUserData;
+
+    if (sourceIndex == pEmitted->sourceIndex)
+    {
+        pEmitted->count++;
+    }
+}
+
+static int registerTestSource(TestSource_t *pTestSource)
+{
+    int sourceIndex = SitewiseSource_register("asset", "property", TEST_PERIOD_MS, readTestSource, pTestSource);
+
+    TEST_ASSERT(sourceIndex >= 0);
+    return sourceIndex;
+}
+
+/**
+ * Move to the next deadline of the test sources and poll them.
+ *
+ * @return true if the source has emitted a value
+ */
+static bool sample(size_t sourceIndex)
+{
+    Emitted_t emitted = { .sourceIndex = sourceIndex };
+
+    nowMs += TEST_PERIOD_MS;
+    SitewiseSource_poll(nowMs, collect, &emitted);
+    return emitted.count > 0;
+}
+
+static bool sampleDouble(size_t sourceIndex, TestSource_t *pTestSource, double value)
+{
+    pTestSource->value.type = PROPERTY_VALUE_TYPE_DOUBLE;
+    pTestSource->value.doubleValue = value;
+    return sample(sourceIndex);
+}
+
+static bool sampleInteger(size_t sourceIndex, TestSource_t *pTestSource, int value)
+{
+    pTestSource->value.type = PROPERTY_VALUE_TYPE_INTEGER;
+    pTestSource->value.integerValue = value;
+    return sample(sourceIndex);
+}
+
+static void testNoDeadband(void)
+{
+    static TestSource_t testSource;
+    int sourceIndex = registerTestSource(&testSource);
+    SitewiseSourceStats_t stats;
+
+    TEST_ASSERT(sampleInteger(sourceIndex, &testSource, 7));
+    TEST_ASSERT(sampleInteger(sourceIndex, &testSource, 7));
+    TEST_ASSERT_EQUAL_INT(2, testSource.reads);
+
+    TEST_ASSERT_EQUAL_INT(SITEWISE_SOURCE_ERROR_NONE, SitewiseSource_getStats(sourceIndex, &stats));
+    TEST_ASSERT_EQUAL_INT(0, stats.suppressed);
+    TEST_ASSERT_EQUAL_INT(SITEWISE_SOURCE_ERROR_NOT_FOUND, SitewiseSource_setDeadband(MAX_SITEWISE_SOURCE_SIZE, 1, 0, 0));
+}
+
+static void testEveryChange(void)
+{
+    static TestSource_t testSource;
+    int sourceIndex = registerTestSource(&testSource);
+    SitewiseSourceStats_t stats;
+
+    TEST_ASSERT_EQUAL_INT(SITEWISE_SOURCE_ERROR_NONE, SitewiseSource_setDeadband(sourceIndex, 0, 0, 0));
+    TEST_ASSERT(sampleInteger(sourceIndex, &testSource, 7));
+    TEST_ASSERT(!sampleInteger(sourceIndex, &testSource, 7));
+    TEST_ASSERT(sampleInteger(sourceIndex, &testSource, 8));
+    TEST_ASSERT(!sampleInteger(sourceIndex, &testSource, 8));
+    TEST_ASSERT(sampleInteger(sourceIndex, &testSource, 7));
+
+    SitewiseSource_getStats(sourceIndex, &stats);
+    TEST_ASSERT_EQUAL_INT(2, stats.suppressed);
+}
+
+static void testAbsolute(void)
+{
+    static TestSource_t testSource;
+    int sourceIndex = registerTestSource(&testSource);
+    SitewiseSourceStats_t stats;
+
+    SitewiseSource_setDeadband(sourceIndex, 0.5, 0, 0);
+    TEST_ASSERT(sampleDouble(sourceIndex, &testSource, 20.0));
+    TEST_ASSERT(!sampleDouble(sourceIndex, &testSource, 20.25));
+    TEST_ASSERT(!sampleDouble(sourceIndex, &testSource, 20.5));
+    /* Compared with the last reported value, not the last sampled one, so a slow drift is reported too */
+    TEST_ASSERT(sampleDouble(sourceIndex, &testSource, 20.75));
+    TEST_ASSERT(!sampleDouble(sourceIndex, &testSource, 20.5));
+    TEST_ASSERT(sampleDouble(sourceIndex, &testSource, 20.0));
+    TEST_ASSERT(sampleDouble(sourceIndex, &testSource, 21.0));
+
+    SitewiseSource_getStats(sourceIndex, &stats);
+    TEST_ASSERT_EQUAL_INT(3, stats.suppressed);
+}
+
+static void testPercent(void)
+{
+    static TestSource_t testSource;
+    int sourceIndex = registerTestSource(&testSource);
+
+    SitewiseSource_setDeadband(sourceIndex, 0, 10, 0);
+    TEST_ASSERT(sampleInteger(sourceIndex, &testSource, 200));
+    TEST_ASSERT(!sampleInteger(sourceIndex, &testSource, 219));
+    TEST_ASSERT(!sampleInteger(sourceIndex, &testSource, 181));
+    TEST_ASSERT(sampleInteger(sourceIndex, &testSource, 221));
+    /* The threshold is taken from the last reported value, 10% of 221 */
+    TEST_ASSERT(!sampleInteger(sourceIndex, &testSource, 200));
+    TEST_ASSERT(sampleInteger(sourceIndex, &testSource, 198));
+    TEST_ASSERT(sampleInteger(sourceIndex, &testSource, -198));
+
+    /* Any change away from zero is more than a percent of it */
+    TEST_ASSERT(sampleInteger(sourceIndex, &testSource, 0));
+    TEST_ASSERT(!sampleInteger(sourceIndex, &testSource, 0));
+    TEST_ASSERT(sampleInteger(sourceIndex, &testSource, 1));
+}
+
+static void testAbsoluteOrPercent(void)
+{
+    static TestSource_t testSource;
+    int sourceIndex = registerTestSource(&testSource);
+
+    /* Either threshold reports a change */
+    SitewiseSource_setDeadband(sourceIndex, 5, 1, 0);
+    TEST_ASSERT(sampleDouble(sourceIndex, &testSource, 1000.0));
+    TEST_ASSERT(!sampleDouble(sourceIndex, &testSource, 1004.0));
+    TEST_ASSERT(sampleDouble(sourceIndex, &testSource, 1006.0));
+    TEST_ASSERT(sampleDouble(sourceIndex, &testSource, 100.0));
+    TEST_ASSERT(!sampleDouble(sourceIndex, &testSource, 100.5));
+    TEST_ASSERT(sampleDouble(sourceIndex, &testSource, 101.5));
+}
+
+static void testHeartbeat(void)
+{
+    static TestSource_t testSource;
+    int sourceIndex = registerTestSource(&testSource);
+    SitewiseSourceStats_t stats;
+
+    SitewiseSource_setDeadband(sourceIndex, 1, 0, 3 * TEST_PERIOD_MS);
+    TEST_ASSERT(sampleDouble(sourceIndex, &testSource, 5.0));
+    TEST_ASSERT(!sampleDouble(sourceIndex, &testSource, 5.0));
+    TEST_ASSERT(!sampleDouble(sourceIndex, &testSource, 5.5));
+    TEST_ASSERT(sampleDouble(sourceIndex, &testSource, 5.5));
+    TEST_ASSERT(!sampleDouble(sourceIndex, &testSource, 5.0));
+
+    /* A change restarts the heartbeat interval */
+    TEST_ASSERT(sampleDouble(sourceIndex, &testSource, 7.0));
+    TEST_ASSERT(!sampleDouble(sourceIndex, &testSource, 7.0));
+    TEST_ASSERT(!sampleDouble(sourceIndex, &testSource, 7.0));
+    TEST_ASSERT(sampleDouble(sourceIndex, &testSource, 7.0));
+
+    SitewiseSource_getStats(sourceIndex, &stats);
+    TEST_ASSERT_EQUAL_INT(5, stats.suppressed);
+}
+
+static void testBoolean(void)
+{
+    static TestSource_t testSource;
+    int sourceIndex = registerTestSource(&testSource);
+
+    /* The thresholds don't apply to booleans */
+    SitewiseSource_setDeadband(sourceIndex, 10, 50, 0);
+    testSource.value.type = PROPERTY_VALUE_TYPE_BOOLEAN;
+    testSource.value.booleanValue = true;
+    TEST_ASSERT(sample(sourceIndex));
+    TEST_ASSERT(!sample(sourceIndex));
+    testSource.value.booleanValue = false;
+    TEST_ASSERT(sample(sourceIndex));
+    TEST_ASSERT(!sample(sourceIndex));
+    testSource.value.booleanValue = true;
+    TEST_ASSERT(sample(sourceIndex));
+}
+
+static void testString(void)
+{
+    static TestSource_t testSource;
+    int sourceIndex = registerTestSource(&testSource);
+    char buffer[SITEWISE_DEADBAND_STRING_SIZE + 16];
+
+    SitewiseSource_setDeadband(sourceIndex, 0, 0, 0);
+    testSource.value.type = PROPERTY_VALUE_TYPE_STRING;
+    testSource.value.stringValue = buffer;
+
+    /* The read callback overwrites the same buffer every time */
+    strcpy(buffer, "RUNNING");
+    TEST_ASSERT(sample(sourceIndex));
+    TEST_ASSERT(!sample(sourceIndex));
+    strcpy(buffer, "STOPPED");
+    TEST_ASSERT(sample(sourceIndex));
+    testSource.value.stringValue = "STOPPED";
+    TEST_ASSERT(!sample(sourceIndex));
+
+    /* A string longer than the copy is always reported */
+    testSource.value.stringValue = buffer;
+    memset(buffer, 'x', sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
+    TEST_ASSERT(sample(sourceIndex));
+    TEST_ASSERT(sample(sourceIndex));
+
+    testSource.value.stringValue = NULL;
+    TEST_ASSERT(sample(sourceIndex));
+    TEST_ASSERT(!sample(sourceIndex));
+    testSource.value.stringValue = "";
+    TEST_ASSERT(!sample(sourceIndex));
+}
+
+static void testTypeChange(void)
+{
+    static TestSource_t testSource;
+    int sourceIndex = registerTestSource(&testSource);
+
+    SitewiseSource_setDeadband(sourceIndex, 100, 0, 0);
+    TEST_ASSERT(sampleInteger(sourceIndex, &testSource, 1));
+    TEST_ASSERT(sampleDouble(sourceIndex, &testSource, 1.0));
+    TEST_ASSERT(!sampleDouble(sourceIndex, &testSource, 2.0));
+    TEST_ASSERT(sampleInteger(sourceIndex, &testSource, 2));
+}
+
+static void testDeadlines(void)
+{
+    static TestSource_t testSource;
+    int sourceIndex = registerTestSource(&testSource);
+    Emitted_t emitted = { .sourceIndex = sourceIndex };
+    int64_t startMs = nowMs + TEST_PERIOD_MS;
+    SitewiseSourceStats_t stats;
+
+    /* All of the sources of these tests have the same period and were first polled on the same grid */
+    TEST_ASSERT_EQUAL_INT(startMs + 100, SitewiseSource_poll(startMs, collect, &emitted));
+    TEST_ASSERT_EQUAL_INT(1, testSource.reads);
+
+    /* A late sample doesn't move the next deadline */
+    TEST_ASSERT_EQUAL_INT(startMs + 200, SitewiseSource_poll(startMs + 130, collect, &emitted));
+    TEST_ASSERT_EQUAL_INT(2, testSource.reads);
+    TEST_ASSERT_EQUAL_INT(startMs + 200, SitewiseSource_poll(startMs + 150, collect, &emitted));
+    TEST_ASSERT_EQUAL_INT(2, testSource.reads);
+    TEST_ASSERT_EQUAL_INT(startMs + 300, SitewiseSource_poll(startMs + 200, collect, &emitted));
+
+    /* A sampler more than a period late skips the deadlines it missed, and samples once */
+    TEST_ASSERT_EQUAL_INT(startMs + 600, SitewiseSource_poll(startMs + 570, collect, &emitted));
+    TEST_ASSERT_EQUAL_INT(4, testSource.reads);
+    TEST_ASSERT_EQUAL_INT(4, emitted.count);
+
+    TEST_ASSERT_EQUAL_INT(SITEWISE_SOURCE_ERROR_NONE, SitewiseSource_getStats(sourceIndex, &stats));
+    TEST_ASSERT_EQUAL_INT(4, stats.samples);
+    TEST_ASSERT_EQUAL_INT(2, stats.overruns);
+    TEST_ASSERT_EQUAL_INT((0 + 30 + 0 + 70) / 4, stats.meanLatenessMs);
+    TEST_ASSERT_EQUAL_INT(70, stats.maxLatenessMs);
+
+    /* A failed read emits nothing, and still keeps the schedule */
+    testSource.result = SITEWISE_SOURCE_ERROR_READ;
+    TEST_ASSERT_EQUAL_INT(startMs + 700, SitewiseSource_poll(startMs + 600, collect, &emitted));
+    TEST_ASSERT_EQUAL_INT(5, testSource.reads);
+    TEST_ASSERT_EQUAL_INT(4, emitted.count);
+    SitewiseSource_getStats(sourceIndex, &stats);
+    TEST_ASSERT_EQUAL_INT(5, stats.samples);
+    TEST_ASSERT_EQUAL_INT(SITEWISE_SOURCE_ERROR_NOT_FOUND, SitewiseSource_getStats(MAX_SITEWISE_SOURCE_SIZE, &stats));
+
+    nowMs = startMs + 600;
+}
+
+static void testPeriods(void)
+{
+    static TestSource_t testSource;
+    int sourceIndex = SitewiseSource_register("asset", "property", 250, readTestSource, &testSource);
+    int64_t startMs = nowMs + TEST_PERIOD_MS;
+    SitewiseSourceStats_t stats;
+    Emitted_t emitted = { .sourceIndex = sourceIndex };
+
+    /* The next due time is the earliest deadline of any source */
+    TEST_ASSERT_EQUAL_INT(startMs + 100, SitewiseSource_poll(startMs, collect, &emitted));
+    TEST_ASSERT_EQUAL_INT(startMs + 200, SitewiseSource_poll(startMs + 100, collect, &emitted));
+    TEST_ASSERT_EQUAL_INT(startMs + 250, SitewiseSource_poll(startMs + 200, collect, &emitted));
+    TEST_ASSERT_EQUAL_INT(startMs + 300, SitewiseSource_poll(startMs + 250, collect, &emitted));
+    TEST_ASSERT_EQUAL_INT(2, testSource.reads);
+
+    /* Late by more than the period of the other sources, but not by its own */
+    SitewiseSource_poll(startMs + 740, collect, &emitted);
+    SitewiseSource_getStats(sourceIndex, &stats);
+    TEST_ASSERT_EQUAL_INT(3, stats.samples);
+    TEST_ASSERT_EQUAL_INT(0, stats.overruns);
+    TEST_ASSERT_EQUAL_INT(240, stats.maxLatenessMs);
+    TEST_ASSERT_EQUAL_INT(startMs + 750, SitewiseSource_get(sourceIndex)->nextSampleMs);
+}
+
+int main(void)
+{
+    RUN_TEST(testNoDeadband);
+    RUN_TEST(testEveryChange);
+    RUN_TEST(testAbsolute);
+    RUN_TEST(testPercent);
+    RUN_TEST(testAbsoluteOrPercent);
+    RUN_TEST(testHeartbeat);
+    RUN_TEST(testBoolean);
+    RUN_TEST(testString);
+    RUN_TEST(testTypeChange);
+    RUN_TEST(testDeadlines);
+    RUN_TEST(testPeriods);
+
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,312 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "host_test.h"
+#include "sitewise_spool.h"
+
+#define TEST_RAM_CAPACITY (4)
+#define TEST_FILE_CAPACITY (8)
+
+static SitewiseSample_t slots[TEST_RAM_CAPACITY];
+static char spoolPath[64];
+
+static SitewiseSample_t makeSample(uint32_t sequence)
+{
+    SitewiseSample_t sample = { .type = PROPERTY_VALUE_TYPE_INTEGER, .timeInSeconds = sequence };
+    sample.value[0] = sequence;
+    return sample;
+}
+
+static int push(SitewiseSpool_t *pSpool, uint32_t sequence)
+{
+    SitewiseSample_t sample = makeSample(sequence);
+    return SitewiseSpool_push(pSpool, &sample);
+}
+
+/**
+ * Check that the backlog holds the samples of a range of sequence numbers, oldest first.
+ */
+static void checkBacklog(SitewiseSpool_t *pSpool, uint32_t first, uint32_t count)
+{
+    SitewiseSample_t sample;
+
+    TEST_ASSERT_EQUAL_INT(count, SitewiseSpool_getDepth(pSpool));
+    for (uint32_t i = 0; i < count; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(SITEWISE_SPOOL_ERROR_NONE, SitewiseSpool_read(pSpool, i, &sample));
+        TEST_ASSERT_EQUAL_INT(first + i, sample.timeInSeconds);
+        TEST_ASSERT_EQUAL_INT(first + i, sample.value[0]);
+    }
+    TEST_ASSERT_EQUAL_INT(SITEWISE_SPOOL_ERROR_NOT_FOUND, SitewiseSpool_read(pSpool, count, &sample));
+}
+
+static void closeSpool(SitewiseSpool_t *pSpool)
+{
+    if (pSpool->pFile != NULL)
+    {
+        fclose(pSpool->pFile);
+        pSpool->pFile = NULL;
+    }
+}
+
+static void testRamOnly(void)
+{
+    SitewiseSpool_t spool;
+    uint32_t next = 0;
+    uint32_t first = 0;
+
+    TEST_ASSERT_EQUAL_INT(SITEWISE_SPOOL_ERROR_NONE, SitewiseSpool_init(&spool, slots, TEST_RAM_CAPACITY, NULL, 0));
+
+    /* Run the RAM ring around many times */
+    for (uint32_t round = 0; round < 100; round++)
+    {
+        while (SitewiseSpool_getDepth(&spool) < TEST_RAM_CAPACITY)
+        {
+            TEST_ASSERT_EQUAL_INT(SITEWISE_SPOOL_ERROR_NONE, push(&spool, next++));
+        }
+        checkBacklog(&spool, first, TEST_RAM_CAPACITY);
+        SitewiseSpool_consume(&spool, 3, 1000);
+        first += 3;
+    }
+
+    while (SitewiseSpool_getDepth(&spool) < TEST_RAM_CAPACITY)
+    {
+        TEST_ASSERT_EQUAL_INT(SITEWISE_SPOOL_ERROR_NONE, push(&spool, next++));
+    }
+    TEST_ASSERT_EQUAL_INT(SITEWISE_SPOOL_ERROR_FULL, push(&spool, next++));
+    TEST_ASSERT_EQUAL_INT(1, spool.dropped);
+}
+
+static void testSpillInOrder(void)
+{
+    SitewiseSpool_t spool;
+
+    unlink(spoolPath);
+    TEST_ASSERT_EQUAL_INT(SITEWISE_SPOOL_ERROR_NONE,
+                          SitewiseSpool_init(&spool, slots, TEST_RAM_CAPACITY, spoolPath, TEST_FILE_CAPACITY));
+
+    /* RAM and file take 12 samples, the next one is dropped */
+    for (uint32_t i = 0; i < TEST_RAM_CAPACITY + TEST_FILE_CAPACITY; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(SITEWISE_SPOOL_ERROR_NONE, push(&spool, i));
+    }
+    TEST_ASSERT_EQUAL_INT(TEST_FILE_CAPACITY, spool.fileDepth);
+    checkBacklog(&spool, 0, TEST_RAM_CAPACITY + TEST_FILE_CAPACITY);
+    TEST_ASSERT_EQUAL_INT(SITEWISE_SPOOL_ERROR_FULL, push(&spool, 99));
+
+    closeSpool(&spool);
+}
+
+static void testSpaceTakenAgainBeforeDrain(void)
+{
+    SitewiseSpool_t spool;
+    uint32_t next = 0;
+    uint32_t first = 0;
+
+    unlink(spoolPath);
+    SitewiseSpool_init(&spool, slots, TEST_RAM_CAPACITY, spoolPath, TEST_FILE_CAPACITY);
+
+    /* The backlog never drains, yet the file goes on taking samples as the oldest ones are consumed */
+    for (uint32_t round = 0; round < 50; round++)
+    {
+        while (push(&spool, next) == SITEWISE_SPOOL_ERROR_NONE)
+        {
+            next++;
+        }
+        TEST_ASSERT_EQUAL_INT(TEST_RAM_CAPACITY + TEST_FILE_CAPACITY, SitewiseSpool_getDepth(&spool));
+        checkBacklog(&spool, first, TEST_RAM_CAPACITY + TEST_FILE_CAPACITY);
+        SitewiseSpool_consume(&spool, TEST_RAM_CAPACITY / 2, 1000);
+        first += TEST_RAM_CAPACITY / 2;
+    }
+    TEST_ASSERT(next > 50 * (TEST_RAM_CAPACITY / 2));
+
+    closeSpool(&spool);
+}
+
+static void testResumeAfterReboot(void)
+{
+    SitewiseSpool_t spool;
+    uint32_t next = 0;
+    uint32_t first = 0;
+
+    unlink(spoolPath);
+    SitewiseSpool_init(&spool, slots, TEST_RAM_CAPACITY, spoolPath, TEST_FILE_CAPACITY);
+
+    /* Go around the file a few times, and reboot at every position of the oldest record */
+    for (uint32_t round = 0; round < 3 * TEST_FILE_CAPACITY; round++)
+    {
+        while (spool.fileDepth < TEST_FILE_CAPACITY - 1 && push(&spool, next) == SITEWISE_SPOOL_ERROR_NONE)
+        {
+            next++;
+        }
+        SitewiseSpool_consume(&spool, 1, 1000);
+        first++;
+
+        /* The samples in RAM are lost in a reboot, the ones in the file come back without the consumed ones */
+        uint32_t fileDepth = spool.fileDepth;
+        closeSpool(&spool);
+        TEST_ASSERT_EQUAL_INT(SITEWISE_SPOOL_ERROR_NONE,
+                              SitewiseSpool_init(&spool, slots, TEST_RAM_CAPACITY, spoolPath, TEST_FILE_CAPACITY));
+        TEST_ASSERT_EQUAL_INT(fileDepth, spool.fileDepth);
+        checkBacklog(&spool, first, fileDepth);
+        next = first + fileDepth;
+    }
+
+    closeSpool(&spool);
+}
+
+static char stringState[] = "RUNNING";
+
+static int pushString(SitewiseSpool_t *pSpool, uint32_t sequence)
+{
+    SitewiseSample_t sample;
+    PropertyValue_t propertyValue = { .type = PROPERTY_VALUE_TYPE_STRING, .stringValue = stringState, .timeInSeconds = sequence };
+
+    SitewiseSample_encode(&sample, 0, &propertyValue);
+    return SitewiseSpool_push(pSpool, &sample);
+}
+
+/**
+ * Check the sample at a position of the backlog by its sequence number, and whether its value has been dropped.
+ */
+static void checkSample(SitewiseSpool_t *pSpool, uint32_t index, uint32_t sequence, bool dropped)
+{
+    SitewiseSample_t sample;
+
+    TEST_ASSERT_EQUAL_INT(SITEWISE_SPOOL_ERROR_NONE, SitewiseSpool_read(pSpool, index, &sample));
+    TEST_ASSERT_EQUAL_INT(sequence, sample.timeInSeconds);
+    if (dropped)
+    {
+        TEST_ASSERT_EQUAL_INT(SITEWISE_SAMPLE_TYPE_DROPPED, sample.type);
+    }
+    else
+    {
+        TEST_ASSERT(sample.type != SITEWISE_SAMPLE_TYPE_DROPPED);
+    }
+}
+
+static void testStringsNotSpilled(void)
+{
+    SitewiseSpool_t spool;
+    SitewiseSample_t sample;
+    PropertyValue_t propertyValue;
+
+    unlink(spoolPath);
+    SitewiseSpool_init(&spool, slots, TEST_RAM_CAPACITY, spoolPath, TEST_FILE_CAPACITY);
+
+    /* A string is replayed from RAM by its pointer */
+    push(&spool, 0);
+    TEST_ASSERT_EQUAL_INT(SITEWISE_SPOOL_ERROR_NONE, pushString(&spool, 1));
+    TEST_ASSERT_EQUAL_INT(SITEWISE_SPOOL_ERROR_NONE, SitewiseSpool_read(&spool, 1, &sample));
+    SitewiseSample_decode(&sample, &propertyValue);
+    TEST_ASSERT(propertyValue.stringValue == stringState);
+
+    /* The spill of the older half writes the number, and a dropped record in place of the string */
+    push(&spool, 2);
+    push(&spool, 3);
+    push(&spool, 4);
+    TEST_ASSERT_EQUAL_INT(2, spool.fileDepth);
+    TEST_ASSERT_EQUAL_INT(1, spool.droppedStrings);
+    TEST_ASSERT_EQUAL_INT(0, spool.dropped);
+    TEST_ASSERT_EQUAL_INT(5, SitewiseSpool_getDepth(&spool));
+    for (uint32_t i = 0; i < 5; i++)
+    {
+        checkSample(&spool, i, i, i == 1);
+    }
+    TEST_ASSERT_EQUAL_INT(SITEWISE_SPOOL_ERROR_NONE, SitewiseSpool_read(&spool, 1, &sample));
+    TEST_ASSERT_EQUAL_INT(0, sample.value[0]);
+    TEST_ASSERT_EQUAL_INT(0, sample.value[1]);
+
+    /* No pointer comes back after a reboot */
+    closeSpool(&spool);
+    SitewiseSpool_init(&spool, slots, TEST_RAM_CAPACITY, spoolPath, TEST_FILE_CAPACITY);
+    TEST_ASSERT_EQUAL_INT(2, SitewiseSpool_getDepth(&spool));
+    checkSample(&spool, 0, 0, false);
+    checkSample(&spool, 1, 1, true);
+    closeSpool(&spool);
+}
+
+static void testStringsSpilledWhileRead(void)
+{
+    SitewiseSpool_t spool;
+    const uint32_t inFlight = 3;
+
+    unlink(spoolPath);
+    SitewiseSpool_init(&spool, slots, TEST_RAM_CAPACITY, spoolPath, TEST_FILE_CAPACITY);
+
+    /* The odd sequence numbers are strings. A replay has read the first three samples and is in flight. */
+    push(&spool, 0);
+    pushString(&spool, 1);
+    push(&spool, 2);
+    pushString(&spool, 3);
+    for (uint32_t i = 0; i < inFlight; i++)
+    {
+        checkSample(&spool, i, i, false);
+    }
+
+    /* Two spills while it is in flight, each with a string among the samples it moves */
+    push(&spool, 4);
+    push(&spool, 5);
+    push(&spool, 6);
+    TEST_ASSERT_EQUAL_INT(4, spool.fileDepth);
+    TEST_ASSERT_EQUAL_INT(2, spool.droppedStrings);
+
+    /* The next replay reads on behind the one in flight, and the samples it had read are the ones consumed */
+    checkSample(&spool, inFlight, 3, true);
+    for (uint32_t i = inFlight + 1; i < 7; i++)
+    {
+        checkSample(&spool, i, i, false);
+    }
+    SitewiseSpool_consume(&spool, inFlight, 1000);
+    TEST_ASSERT_EQUAL_INT(4, SitewiseSpool_getDepth(&spool));
+    checkSample(&spool, 0, 3, true);
+    checkSample(&spool, 1, 4, false);
+    closeSpool(&spool);
+}
+
+static void testOtherSizeStartsOver(void)
+{
+    SitewiseSpool_t spool;
+
+    unlink(spoolPath);
+    SitewiseSpool_init(&spool, slots, TEST_RAM_CAPACITY, spoolPath, TEST_FILE_CAPACITY);
+    for (uint32_t i = 0; i < TEST_RAM_CAPACITY + TEST_FILE_CAPACITY; i++)
+    {
+        push(&spool, i);
+    }
+    closeSpool(&spool);
+
+    TEST_ASSERT_EQUAL_INT(SITEWISE_SPOOL_ERROR_NONE,
+                          SitewiseSpool_init(&spool, slots, TEST_RAM_CAPACITY, spoolPath, 2 * TEST_FILE_CAPACITY));
+    TEST_ASSERT_EQUAL_INT(0, SitewiseSpool_getDepth(&spool));
+    closeSpool(&spool);
+
+    /* A header that counts more records than the file holds */
+    FILE *pFile = fopen(spoolPath, "r+b");
+    uint32_t depth = 2 * TEST_FILE_CAPACITY;
+    TEST_ASSERT(pFile != NULL && fseek(pFile, 16, SEEK_SET) == 0 && fwrite(&depth, sizeof(depth), 1, pFile) == 1);
+    fclose(pFile);
+    SitewiseSpool_init(&spool, slots, TEST_RAM_CAPACITY, spoolPath, 2 * TEST_FILE_CAPACITY);
+    TEST_ASSERT_EQUAL_INT(0, SitewiseSpool_getDepth(&spool));
+    closeSpool(&spool);
+}
+
+int main(void)
+{
+    snprintf(spoolPath, sizeof(spoolPath), "test_sitewise_spool_%d.bin", (int)getpid());
+
+    RUN_TEST(testRamOnly);
+    RUN_TEST(testSpillInOrder);
+    RUN_TEST(testSpaceTakenAgainBeforeDrain);
+    RUN_TEST(testResumeAfterReboot);
+    RUN_TEST(testStringsNotSpilled);
+    RUN_TEST(testStringsSpilledWhileRead);
+    RUN_TEST(testOtherSizeStartsOver);
+
+    unlink(spoolPath);
+    return HOST_TEST_RESULT();
+}